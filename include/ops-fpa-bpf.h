@@ -0,0 +1,43 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *
+ *  File: ops-fpa-bpf.h
+ *
+ *  Purpose: In-kernel eBPF filter of frames CPU TAP interfaces pass to
+ *           userspace.
+ */
+
+#ifndef OPS_FPA_BPF_H
+#define OPS_FPA_BPF_H 1
+
+#include <stdbool.h>
+#include <net/ethernet.h>
+
+/* Loads filter for TAP interface of port 'pid' on switch 'sid' with MAC
+ * address 'mac'. Filter passes untagged frames with source MAC 'mac' and
+ * tagged frames of VLANs port is egress member of. If port VLANs can't
+ * be kept in kernel, its tagged frames all pass and are left to TAP
+ * worker. Returns program fd or negative errno value. */
+int ops_fpa_bpf_tap_filter_load(int sid, int pid, const struct ether_addr *mac);
+
+/* Updates VLAN membership used by TAP filters. Thread safe. */
+void ops_fpa_bpf_vlan_update(int sid, int pid, int vid, bool member);
+
+/* Forgets VLAN membership of port 'pid' on switch 'sid' once its TAP
+ * interface is removed. Thread safe. */
+void ops_fpa_bpf_port_remove(int sid, int pid);
+
+#endif /* OPS_FPA_BPF_H */
@@ -0,0 +1,59 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *
+ *  File: ops-fpa-capture.h
+ *
+ *  Purpose: pcap-ng capture of packets trapped to CPU and sent by CPU.
+ */
+
+#ifndef OPS_FPA_CAPTURE_H
+#define OPS_FPA_CAPTURE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ovs-atomic.h>
+#include <util.h>
+
+/* Capture is running. Only flag CPU packet path checks per packet. */
+extern atomic_bool ops_fpa_capture_on;
+
+/* Metadata of captured packet, saved in its pcap-ng block */
+struct ops_fpa_capture_meta {
+    bool inbound;           /* Trapped to CPU, otherwise sent by CPU */
+    uint32_t port;          /* Ingress port if inbound, egress otherwise */
+    uint16_t vid;
+    uint32_t reason;        /* Trap reason, inbound only */
+    uint32_t tableId;       /* Flow table which trapped, inbound only */
+};
+
+static inline bool
+ops_fpa_capture_enabled(void)
+{
+    bool on;
+
+    atomic_read_relaxed(&ops_fpa_capture_on, &on);
+    return OVS_UNLIKELY(on);
+}
+
+/* Queues packet to capture if it passes capture filter. Lock-free, may be
+ * called by any thread between RCU quiescent states. Packets are dropped
+ * if writer thread falls behind. */
+void ops_fpa_capture_packet(const struct ops_fpa_capture_meta *meta,
+                            const void *data, uint32_t len);
+
+void ops_fpa_capture_unixctl_init(void);
+
+#endif /* OPS_FPA_CAPTURE_H */
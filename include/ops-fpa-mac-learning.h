@@ -22,49 +22,136 @@
 #ifndef OPS_FPA_MAC_LEARNING_H
 #define OPS_FPA_MAC_LEARNING_H 1
 
+#include "cmap.h"
+#include "guarded-list.h"
 #include "hmap.h"
 #include "latch.h"
+#include "list.h"
+#include "ovs-atomic.h"
+#include "seq.h"
 #include "timer.h"
 #include "mac-learning.h"
 #include "mac-learning-plugin.h"
 
 #include "ops-fpa-dev.h"
 
+/* VLANs with own list of MAC learning table entries. */
+#define OPS_FPA_ML_MAX_VLANS     4096
+
 /* Default maximum size of a MAC learning table, in entries. */
 #define OPS_FPA_ML_DEFAULT_SIZE  MAC_DEFAULT_MAX
 
 /* Time, in seconds, before expiring a MAC entry due to inactivity. */
 #define OPS_FPA_ML_ENTRY_DEFAULT_IDLE_TIME  MAC_ENTRY_DEFAULT_IDLE_TIME
 
+/* FDB events queued from ASIC reader to event thread, power of 2. */
+#define OPS_FPA_ML_RING_SIZE     4096
+
 /* The buffers are defined as 2 in order to allow simultaneous read access to
  * bridge.c and ops-fpa-mac-learning.c code from different threads.
  */
 #define OPS_FPA_ML_NUM_BUFFERS   2
 
-/* A MAC learning table entry.
- * Guarded by owning 'fpa_mac_learning''s rwlock */
+/* Statistics of the threads receiving FDB events from ASIC and applying
+ * them to the table. Each counter is updated by one of them only, notify
+ * and mlearn counters under the table write lock. */
+struct fpa_ml_stats {
+    atomic_uint64_t wakeups;        /* Returns from wait for AU messages */
+    atomic_uint64_t empty_polls;    /* AU queue found empty */
+    atomic_uint64_t au_msgs;        /* AU messages received */
+    atomic_uint64_t au_errors;      /* AU queue read failures */
+    atomic_uint32_t backoff_ms;     /* Current wait for AU messages */
+    atomic_uint64_t au_batches;     /* Batches applied to the table */
+    atomic_uint64_t au_coalesced;   /* Messages superseded by later one in batch */
+    atomic_uint64_t lock_holds;     /* Write lock acquisitions for batches */
+    atomic_uint64_t lock_breaks;    /* Batch lock holds cut by hold time limit */
+    atomic_uint64_t lock_hold_max_us; /* Longest write lock hold */
+    atomic_uint64_t rate;           /* Messages applied per second, last second */
+    atomic_uint64_t rate_max;       /* Highest 'rate' seen */
+    atomic_uint64_t ring_full;      /* AU reads put off by full event ring */
+    atomic_uint32_t ring_max;       /* Highest event ring depth */
+    atomic_uint64_t ctrl_events;    /* Port down and VLAN removed events */
+    atomic_uint64_t ev_wakeups;     /* Event thread returns from wait */
+    atomic_uint64_t notifies;       /* Learned MAC callbacks to vswitchd */
+    atomic_uint64_t notify_events;  /* MAC events handed over by them */
+    atomic_uint64_t mlearn_spilled; /* MAC events put off by full hmap */
+    atomic_uint64_t mlearn_spill_max; /* Highest number of put off events */
+    atomic_uint64_t mlearn_dropped; /* MAC add events dropped, resynced */
+    atomic_uint64_t mlearn_lost;    /* MAC delete events dropped */
+    atomic_uint64_t mlearn_resyncs; /* Re-exports of the whole table */
+};
+
+/* A MAC learning table entry, one cache line. Allocated from a slab, not
+ * changed once inserted, may be read under RCU. Lists are guarded by
+ * owning 'fpa_mac_learning''s rwlock */
 struct fpa_mac_entry {
-    struct hmap_node hmap_node; /* Node in a fpa_mac_learning hmap. */
-
-    FPA_EVENT_ADDRESS_MSG_STC fdb_entry;
-    /* The following are marked guarded to prevent users from iterating over or
-     * accessing a fpa_mac_entry without holding the parent fpa_mac_learning rwlock. */
-    /* Learned port. */
-    union {
-        void *p;
-        ofp_port_t ofp_port;
-    } port OVS_GUARDED;
+    struct cmap_node cmap_node; /* Node in 'table' of fpa_mac_learning. */
+    uint32_t hash;              /* Hash of 'key'. */
+    uint32_t portNum;           /* Learned port. */
+    uint64_t key;               /* VLAN and MAC, see ops_fpa_ml_key(). */
+    long long int learned;      /* When learned, in ms. */
+    struct ovs_list port_node;  /* Node in 'entries' of fpa_ml_port, or in
+                                 * slab free list while not in use. */
+    struct ovs_list vlan_node;  /* Node in 'vlan_entries' of fpa_mac_learning. */
 };
 
-/* MAC learning table. */
+/* Packs VLAN 'vid' and MAC 'mac' into FDB key, VLAN in the top 16 bits. */
+static inline uint64_t
+ops_fpa_ml_key(uint16_t vid, const FPA_MAC_ADDRESS_STC *mac)
+{
+    const uint8_t *a = mac->addr;
+
+    return ((uint64_t) vid << 48)
+           | ((uint64_t) a[0] << 40) | ((uint64_t) a[1] << 32)
+           | ((uint64_t) a[2] << 24) | ((uint64_t) a[3] << 16)
+           | ((uint64_t) a[4] << 8) | a[5];
+}
+
+static inline uint16_t
+ops_fpa_ml_key_vid(uint64_t key)
+{
+    return key >> 48;
+}
+
+static inline void
+ops_fpa_ml_key_mac(uint64_t key, FPA_MAC_ADDRESS_STC *mac)
+{
+    int i;
+
+    for (i = ETH_ADDR_LEN - 1; i >= 0; i--) {
+        mac->addr[i] = key;
+        key >>= 8;
+    }
+}
+
+/* MAC learning table entries learned on one port.
+ * Exists while the port has entries. */
+struct fpa_ml_port {
+    struct hmap_node hmap_node;     /* Node in 'ports' of fpa_mac_learning. */
+    uint32_t portNum;
+    struct ovs_list entries;        /* Contains "struct fpa_mac_entry"s. */
+    size_t n_entries;
+};
+
+struct ml_event_ring;
+
+/* MAC learning table. Lookups in 'table' are lock-free, all changes and
+ * the rest of the members are guarded by 'rwlock'. */
 struct fpa_mac_learning {
-    struct hmap table;              /* Learning table. */
+    struct cmap table;              /* Learning table, by VLAN and MAC. */
+    struct hmap ports;              /* Contains "struct fpa_ml_port"s. */
+    struct ovs_list vlan_entries[OPS_FPA_ML_MAX_VLANS]; /* Entries by VLAN. */
+    size_t vlan_n_entries[OPS_FPA_ML_MAX_VLANS];
     unsigned int idle_time;         /* Max age before deleting an entry. */
     size_t max_entries;             /* Max number of learned MACs. */
     struct ovs_refcount ref_cnt;
     struct ovs_rwlock rwlock;
     pthread_t ml_asic_thread;       /* ML Thread ID. */
+    pthread_t ml_event_thread;      /* Applies FDB events to the table. */
     struct latch exit_latch;     /* Tells child threads to exit. */
+    struct ml_event_ring *events;   /* AU events from ASIC thread. */
+    struct guarded_list ctrl_events; /* Contains "struct ml_ctrl_event"s. */
+    struct seq *event_seq;          /* Changes when an event is queued. */
     struct fpa_dev *dev;
     /* Tables which store mac learning events destined for main
      * processing in OPS mac-learning-plugin. */
@@ -72,7 +159,18 @@ struct fpa_mac_learning {
     /* Index of a mlearn table which is currently in use. */
     int curr_mlearn_table_in_use;
     struct timer mlearn_timer;
+    /* When pending mlearn events are handed to vswitchd, LLONG_MAX if
+     * none are pending. */
+    atomic_llong mlearn_deadline;
+    struct seq *mlearn_seq;         /* Changes when 'mlearn_deadline' is set. */
+    /* Events which found current mlearn table full, by mlearn index.
+     * Contains "struct ml_spill_event"s. */
+    struct hmap mlearn_spill;
+    /* Add events were dropped, whole table is to be handed over again. */
+    bool mlearn_resync;
+    struct cmap_position mlearn_resync_pos; /* Next entry to hand over. */
     struct mac_learning_plugin_interface *plugin_interface;
+    struct fpa_ml_stats stats;
 };
 
 typedef enum {
@@ -105,23 +203,48 @@ int ops_fpa_mac_learning_set_idle_time(struct fpa_mac_learning *ml,
 
 void ops_fpa_mac_learning_flush(struct fpa_mac_learning *ml)
     OVS_REQ_WRLOCK(ml->rwlock);
+void ops_fpa_mac_learning_flush_port(struct fpa_mac_learning *ml,
+                                     uint32_t portNum)
+    OVS_REQ_WRLOCK(ml->rwlock);
+void ops_fpa_mac_learning_flush_vlan(struct fpa_mac_learning *ml, uint16_t vid)
+    OVS_REQ_WRLOCK(ml->rwlock);
+
+void ops_fpa_mac_learning_port_down(struct fpa_mac_learning *ml,
+                                    uint32_t portNum);
+void ops_fpa_mac_learning_vlan_removed(struct fpa_mac_learning *ml,
+                                       uint16_t vid);
+
+size_t ops_fpa_mac_learning_count_port(const struct fpa_mac_learning *ml,
+                                       uint32_t portNum)
+    OVS_REQ_RDLOCK(ml->rwlock);
+size_t ops_fpa_mac_learning_count_vlan(const struct fpa_mac_learning *ml,
+                                       uint16_t vid)
+    OVS_REQ_RDLOCK(ml->rwlock);
 
 void ops_fpa_mac_learning_dump_table(struct fpa_mac_learning *ml,
                                     struct ds *d_str);
+void ops_fpa_mac_learning_dump_stats(struct fpa_mac_learning *ml,
+                                     struct ds *d_str);
 
 void ops_fpa_mac_learning_on_mlearn_timer_expired(struct fpa_mac_learning *ml);
+void ops_fpa_mac_learning_run(struct fpa_mac_learning *ml);
+void ops_fpa_mac_learning_wait(struct fpa_mac_learning *ml);
 
 int ops_fpa_ml_hmap_get(struct mlearn_hmap **mhmap);
 
+/* Lookups need no lock. Returned entry is valid until the calling thread
+ * quiesces. */
 struct fpa_mac_entry *
 ops_fpa_mac_learning_lookup(const struct fpa_mac_learning *ml,
-                            FPA_EVENT_ADDRESS_MSG_STC *fdb_entry)
-    OVS_REQ_RDLOCK(ml->rwlock);
+                            FPA_EVENT_ADDRESS_MSG_STC *fdb_entry);
 
 struct fpa_mac_entry *
 ops_fpa_mac_learning_lookup_by_vlan_and_mac(const struct fpa_mac_learning *ml,
                                             uint16_t vlan_id,
-                                            FPA_MAC_ADDRESS_STC macAddr)
-    OVS_REQ_RDLOCK(ml->rwlock);
+                                            FPA_MAC_ADDRESS_STC macAddr);
+
+int ops_fpa_mac_learning_get_port(struct fpa_mac_learning *ml, uint16_t vid,
+                                  const uint8_t mac[ETH_ADDR_LEN],
+                                  uint32_t *portNum);
 
 #endif /* OPS_FPA_MAC_LEARNING_H */
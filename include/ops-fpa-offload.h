@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *  File: ops-fpa-offload.h
+ *
+ *  Purpose: Software checksum, TCP segmentation (GSO) and receive
+ *           coalescing (GRO) for CPU TAP interfaces with vnet header.
+ */
+
+#ifndef OPS_FPA_OFFLOAD_H
+#define OPS_FPA_OFFLOAD_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/virtio_net.h>
+
+/* Max frame exchanged with TAP interface with vnet header, without it */
+#define OPS_FPA_GSO_MAX_LEN         (14 + 4 + 65535)
+
+/* Max L2 to L4 headers length of segmented frame */
+#define OPS_FPA_GSO_MAX_HDR_LEN     256
+
+/* Called for every segment, 'data' is valid until next segment */
+typedef void (*ops_fpa_gso_cb)(void *aux, uint8_t *data, uint32_t len);
+
+/* Called for every coalesced frame with vnet header to write */
+typedef void (*ops_fpa_gro_cb)(void *aux, void *owner,
+                               const struct virtio_net_hdr *vh,
+                               const uint8_t *data, uint32_t len,
+                               uint32_t n_segs);
+
+/* Coalescing context of TCP/IPv4 segments of one flow */
+struct ops_fpa_gro {
+    ops_fpa_gro_cb cb;
+    void *aux;
+
+    void *owner;            /* Destination of pending frame, NULL if none */
+    uint8_t *buf;           /* Pending frame */
+    uint32_t len;
+    uint32_t hdr_len;       /* L2 to L4 headers length */
+    uint32_t mss;           /* Payload length of the first segment */
+    uint32_t next_seq;      /* Expected sequence number of next segment */
+    uint32_t n_segs;
+};
+
+int ops_fpa_csum_complete(uint8_t *data, uint32_t len,
+                          const struct virtio_net_hdr *vh);
+int ops_fpa_gso_segment(uint8_t *data, uint32_t len,
+                        const struct virtio_net_hdr *vh,
+                        ops_fpa_gso_cb cb, void *aux);
+
+void ops_fpa_gro_init(struct ops_fpa_gro *gro, ops_fpa_gro_cb cb, void *aux);
+void ops_fpa_gro_destroy(struct ops_fpa_gro *gro);
+bool ops_fpa_gro_add(struct ops_fpa_gro *gro, void *owner,
+                     const uint8_t *data, uint32_t len);
+void ops_fpa_gro_flush(struct ops_fpa_gro *gro);
+
+#endif /* OPS_FPA_OFFLOAD_H */
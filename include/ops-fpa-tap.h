@@ -22,11 +22,25 @@
 #ifndef OPS_FPA_TAP_H
 #define OPS_FPA_TAP_H 1
 
+#include <stdbool.h>
 #include <net/ethernet.h>
 
 struct tap_info;
+struct fpa_mac_learning;
 
-struct tap_info *ops_fpa_tap_init(uint32_t switchId);
+/* CPU packet path counters, directions are from host point of view */
+struct ops_fpa_tap_cpu_stats {
+    uint64_t rx_packets;    /* ASIC to TAP */
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;
+    uint64_t tx_packets;    /* TAP to ASIC */
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;
+};
+
+/* 'ml' is FDB of the switch SVI traffic is forwarded by, it must outlive
+ * TAP interfaces. */
+struct tap_info *ops_fpa_tap_init(uint32_t switchId, struct fpa_mac_learning *ml);
 void ops_fpa_tap_deinit(uint32_t switchId);
 
 int ops_fpa_bridge_create(const char *name, const struct ether_addr *mac);
@@ -34,8 +48,18 @@ int ops_fpa_bridge_delete(const char *name);
 int ops_fpa_bridge_port_add(const char *name);
 int ops_fpa_bridge_port_rm(const char *name);
 
+/* Marks VLAN 'vid' as having SVI or not. In direct SVI mode its traffic
+ * is exchanged with SVI TAP interface instead of port TAP interfaces. */
+void ops_fpa_tap_svi_vlan_set(uint32_t switchId, int vid, bool svi);
+
 int ops_fpa_tap_if_create(uint32_t switchId, uint32_t portNum, const char *name,
                           const struct ether_addr *mac, int* tap_fd);
 int ops_fpa_tap_if_delete(uint32_t switchId, int tap_fd);
 
+/* Gets CPU packet counters of VLAN 'vid' or of all VLANs if 'vid' is
+ * negative. Must be called from main thread, does not take FPA device
+ * mutex. */
+int ops_fpa_tap_cpu_stats_get(uint32_t switchId, int vid,
+                              struct ops_fpa_tap_cpu_stats *stats);
+
 #endif /* OPS_FPA_TAP_H */
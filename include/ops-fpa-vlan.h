@@ -52,6 +52,19 @@ void ops_fpa_vlan_fetch(int sid, int pid, unsigned long *vmap);
 int ops_fpa_vlan_add(int sid, int pid, int vidx);
 /* delete vidx encoded flow form FPA */
 int ops_fpa_vlan_del(int sid, int pid, int vidx);
+/* get cached egress tag state of port 'pid' in VLAN 'vid' into 'pop',
+ * returns ENOENT if port is not egress member of VLAN or 'vid' is not a
+ * valid VLAN ID. Thread safe. */
+int ops_fpa_vlan_egress_state(int sid, int pid, int vid, bool *pop);
+/* get egress member ports of VLAN 'vid' with their pop tag state into
+ * 'pids' and 'pops', up to 'max' ports, returns number of all member
+ * ports, which may exceed 'max', none if 'vid' is not a valid VLAN ID. Thread safe, must be called from RCU
+ * reader. */
+size_t ops_fpa_vlan_egress_members(int sid, int vid, uint32_t pids[],
+                                   bool pops[], size_t max);
+/* delete egress VLAN memberships of port 'pid' from FPA and forget its
+ * cached egress tag state, called when port is deleted */
+void ops_fpa_vlan_port_remove(int sid, int pid);
 /* return true if 'vid' is internal VLAN ID, false otherwise */
 bool ops_fpa_vlan_internal(int vid);
 /* add flows for port 'pid' on switch 'sid' with internal VLAN ID 'vid' */
@@ -0,0 +1,352 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *
+ *  File: ops-fpa-bpf.c
+ *
+ *  Purpose: In-kernel eBPF filter of frames CPU TAP interfaces pass to
+ *           userspace.
+ *
+ *           Kernel bridge floods frames onto every TAP interface, while
+ *           TAP worker sends to ASIC only untagged frames from TAP own MAC
+ *           and tagged frames of VLANs the port is member of. The filter
+ *           does the same check in tun driver, so the rest never reaches
+ *           userspace. Programs are assembled here, no compiler or libbpf
+ *           is needed.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <openvswitch/vlog.h>
+#include <hash.h>
+#include <hmap.h>
+#include <ovs-thread.h>
+
+#include "ops-fpa.h"
+#include "ops-fpa-bpf.h"
+
+VLOG_DEFINE_THIS_MODULE(ops_fpa_bpf);
+
+#define OPS_FPA_BPF_PORT_MAP_SIZE   4096  /* Max ports of all switches */
+#define OPS_FPA_BPF_VLAN_BYTES      (4096 / 8) /* VLAN bitmap of one port */
+#define OPS_FPA_BPF_LOG_SIZE        4096  /* Verifier log kept on load failure */
+
+/* Key of VLAN membership map */
+#define OPS_FPA_BPF_PORT_KEY(sid, pid) \
+    (((uint64_t)(sid) << 32) | (uint32_t)(pid))
+
+/* Instruction encoding, as in kernel samples/bpf/bpf_insn.h */
+#define BPF_INSN(CODE, DST, SRC, OFF, IMM) \
+    ((struct bpf_insn) { .code = (CODE), .dst_reg = (DST), .src_reg = (SRC), \
+                         .off = (OFF), .imm = (IMM) })
+#define BPF_MOV64_REG(DST, SRC) \
+    BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, DST, SRC, 0, 0)
+#define BPF_MOV64_IMM(DST, IMM) \
+    BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define BPF_MOV32_IMM(DST, IMM) \
+    BPF_INSN(BPF_ALU | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define BPF_ALU64_IMM(OP, DST, IMM) \
+    BPF_INSN(BPF_ALU64 | BPF_OP(OP) | BPF_K, DST, 0, 0, IMM)
+#define BPF_ALU64_REG(OP, DST, SRC) \
+    BPF_INSN(BPF_ALU64 | BPF_OP(OP) | BPF_X, DST, SRC, 0, 0)
+#define BPF_LDX_MEM(SIZE, DST, SRC, OFF) \
+    BPF_INSN(BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM, DST, SRC, OFF, 0)
+#define BPF_STX_MEM(SIZE, DST, SRC, OFF) \
+    BPF_INSN(BPF_STX | BPF_SIZE(SIZE) | BPF_MEM, DST, SRC, OFF, 0)
+#define BPF_LD_ABS(SIZE, IMM) \
+    BPF_INSN(BPF_LD | BPF_SIZE(SIZE) | BPF_ABS, 0, 0, 0, IMM)
+#define BPF_LD_IMM64_RAW(DST, SRC, IMM) \
+    BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, DST, SRC, 0, (uint32_t) (IMM)), \
+    BPF_INSN(0, 0, 0, 0, (uint64_t) (IMM) >> 32)
+#define BPF_LD_IMM64(DST, IMM)      BPF_LD_IMM64_RAW(DST, 0, IMM)
+#define BPF_LD_MAP_FD(DST, FD)      BPF_LD_IMM64_RAW(DST, BPF_PSEUDO_MAP_FD, FD)
+#define BPF_JMP_IMM(OP, DST, IMM, OFF) \
+    BPF_INSN(BPF_JMP | BPF_OP(OP) | BPF_K, DST, 0, OFF, IMM)
+#define BPF_JMP_REG(OP, DST, SRC, OFF) \
+    BPF_INSN(BPF_JMP | BPF_OP(OP) | BPF_X, DST, SRC, OFF, 0)
+#define BPF_JMP_A(OFF)              BPF_INSN(BPF_JMP | BPF_JA, 0, 0, OFF, 0)
+#define BPF_EMIT_CALL(FUNC)         BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FUNC)
+#define BPF_EXIT_INSN()             BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+static struct ovs_mutex bpf_mutex = OVS_MUTEX_INITIALIZER;
+
+/* VLAN membership map shared by all filters: key is
+ * OPS_FPA_BPF_PORT_KEY(), value is bitmap of VLANs port is egress member
+ * of. Filter passes all tagged frames of port without value, so a port
+ * whose value could not be written is not filtered rather than cut off.
+ * -1 if not created yet. */
+static int vlan_map_fd OVS_GUARDED_BY(bpf_mutex) = -1;
+
+/* VLAN membership of one port. Whole bitmap is written on every change,
+ * so the map is right again after a failed write. */
+struct bpf_port {
+    struct hmap_node node;          /* In 'bpf_ports'. */
+    uint64_t key;
+    uint8_t vlans[OPS_FPA_BPF_VLAN_BYTES];
+};
+
+static struct hmap bpf_ports OVS_GUARDED_BY(bpf_mutex)
+    = HMAP_INITIALIZER(&bpf_ports);
+
+/* eBPF is not available, no more attempts */
+static bool bpf_failed OVS_GUARDED_BY(bpf_mutex);
+
+static int
+sys_bpf(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof *attr);
+}
+
+/* Returns VLAN membership map fd, creating it on first call, or
+ * negative errno value. */
+static int
+bpf_vlan_map_get(void)
+    OVS_REQUIRES(bpf_mutex)
+{
+    union bpf_attr attr;
+    int fd;
+
+    if (vlan_map_fd >= 0 || bpf_failed) {
+        return bpf_failed ? -EOPNOTSUPP : vlan_map_fd;
+    }
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_type = BPF_MAP_TYPE_HASH;
+    attr.key_size = sizeof(uint64_t);
+    attr.value_size = OPS_FPA_BPF_VLAN_BYTES;
+    attr.max_entries = OPS_FPA_BPF_PORT_MAP_SIZE;
+    attr.map_flags = BPF_F_NO_PREALLOC;
+
+    fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (fd < 0) {
+        VLOG_WARN("Unable to create VLAN map, TAP interfaces are not filtered in kernel. Error(%d) - %s",
+                  errno, strerror(errno));
+        bpf_failed = true;
+        return -EOPNOTSUPP;
+    }
+
+    vlan_map_fd = fd;
+    return fd;
+}
+
+static struct bpf_port *
+bpf_port_get(int sid, int pid)
+    OVS_REQUIRES(bpf_mutex)
+{
+    uint64_t key = OPS_FPA_BPF_PORT_KEY(sid, pid);
+    struct bpf_port *port;
+
+    HMAP_FOR_EACH_WITH_HASH (port, node, hash_uint64(key), &bpf_ports) {
+        if (port->key == key) {
+            return port;
+        }
+    }
+
+    port = xzalloc(sizeof *port);
+    port->key = key;
+    hmap_insert(&bpf_ports, &port->node, hash_uint64(key));
+
+    return port;
+}
+
+/* Writes VLAN bitmap of 'port' to map 'fd'. On failure removes the port
+ * from the map, so its tagged frames are left to TAP worker. */
+static void
+bpf_port_write(int fd, struct bpf_port *port)
+    OVS_REQUIRES(bpf_mutex)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_fd = fd;
+    attr.key = (uintptr_t) &port->key;
+    attr.value = (uintptr_t) port->vlans;
+    attr.flags = BPF_ANY;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        VLOG_WARN("sid=%d pid=%d: Unable to write VLANs to filter map, port is not filtered in kernel. Error(%d) - %s",
+                  (int) (port->key >> 32), (int) (uint32_t) port->key,
+                  errno, strerror(errno));
+
+        memset(&attr, 0, sizeof attr);
+        attr.map_fd = fd;
+        attr.key = (uintptr_t) &port->key;
+        if (sys_bpf(BPF_MAP_DELETE_ELEM, &attr) < 0 && errno != ENOENT) {
+            VLOG_ERR("sid=%d pid=%d: Unable to remove port from filter map. Error(%d) - %s",
+                     (int) (port->key >> 32), (int) (uint32_t) port->key,
+                     errno, strerror(errno));
+        }
+    }
+}
+
+void
+ops_fpa_bpf_vlan_update(int sid, int pid, int vid, bool member)
+{
+    struct bpf_port *port;
+    int fd;
+
+    if (vid < 0 || vid >= OPS_FPA_BPF_VLAN_BYTES * 8) {
+        return;
+    }
+
+    ovs_mutex_lock(&bpf_mutex);
+
+    fd = bpf_vlan_map_get();
+    if (fd < 0) {
+        ovs_mutex_unlock(&bpf_mutex);
+        return;
+    }
+
+    port = bpf_port_get(sid, pid);
+    if (member) {
+        port->vlans[vid / 8] |= 1 << (vid % 8);
+    } else {
+        port->vlans[vid / 8] &= ~(1 << (vid % 8));
+    }
+    bpf_port_write(fd, port);
+
+    ovs_mutex_unlock(&bpf_mutex);
+}
+
+void
+ops_fpa_bpf_port_remove(int sid, int pid)
+{
+    uint64_t key = OPS_FPA_BPF_PORT_KEY(sid, pid);
+    struct bpf_port *port;
+    union bpf_attr attr;
+
+    ovs_mutex_lock(&bpf_mutex);
+
+    HMAP_FOR_EACH_WITH_HASH (port, node, hash_uint64(key), &bpf_ports) {
+        if (port->key == key) {
+            hmap_remove(&bpf_ports, &port->node);
+            free(port);
+            break;
+        }
+    }
+
+    if (vlan_map_fd >= 0) {
+        memset(&attr, 0, sizeof attr);
+        attr.map_fd = vlan_map_fd;
+        attr.key = (uintptr_t) &key;
+        if (sys_bpf(BPF_MAP_DELETE_ELEM, &attr) < 0 && errno != ENOENT) {
+            VLOG_ERR("sid=%d pid=%d: Unable to remove port from filter map. Error(%d) - %s",
+                     sid, pid, errno, strerror(errno));
+        }
+    }
+
+    ovs_mutex_unlock(&bpf_mutex);
+}
+
+int
+ops_fpa_bpf_tap_filter_load(int sid, int pid, const struct ether_addr *mac)
+{
+    const uint8_t *a = mac->ether_addr_octet;
+    uint32_t mac_hi = ((uint32_t) a[0] << 24) | (a[1] << 16) | (a[2] << 8) | a[3];
+    uint32_t mac_lo = (a[4] << 8) | a[5];
+    static char log[OPS_FPA_BPF_LOG_SIZE];
+    union bpf_attr attr;
+    int map_fd;
+    int fd;
+
+    ovs_mutex_lock(&bpf_mutex);
+
+    map_fd = bpf_vlan_map_get();
+    if (map_fd < 0) {
+        ovs_mutex_unlock(&bpf_mutex);
+        return map_fd;
+    }
+
+    /* Port has no VLANs until told otherwise */
+    bpf_port_write(map_fd, bpf_port_get(sid, pid));
+
+    /* Returns frame length to pass it or 0 to drop. LD_ABS loads are in
+     * host order, clobber R1-R5 and drop frames too short for them. Tag
+     * may be in frame or, if not inserted yet, in skb metadata. */
+    struct bpf_insn prog[] = {
+        /* 0 */  BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+        /* 1 */  BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_6,
+                             offsetof(struct __sk_buff, vlan_present)),
+        /* 2 */  BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 11),           /* -> 14 */
+        /* 3 */  BPF_LD_ABS(BPF_H, 2 * ETH_ALEN),
+        /* 4 */  BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, ETHERTYPE_VLAN, 7), /* -> 12 */
+
+        /* Untagged: source MAC */
+        /* 5 */  BPF_LD_ABS(BPF_W, ETH_ALEN),
+        /* 6 */  BPF_MOV32_IMM(BPF_REG_2, mac_hi),
+        /* 7 */  BPF_JMP_REG(BPF_JNE, BPF_REG_0, BPF_REG_2, 29),   /* -> 37 */
+        /* 8 */  BPF_LD_ABS(BPF_H, ETH_ALEN + 4),
+        /* 9 */  BPF_MOV32_IMM(BPF_REG_2, mac_lo),
+        /* 10 */ BPF_JMP_REG(BPF_JNE, BPF_REG_0, BPF_REG_2, 26),   /* -> 37 */
+        /* 11 */ BPF_JMP_A(23),                                    /* -> 35 */
+
+        /* Tagged: VLAN bit in port bitmap, pass if port has none */
+        /* 12 */ BPF_LD_ABS(BPF_H, ETH_HLEN),
+        /* 13 */ BPF_JMP_A(1),                                     /* -> 15 */
+        /* 14 */ BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_6,
+                             offsetof(struct __sk_buff, vlan_tci)),
+        /* 15 */ BPF_ALU64_IMM(BPF_AND, BPF_REG_0, 0xfff),
+        /* 16 */ BPF_MOV64_REG(BPF_REG_7, BPF_REG_0),
+        /* 17 */ BPF_LD_IMM64(BPF_REG_1, OPS_FPA_BPF_PORT_KEY(sid, pid)),
+        /* 19 */ BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, -8),
+        /* 20 */ BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+        /* 22 */ BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+        /* 23 */ BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8),
+        /* 24 */ BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+        /* 25 */ BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 9),            /* -> 35 */
+        /* 26 */ BPF_MOV64_REG(BPF_REG_1, BPF_REG_7),
+        /* 27 */ BPF_ALU64_IMM(BPF_RSH, BPF_REG_1, 3),
+        /* 28 */ BPF_ALU64_IMM(BPF_AND, BPF_REG_1, OPS_FPA_BPF_VLAN_BYTES - 1),
+        /* 29 */ BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_1),
+        /* 30 */ BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_0, 0),
+        /* 31 */ BPF_ALU64_IMM(BPF_AND, BPF_REG_7, 7),
+        /* 32 */ BPF_ALU64_REG(BPF_RSH, BPF_REG_0, BPF_REG_7),
+        /* 33 */ BPF_ALU64_IMM(BPF_AND, BPF_REG_0, 1),
+        /* 34 */ BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2),            /* -> 37 */
+
+        /* Pass */
+        /* 35 */ BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_6,
+                             offsetof(struct __sk_buff, len)),
+        /* 36 */ BPF_EXIT_INSN(),
+
+        /* Drop */
+        /* 37 */ BPF_MOV64_IMM(BPF_REG_0, 0),
+        /* 38 */ BPF_EXIT_INSN(),
+    };
+
+    memset(&attr, 0, sizeof attr);
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns = (uintptr_t) prog;
+    attr.insn_cnt = ARRAY_SIZE(prog);
+    attr.license = (uintptr_t) "Apache-2.0";
+    attr.log_buf = (uintptr_t) log;
+    attr.log_size = sizeof log;
+    attr.log_level = 1;
+    log[0] = '\0';
+
+    fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if (fd < 0) {
+        fd = -errno;
+        VLOG_WARN("Unable to load filter for TAP interface of port %d. Error(%d) - %s\n%s",
+                  pid, -fd, strerror(-fd), log);
+    }
+
+    ovs_mutex_unlock(&bpf_mutex);
+
+    return fd;
+}
@@ -0,0 +1,591 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *
+ *  File: ops-fpa-capture.c
+ *
+ *  Purpose: pcap-ng capture of packets trapped to CPU and sent by CPU.
+ *
+ *           CPU packet path threads copy matching packets with their
+ *           metadata into lock-free staging ring. Writer thread formats
+ *           them as pcap-ng Enhanced Packet Blocks into memory mapped
+ *           capture file, so packet path never blocks on file I/O.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <openvswitch/vlog.h>
+#include <ovs-thread.h>
+#include <ovs-rcu.h>
+#include <dynamic-string.h>
+#include <unixctl.h>
+
+#include "ops-fpa.h"
+#include "ops-fpa-capture.h"
+
+VLOG_DEFINE_THIS_MODULE(ops_fpa_capture);
+
+#define OPS_FPA_CAPTURE_RING_SIZE   1024 /* Staged packets, power of 2 */
+#define OPS_FPA_CAPTURE_SNAPLEN     2048 /* Max bytes saved per packet */
+#define OPS_FPA_CAPTURE_CHUNK       (4 * 1024 * 1024) /* File is allocated and mapped by chunks */
+#define OPS_FPA_CAPTURE_POLL_MS     10   /* Writer sleep when staging ring is empty */
+
+/* pcap-ng block types and options */
+#define PCAPNG_BLOCK_SHB            0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB            0x00000001
+#define PCAPNG_BLOCK_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET    1
+#define PCAPNG_OPT_END              0
+#define PCAPNG_OPT_COMMENT          1
+#define PCAPNG_OPT_IF_NAME          2
+#define PCAPNG_OPT_IF_TSRESOL       9
+#define PCAPNG_OPT_EPB_FLAGS        2
+#define PCAPNG_EPB_INBOUND          0x1
+#define PCAPNG_EPB_OUTBOUND         0x2
+
+#define PCAPNG_PAD(LEN)             ROUND_UP(LEN, 4)
+
+/* Packet staged for writer thread */
+struct capture_slot {
+    /* Slot sequence number. Equals ring position when slot is free for
+     * producer at that position, position + 1 when it is filled. */
+    atomic_uint64_t seq;
+
+    struct ops_fpa_capture_meta meta;
+    uint64_t time_ns;       /* CLOCK_REALTIME timestamp */
+    uint32_t len;           /* Packet length */
+    uint32_t caplen;        /* Saved bytes in 'data' */
+    uint8_t data[OPS_FPA_CAPTURE_SNAPLEN];
+};
+
+/* Running capture */
+struct capture {
+    char *file_name;
+    int fd;
+
+    /* Filter, negative value matches any */
+    int port;
+    int vid;
+    int reason;
+
+    /* Staging ring, bounded multiple producers single consumer queue */
+    atomic_uint64_t head;   /* Next position to fill, producers side */
+    uint8_t pad0[CACHE_LINE_SIZE - sizeof(atomic_uint64_t)];
+    uint64_t tail;          /* Next position to write, writer side */
+    struct capture_slot *slots;
+
+    /* Writer thread, writes staged packets until stopped */
+    pthread_t thread;
+    atomic_bool stop;
+
+    /* Mapped chunk of capture file, owned by writer thread */
+    uint8_t *map;
+    off_t map_off;          /* File offset of mapped chunk */
+    size_t map_pos;         /* Write position in mapped chunk */
+    int error;              /* errno value writing failed with, 0 if none */
+
+    atomic_uint64_t packets;    /* Packets written to file */
+    atomic_uint64_t bytes;      /* File size */
+    atomic_uint64_t drops;      /* Packets not written: ring full or write error */
+};
+
+/* Capture is running */
+atomic_bool ops_fpa_capture_on;
+
+/* Running capture, NULL if none. Read by CPU packet path under RCU,
+ * changed by unixctl under 'capture_mutex'. */
+static OVSRCU_TYPE(struct capture *) capture_cur;
+static struct ovs_mutex capture_mutex = OVS_MUTEX_INITIALIZER;
+
+static inline void
+capture_stat_add(atomic_uint64_t *stat, uint64_t n)
+{
+    uint64_t orig;
+
+    atomic_add_relaxed(stat, n, &orig);
+}
+
+void
+ops_fpa_capture_packet(const struct ops_fpa_capture_meta *meta,
+                       const void *data, uint32_t len)
+{
+    struct capture *c = ovsrcu_get(struct capture *, &capture_cur);
+    struct capture_slot *slot;
+    struct timespec ts;
+    uint64_t pos, seq;
+    int64_t diff;
+
+    if (!c
+        || (c->port >= 0 && (uint32_t) c->port != meta->port)
+        || (c->vid >= 0 && c->vid != meta->vid)
+        || (c->reason >= 0 && (!meta->inbound || (uint32_t) c->reason != meta->reason))) {
+        return;
+    }
+
+    /* Claim next free slot. Producers race for position by CAS, slot
+     * sequence tells whether writer has already freed it. */
+    atomic_read_relaxed(&c->head, &pos);
+    for (;;) {
+        slot = &c->slots[pos & (OPS_FPA_CAPTURE_RING_SIZE - 1)];
+        atomic_read_explicit(&slot->seq, &seq, memory_order_acquire);
+        diff = (int64_t) (seq - pos);
+        if (!diff) {
+            if (atomic_compare_exchange_weak_explicit(&c->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Writer fell behind a whole ring */
+            capture_stat_add(&c->drops, 1);
+            return;
+        } else {
+            atomic_read_relaxed(&c->head, &pos);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->meta = *meta;
+    slot->time_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    slot->len = len;
+    slot->caplen = MIN(len, OPS_FPA_CAPTURE_SNAPLEN);
+    memcpy(slot->data, data, slot->caplen);
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/* Maps next chunk of capture file. Space is allocated first, so full
+ * file system is reported here instead of by SIGBUS on write. */
+static int
+capture_map_next(struct capture *c)
+{
+    int err;
+
+    if (c->map) {
+        munmap(c->map, OPS_FPA_CAPTURE_CHUNK);
+        c->map = NULL;
+        c->map_off += OPS_FPA_CAPTURE_CHUNK;
+        c->map_pos = 0;
+    }
+
+    err = posix_fallocate(c->fd, c->map_off, OPS_FPA_CAPTURE_CHUNK);
+    if (err) {
+        return err;
+    }
+
+    c->map = mmap(NULL, OPS_FPA_CAPTURE_CHUNK, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, c->fd, c->map_off);
+    if (c->map == MAP_FAILED) {
+        c->map = NULL;
+        return errno;
+    }
+
+    return 0;
+}
+
+/* Appends 'len' bytes of 'data' to capture file */
+static int
+capture_put(struct capture *c, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    while (len) {
+        size_t n;
+
+        if (!c->map || c->map_pos == OPS_FPA_CAPTURE_CHUNK) {
+            int err = capture_map_next(c);
+            if (err) {
+                return err;
+            }
+        }
+
+        n = MIN(len, OPS_FPA_CAPTURE_CHUNK - c->map_pos);
+        memcpy(c->map + c->map_pos, p, n);
+        c->map_pos += n;
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Appends option 'code' with 'len' bytes of 'value' padded to 32 bits */
+static int
+capture_put_opt(struct capture *c, uint16_t code, const void *value,
+                uint16_t len)
+{
+    static const uint8_t zeros[4];
+    uint16_t hdr[2] = { code, len };
+
+    return capture_put(c, hdr, sizeof hdr)
+           || capture_put(c, value, len)
+           || capture_put(c, zeros, PCAPNG_PAD(len) - len) ? EIO : 0;
+}
+
+/* Writes Section Header Block and the only Interface Description Block:
+ * Ethernet, nanosecond timestamps. */
+static int
+capture_put_header(struct capture *c)
+{
+    static const char if_name[] = "fpa-cpu";
+    static const uint8_t tsresol = 9;
+    static const uint32_t opt_end = PCAPNG_OPT_END;
+    uint32_t shb[7], idb[4];
+    uint32_t idb_len;
+
+    shb[0] = PCAPNG_BLOCK_SHB;
+    shb[1] = sizeof shb;
+    shb[2] = PCAPNG_BYTE_ORDER_MAGIC;
+    shb[3] = 1;                 /* Version 1.0 */
+    shb[4] = UINT32_MAX;        /* Section length not specified */
+    shb[5] = UINT32_MAX;
+    shb[6] = sizeof shb;
+
+    idb_len = sizeof idb + 4 + PCAPNG_PAD(sizeof if_name) + 4 + 4
+              + sizeof opt_end + 4;
+    idb[0] = PCAPNG_BLOCK_IDB;
+    idb[1] = idb_len;
+    idb[2] = PCAPNG_LINKTYPE_ETHERNET;
+    idb[3] = OPS_FPA_CAPTURE_SNAPLEN;
+
+    return capture_put(c, shb, sizeof shb)
+           || capture_put(c, idb, sizeof idb)
+           || capture_put_opt(c, PCAPNG_OPT_IF_NAME, if_name, sizeof if_name)
+           || capture_put_opt(c, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof tsresol)
+           || capture_put(c, &opt_end, sizeof opt_end)
+           || capture_put(c, &idb_len, sizeof idb_len) ? EIO : 0;
+}
+
+/* Writes staged packet as Enhanced Packet Block. Direction goes to
+ * epb_flags, ports, VLAN, trap reason and table to comment. */
+static int
+capture_put_epb(struct capture *c, const struct capture_slot *slot)
+{
+    static const uint8_t zeros[4];
+    static const uint32_t opt_end = PCAPNG_OPT_END;
+    const struct ops_fpa_capture_meta *meta = &slot->meta;
+    uint32_t flags = meta->inbound ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+    uint32_t epb[7], block_len;
+    char comment[96];
+    int comment_len;
+
+    if (meta->inbound) {
+        comment_len = snprintf(comment, sizeof comment,
+                               "in_port=%"PRIu32" vid=%"PRIu16" reason=%"PRIu32" table=%"PRIu32,
+                               meta->port, meta->vid, meta->reason, meta->tableId);
+    } else {
+        comment_len = snprintf(comment, sizeof comment,
+                               "out_port=%"PRIu32" vid=%"PRIu16,
+                               meta->port, meta->vid);
+    }
+
+    block_len = sizeof epb + PCAPNG_PAD(slot->caplen)
+                + 4 + sizeof flags + 4 + PCAPNG_PAD(comment_len)
+                + sizeof opt_end + 4;
+    epb[0] = PCAPNG_BLOCK_EPB;
+    epb[1] = block_len;
+    epb[2] = 0;                 /* Interface ID */
+    epb[3] = slot->time_ns >> 32;
+    epb[4] = slot->time_ns;
+    epb[5] = slot->caplen;
+    epb[6] = slot->len;
+
+    if (capture_put(c, epb, sizeof epb)
+        || capture_put(c, slot->data, slot->caplen)
+        || capture_put(c, zeros, PCAPNG_PAD(slot->caplen) - slot->caplen)
+        || capture_put_opt(c, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof flags)
+        || capture_put_opt(c, PCAPNG_OPT_COMMENT, comment, comment_len)
+        || capture_put(c, &opt_end, sizeof opt_end)
+        || capture_put(c, &block_len, sizeof block_len)) {
+        return EIO;
+    }
+
+    capture_stat_add(&c->bytes, block_len);
+    return 0;
+}
+
+/* Writes staged packets to capture file. Returns number of packets taken
+ * from staging ring. */
+static size_t
+capture_drain(struct capture *c)
+{
+    uint64_t n_written = 0;
+    size_t n = 0;
+
+    while (n < OPS_FPA_CAPTURE_RING_SIZE) {
+        struct capture_slot *slot;
+        uint64_t seq;
+
+        slot = &c->slots[c->tail & (OPS_FPA_CAPTURE_RING_SIZE - 1)];
+        atomic_read_explicit(&slot->seq, &seq, memory_order_acquire);
+        if (seq != c->tail + 1) {
+            break;
+        }
+
+        /* After write error packets are only taken out */
+        if (!c->error) {
+            c->error = capture_put_epb(c, slot);
+            if (c->error) {
+                VLOG_ERR("Writing capture file '%s' failed, capture stopped",
+                         c->file_name);
+            }
+        }
+        if (c->error) {
+            capture_stat_add(&c->drops, 1);
+        } else {
+            n_written++;
+        }
+
+        atomic_store_explicit(&slot->seq, c->tail + OPS_FPA_CAPTURE_RING_SIZE,
+                              memory_order_release);
+        c->tail++;
+        n++;
+    }
+
+    capture_stat_add(&c->packets, n_written);
+    return n;
+}
+
+static void *
+capture_writer(void *arg)
+{
+    struct capture *c = arg;
+
+    for (;;) {
+        bool stop;
+
+        /* Producers are gone once stop is seen, so the last drain takes
+         * everything they staged */
+        atomic_read_relaxed(&c->stop, &stop);
+        if (capture_drain(c)) {
+            ovsrcu_quiesce();
+            continue;
+        }
+        if (stop) {
+            break;
+        }
+
+        ovsrcu_quiesce_start();
+        poll(NULL, 0, OPS_FPA_CAPTURE_POLL_MS);
+        ovsrcu_quiesce_end();
+    }
+
+    return NULL;
+}
+
+static void
+capture_destroy(struct capture *c)
+{
+    if (c->map) {
+        munmap(c->map, OPS_FPA_CAPTURE_CHUNK);
+    }
+    if (c->fd >= 0) {
+        /* Cut preallocated tail of the last chunk */
+        if (ftruncate(c->fd, c->map_off + c->map_pos) < 0) {
+            VLOG_WARN("Unable to truncate capture file '%s'. Error(%d) - %s",
+                      c->file_name, errno, strerror(errno));
+        }
+        close(c->fd);
+    }
+    free_cacheline(c->slots);
+    free(c->file_name);
+    free_cacheline(c);
+}
+
+static struct capture *
+capture_create(const char *file_name, int port, int vid, int reason,
+               struct ds *err_str)
+{
+    struct capture *c;
+    size_t i;
+    int err;
+
+    c = xzalloc_cacheline(sizeof *c);
+    c->file_name = xstrdup(file_name);
+    c->port = port;
+    c->vid = vid;
+    c->reason = reason;
+    c->slots = xmalloc_cacheline(OPS_FPA_CAPTURE_RING_SIZE * sizeof *c->slots);
+    for (i = 0; i < OPS_FPA_CAPTURE_RING_SIZE; i++) {
+        atomic_init(&c->slots[i].seq, i);
+    }
+    atomic_init(&c->head, 0);
+    atomic_init(&c->stop, false);
+
+    c->fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (c->fd < 0) {
+        ds_put_format(err_str, "Unable to open '%s': %s", file_name,
+                      strerror(errno));
+        capture_destroy(c);
+        return NULL;
+    }
+
+    err = capture_put_header(c);
+    if (err) {
+        ds_put_format(err_str, "Unable to write '%s': %s", file_name,
+                      strerror(err));
+        capture_destroy(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+static void
+capture_status(struct ds *d_str, struct capture *c)
+{
+    uint64_t packets, bytes, drops;
+
+    atomic_read_relaxed(&c->packets, &packets);
+    atomic_read_relaxed(&c->bytes, &bytes);
+    atomic_read_relaxed(&c->drops, &drops);
+
+    ds_put_format(d_str, "Capture to '%s'", c->file_name);
+    if (c->port >= 0) {
+        ds_put_format(d_str, " port %d", c->port);
+    }
+    if (c->vid >= 0) {
+        ds_put_format(d_str, " vid %d", c->vid);
+    }
+    if (c->reason >= 0) {
+        ds_put_format(d_str, " reason %d", c->reason);
+    }
+    ds_put_format(d_str, ": %"PRIu64" packets, %"PRIu64" bytes, %"PRIu64" dropped",
+                  packets, bytes, drops);
+}
+
+/* Stops writer of capture 'c' removed from packet path, which takes
+ * packets staged before, and destroys the capture. Called after RCU grace
+ * period. */
+static void
+capture_stop(struct capture *c)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+
+    atomic_store_relaxed(&c->stop, true);
+    xpthread_join(c->thread, NULL);
+
+    capture_status(&d_str, c);
+    if (c->error) {
+        VLOG_WARN("%s, stopped by write error", ds_cstr(&d_str));
+    } else {
+        VLOG_INFO("%s, stopped", ds_cstr(&d_str));
+    }
+    ds_destroy(&d_str);
+
+    capture_destroy(c);
+}
+
+/* Parses optional capture filter value, "any" matches any */
+static bool
+capture_parse_filter(const char *s, int *value)
+{
+    if (!s || !strcmp(s, "any")) {
+        *value = -1;
+        return true;
+    }
+    return !ops_fpa_str2int(s, value) && *value >= 0;
+}
+
+static void
+ops_fpa_capture_unixctl(struct unixctl_conn *conn, int argc,
+                        const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    struct capture *c;
+
+    ovs_mutex_lock(&capture_mutex);
+    c = ovsrcu_get_protected(struct capture *, &capture_cur);
+
+    if (argc == 1) {
+        if (c) {
+            capture_status(&d_str, c);
+        } else {
+            ds_put_cstr(&d_str, "Capture is not running");
+        }
+    } else if (!strcmp(argv[1], "start")) {
+        int port, vid, reason;
+
+        if (argc < 3
+            || !capture_parse_filter(argc > 3 ? argv[3] : NULL, &port)
+            || !capture_parse_filter(argc > 4 ? argv[4] : NULL, &vid)
+            || !capture_parse_filter(argc > 5 ? argv[5] : NULL, &reason)) {
+            ds_put_cstr(&d_str, "expected start FILE [port|any] [vid|any] [reason|any]");
+            goto error;
+        }
+        if (c) {
+            ds_put_format(&d_str, "Capture to '%s' is already running",
+                          c->file_name);
+            goto error;
+        }
+
+        c = capture_create(argv[2], port, vid, reason, &d_str);
+        if (!c) {
+            goto error;
+        }
+        c->thread = ovs_thread_create("capture-writer", capture_writer, c);
+
+        ovsrcu_set(&capture_cur, c);
+        atomic_store_relaxed(&ops_fpa_capture_on, true);
+        ds_put_format(&d_str, "Capture to '%s' started", c->file_name);
+    } else if (!strcmp(argv[1], "stop")) {
+        if (!c) {
+            ds_put_cstr(&d_str, "Capture is not running");
+            goto error;
+        }
+
+        /* Packet path may still be staging packets until grace period
+         * ends, writer is stopped after it */
+        atomic_store_relaxed(&ops_fpa_capture_on, false);
+        ovsrcu_set(&capture_cur, NULL);
+        ovsrcu_postpone(capture_stop, c);
+
+        capture_status(&d_str, c);
+        ds_put_cstr(&d_str, ", stopping");
+    } else {
+        ds_put_cstr(&d_str, "expected start or stop");
+        goto error;
+    }
+
+    ovs_mutex_unlock(&capture_mutex);
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+    return;
+
+error:
+    ovs_mutex_unlock(&capture_mutex);
+    unixctl_command_reply_error(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
+
+void
+ops_fpa_capture_unixctl_init(void)
+{
+    static bool registered;
+    if (registered) {
+        return;
+    }
+    registered = true;
+
+    unixctl_command_register("fpa/tap/capture",
+                             "[start FILE [port] [vid] [reason] | stop]", 0, 5,
+                             ops_fpa_capture_unixctl, NULL);
+}
@@ -83,11 +83,6 @@ ops_fpa_dev_init(uint32_t switchId, struct fpa_dev **fdev)
     dev->switchId = switchId;
     dev->ref_cnt = 1;
 
-    /* Initialize TAP interface. */
-    dev->tap_if_info = ops_fpa_tap_init(switchId);
-    if (dev->tap_if_info)
-        VLOG_INFO("FPA device (%d) initialize was successful", dev->switchId);
-
     err = ops_fpa_mac_learning_create(dev, &dev->ml);
     if (err) {
         VLOG_ERR("Unable to create mac learning feature");
@@ -95,6 +90,11 @@ ops_fpa_dev_init(uint32_t switchId, struct fpa_dev **fdev)
         goto error;
     }
 
+    /* Initialize TAP interface. TAP workers look up FDB from the start. */
+    dev->tap_if_info = ops_fpa_tap_init(switchId, dev->ml);
+    if (dev->tap_if_info)
+        VLOG_INFO("FPA device (%d) initialize was successful", dev->switchId);
+
     /* Initialize unix ctl functions */
     ops_fpa_dev_unixctl_init();
 
@@ -126,10 +126,11 @@ ops_fpa_dev_deinit(uint32_t switchId)
     fdev->ref_cnt--;
     if (!fdev->ref_cnt)
     {
-        ops_fpa_mac_learning_unref(fdev->ml);
-
+        /* TAP workers look up FDB until they are stopped */
         ops_fpa_tap_deinit(switchId);
 
+        ops_fpa_mac_learning_unref(fdev->ml);
+
         free(dev);
         dev = NULL;
 
@@ -139,17 +140,17 @@ ops_fpa_dev_deinit(uint32_t switchId)
     ops_fpa_dev_mutex_unlock();
 }
 
-/* Return TAP info by switch ID */
+/* Return TAP info by switch ID, NULL if device or its TAP interfaces
+ * do not exist. Must be called with FPA device mutex held or from main
+ * thread, which is the only one creating and destroying devices. */
 struct tap_info *get_tap_info_by_switch_id(uint32_t switchId)
 {
-    struct fpa_dev *fdev;
-
-    fdev = ops_fpa_dev_by_id(switchId);
-    if (fdev) {
-        return fdev->tap_if_info;
+    /* TODO: To be refactored for multiple device support */
+    if (dev && dev->switchId == switchId) {
+        return dev->tap_if_info;
     }
 
-    OVS_NOT_REACHED();
+    return NULL;
 }
 
 /************************************************************************************/
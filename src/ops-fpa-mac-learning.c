@@ -19,9 +19,13 @@
  *          for the FPA SDK.
  */
 
+#include <limits.h>
 #include <unistd.h>
 #include "hash.h"
 #include "util.h"
+#include "ovs-rcu.h"
+#include "poll-loop.h"
+#include "timeval.h"
 #include "plugin-extensions.h"
 #include "ops-fpa.h"
 #include "ops-fpa-ofproto.h"
@@ -31,8 +35,87 @@ VLOG_DEFINE_THIS_MODULE(ops_fpa_mac_learning);
 
 /* Timeout to wait for all plugin parts to finish init */
 #define ML_DELAY_STARTUP_TIME    5
-/* MAC learning timer timeout in seconds. */
+/* MAC learning timer timeout in seconds. Learned MACs are normally handed
+ * to vswitchd much sooner, see ML_NOTIFY_*. */
 #define OPS_FPA_ML_TIMER_TIMEOUT 30
+/* Learned MAC events are coalesced for up to ML_NOTIFY_DELAY_MS ms or
+ * until ML_NOTIFY_EVENTS are pending before vswitchd is notified. */
+#define ML_NOTIFY_DELAY_MS       100
+#define ML_NOTIFY_EVENTS         256
+/* Events put off while mlearn tables are full. Past ML_SPILL_MAX add
+ * events are dropped and recovered by resync of the whole table, past
+ * ML_SPILL_HARD_MAX delete events are lost too. */
+#define ML_SPILL_MAX             (4 * BUFFER_SIZE)
+#define ML_SPILL_HARD_MAX        (4 * ML_SPILL_MAX)
+/* Wait for AU messages after the queue is found empty, in ms. It doubles
+ * while the queue stays empty and restarts once a message comes. */
+#define ML_AU_BACKOFF_MIN        1
+#define ML_AU_BACKOFF_MAX        128
+/* AU messages read from ASIC and applied to the table at once */
+#define ML_AU_BATCH              256
+/* Max time in us the table is write locked for one batch, checked every
+ * ML_AU_HOLD_CHECK messages */
+#define ML_AU_HOLD_MAX_US        1000
+#define ML_AU_HOLD_CHECK         16
+/* Matching mode of FDB entry delete, entries are matched exactly */
+#define ML_HW_MATCH_MODE         0
+
+/* AU message in batch, indexed by VLAN and MAC */
+struct ml_au_msg {
+    struct hmap_node node;
+    FPA_EVENT_ADDRESS_MSG_STC msg;
+    bool aged;      /* Replaced AGED message, entry is removed first */
+};
+
+/* AU messages drained from ASIC, at most one per VLAN and MAC */
+struct ml_au_batch {
+    struct hmap index;
+    size_t n;
+    struct ml_au_msg msgs[ML_AU_BATCH];
+};
+
+/* Single producer single consumer ring of AU events, from ASIC events
+ * thread to event thread */
+struct ml_event_ring {
+    atomic_uint32_t head;   /* Next slot to fill, producer side */
+    uint8_t pad0[CACHE_LINE_SIZE - sizeof(atomic_uint32_t)];
+    atomic_uint32_t tail;   /* Next slot to take, consumer side */
+    uint8_t pad1[CACHE_LINE_SIZE - sizeof(atomic_uint32_t)];
+    struct fpa_ml_event ev[OPS_FPA_ML_RING_SIZE];
+};
+
+/* FDB entries are allocated ML_SLAB_CHUNK at a time and reused. Chunks
+ * are kept for the process lifetime. */
+#define ML_SLAB_CHUNK            1024
+
+struct ml_slab_chunk {
+    struct fpa_mac_entry entries[ML_SLAB_CHUNK];
+    struct ovs_list node;           /* In 'ml_slab_chunks'. */
+};
+
+static struct ovs_mutex ml_slab_mutex = OVS_MUTEX_INITIALIZER;
+static struct ovs_list ml_slab_chunks OVS_GUARDED_BY(ml_slab_mutex)
+    = OVS_LIST_INITIALIZER(&ml_slab_chunks);
+static struct ovs_list ml_slab_free OVS_GUARDED_BY(ml_slab_mutex)
+    = OVS_LIST_INITIALIZER(&ml_slab_free);
+static size_t ml_slab_n_chunks OVS_GUARDED_BY(ml_slab_mutex);
+static size_t ml_slab_n_used OVS_GUARDED_BY(ml_slab_mutex);
+
+BUILD_ASSERT_DECL(sizeof(struct fpa_mac_entry) <= CACHE_LINE_SIZE);
+
+/* MAC event waiting for room in mlearn table */
+struct ml_spill_event {
+    struct hmap_node hmap_node;     /* In 'mlearn_spill', by mlearn index. */
+    struct mlearn_hmap_node data;
+};
+
+/* Port down or VLAN removed event, ordered against AU events by ring
+ * position at the time it was queued */
+struct ml_ctrl_event {
+    struct ovs_list node;   /* In 'ctrl_events' of fpa_mac_learning. */
+    uint32_t au_seq;
+    struct fpa_ml_event ev;
+};
 
 struct fpa_mac_learning* g_fpa_ml = NULL;
 static struct vlog_rate_limit ml_rl = VLOG_RATE_LIMIT_INIT(5, 20);
@@ -50,7 +133,12 @@ int ops_fpa_mac_learning_expire(struct fpa_mac_learning *ml,
     OVS_REQ_WRLOCK(ml->rwlock);
 
 static uint32_t fpa_hash_fdb_entry(const FPA_EVENT_ADDRESS_MSG_STC *fdb_entry);
+static void ml_index_add(struct fpa_mac_learning *ml, struct fpa_mac_entry *e);
+static void ml_entry_free(struct fpa_mac_entry *e);
+static void ml_entry_msg(const struct fpa_mac_entry *e,
+                         FPA_EVENT_ADDRESS_MSG_STC *msg);
 static void *mac_learning_asic_events_handler(void *arg);
+static void *mac_learning_events_handler(void *arg);
 static void ops_fpa_mac_learning_mlearn_action_add(struct fpa_mac_learning *ml,
                                       FPA_EVENT_ADDRESS_MSG_STC *fdb_entry,
                                       uint32_t index,
@@ -66,6 +154,23 @@ normalize_idle_time(unsigned int idle_time)
             : idle_time);
 }
 
+/* Looks up the interface of mac learning plugin of vswitchd, which mlearn
+ * events are handed over to. Must be called from main thread. */
+static void
+mac_learning_plugin_lookup(struct fpa_mac_learning *ml)
+{
+    struct plugin_extension_interface *extension = NULL;
+
+    if (find_plugin_extension(MAC_LEARNING_PLUGIN_INTERFACE_NAME,
+                              MAC_LEARNING_PLUGIN_INTERFACE_MAJOR,
+                              MAC_LEARNING_PLUGIN_INTERFACE_MINOR,
+                              &extension) == 0) {
+        if (extension) {
+            ml->plugin_interface = extension->plugin_interface;
+        }
+    }
+}
+
 /* Creates and returns a new MAC learning table with an initial MAC aging
  * timeout of 'idle_time' seconds and an initial maximum of OPS_FPA_ML_DEFAULT_SIZE
  * entries. */
@@ -75,12 +180,16 @@ ops_fpa_mac_learning_create(struct fpa_dev *dev, struct fpa_mac_learning **p_ml)
     struct fpa_mac_learning *ml = NULL;
     FPA_STATUS err = FPA_OK;
     int idx = 0;
-    struct plugin_extension_interface *extension = NULL;
 
     ovs_assert(dev);
 
     ml = xmalloc(sizeof *ml);
-    hmap_init(&ml->table);
+    cmap_init(&ml->table);
+    hmap_init(&ml->ports);
+    for (idx = 0; idx < OPS_FPA_ML_MAX_VLANS; idx++) {
+        list_init(&ml->vlan_entries[idx]);
+        ml->vlan_n_entries[idx] = 0;
+    }
     ml->max_entries = OPS_FPA_ML_DEFAULT_SIZE;
     ml->dev = dev;
     ml->idle_time = normalize_idle_time(OPS_FPA_ML_ENTRY_DEFAULT_IDLE_TIME);
@@ -88,8 +197,17 @@ ops_fpa_mac_learning_create(struct fpa_dev *dev, struct fpa_mac_learning **p_ml)
     ovs_refcount_init(&ml->ref_cnt);
     ovs_rwlock_init(&ml->rwlock);
     latch_init(&ml->exit_latch);
+    ml->events = xzalloc_cacheline(sizeof *ml->events);
+    guarded_list_init(&ml->ctrl_events);
+    ml->event_seq = seq_create();
     ml->plugin_interface = NULL;
     ml->curr_mlearn_table_in_use = 0;
+    atomic_init(&ml->mlearn_deadline, LLONG_MAX);
+    ml->mlearn_seq = seq_create();
+    hmap_init(&ml->mlearn_spill);
+    ml->mlearn_resync = false;
+    memset(&ml->mlearn_resync_pos, 0, sizeof ml->mlearn_resync_pos);
+    memset(&ml->stats, 0, sizeof ml->stats);
 
     for (idx = 0; idx < OPS_FPA_ML_NUM_BUFFERS; idx++) {
         hmap_init(&(ml->mlearn_event_tables[idx].table));
@@ -98,14 +216,7 @@ ops_fpa_mac_learning_create(struct fpa_dev *dev, struct fpa_mac_learning **p_ml)
         hmap_reserve(&(ml->mlearn_event_tables[idx].table), BUFFER_SIZE);
     }
 
-    if (find_plugin_extension(MAC_LEARNING_PLUGIN_INTERFACE_NAME,
-                              MAC_LEARNING_PLUGIN_INTERFACE_MAJOR,
-                              MAC_LEARNING_PLUGIN_INTERFACE_MINOR,
-                              &extension) == 0) {
-        if (extension) {
-            ml->plugin_interface = extension->plugin_interface;
-        }
-    }
+    mac_learning_plugin_lookup(ml);
 
     /* Configure FDB aging time */
     err = fpaLibSwitchAgingTimeoutSet(ml->dev->switchId, ml->idle_time);
@@ -116,6 +227,8 @@ ops_fpa_mac_learning_create(struct fpa_dev *dev, struct fpa_mac_learning **p_ml)
 
     timer_set_duration(&ml->mlearn_timer, OPS_FPA_ML_TIMER_TIMEOUT * 1000);
 
+    ml->ml_event_thread = ovs_thread_create("ops-fpa-ml-event",
+                                      mac_learning_events_handler, ml);
     ml->ml_asic_thread = ovs_thread_create("ops-fpa-ml-asic-ev",
                                       mac_learning_asic_events_handler, ml);
     VLOG_INFO("FDB events processing thread started");
@@ -135,12 +248,31 @@ void
 ops_fpa_mac_learning_unref(struct fpa_mac_learning *ml)
 {
     if (ml && ovs_refcount_unref(&ml->ref_cnt) == 1) {
+        struct ml_spill_event *s, *next;
+        struct ml_ctrl_event *c;
+        struct ovs_list ctrl;
 
         latch_set(&ml->exit_latch);
         xpthread_join(ml->ml_asic_thread, NULL);
+        xpthread_join(ml->ml_event_thread, NULL);
 
         ops_fpa_mac_learning_flush(ml);
-        hmap_destroy(&ml->table);
+        cmap_destroy(&ml->table);
+        hmap_destroy(&ml->ports);
+
+        guarded_list_pop_all(&ml->ctrl_events, &ctrl);
+        LIST_FOR_EACH_POP (c, node, &ctrl) {
+            free(c);
+        }
+        guarded_list_destroy(&ml->ctrl_events);
+        seq_destroy(ml->event_seq);
+        seq_destroy(ml->mlearn_seq);
+        HMAP_FOR_EACH_SAFE (s, next, hmap_node, &ml->mlearn_spill) {
+            hmap_remove(&ml->mlearn_spill, &s->hmap_node);
+            free(s);
+        }
+        hmap_destroy(&ml->mlearn_spill);
+        free_cacheline(ml->events);
 
         latch_destroy(&ml->exit_latch);
 
@@ -222,32 +354,35 @@ ops_fpa_mac_learning_may_learn(const struct fpa_mac_learning *ml,
 int
 ops_fpa_mac_learning_insert(struct fpa_mac_learning *ml, struct fpa_mac_entry *e)
 {
+    FPA_EVENT_ADDRESS_MSG_STC msg;
     uint32_t index;
     uint32_t reHashIndex = 0;
 
     ovs_assert(ml);
     ovs_assert(e);
 
-    if (hmap_count(&ml->table) >= ml->max_entries) {
+    ml_entry_msg(e, &msg);
+    if (cmap_count(&ml->table) >= ml->max_entries) {
         VLOG_WARN_RL(&ml_rl, "%s: Unable to insert entry for VLAN %d "
                              "and MAC: " FPA_ETH_ADDR_FMT
                              " to the software FDB table. The table is full",
-                     __func__, e->fdb_entry.vid,
-                     FPA_ETH_ADDR_ARGS(e->fdb_entry.address));
-        free(e);
+                     __func__, msg.vid, FPA_ETH_ADDR_ARGS(msg.address));
+        ml_entry_free(e);
         return EPERM;
     }
 
-    index = fpa_hash_fdb_entry(&e->fdb_entry);
-    hmap_insert(&ml->table, &e->hmap_node, index);
+    index = hash_uint64(e->key);
+    e->hash = index;
+    cmap_insert(&ml->table, &e->cmap_node, index);
+    ml_index_add(ml, e);
     VLOG_DBG_RL(&ml_rl, "Inserted new entry into ML table: VLAN %d, "
-                        "MAC: " FPA_ETH_ADDR_FMT ", Intf ID: %u, index 0x%lx",
-                e->fdb_entry.vid,
-                FPA_ETH_ADDR_ARGS(e->fdb_entry.address),
-                e->fdb_entry.portNum,
-                e->hmap_node.hash);
+                        "MAC: " FPA_ETH_ADDR_FMT ", Intf ID: %u, index 0x%"PRIx32,
+                msg.vid,
+                FPA_ETH_ADDR_ARGS(msg.address),
+                e->portNum,
+                e->hash);
 
-    ops_fpa_mac_learning_mlearn_action_add(ml, &e->fdb_entry,
+    ops_fpa_mac_learning_mlearn_action_add(ml, &msg,
                                           index, reHashIndex, MLEARN_ADD);
 
     return 0;
@@ -255,30 +390,122 @@ ops_fpa_mac_learning_insert(struct fpa_mac_learning *ml, struct fpa_mac_entry *e
 
 static uint32_t fpa_hash_fdb_entry(const FPA_EVENT_ADDRESS_MSG_STC *fdb_entry)
 {
-    char buf[sizeof(fdb_entry->vid)+sizeof(fdb_entry->address)];
-    char *p = buf;
+    return hash_uint64(ops_fpa_ml_key(fdb_entry->vid, &fdb_entry->address));
+}
+
+/* Takes FDB entry from the slab */
+static struct fpa_mac_entry *
+ml_entry_alloc(void)
+{
+    struct fpa_mac_entry *e;
+
+    ovs_mutex_lock(&ml_slab_mutex);
+    if (list_is_empty(&ml_slab_free)) {
+        struct ml_slab_chunk *chunk = xmalloc_cacheline(sizeof *chunk);
+        size_t i;
+
+        for (i = 0; i < ML_SLAB_CHUNK; i++) {
+            list_push_back(&ml_slab_free, &chunk->entries[i].port_node);
+        }
+        list_push_back(&ml_slab_chunks, &chunk->node);
+        ml_slab_n_chunks++;
+    }
+    e = CONTAINER_OF(list_pop_front(&ml_slab_free), struct fpa_mac_entry,
+                     port_node);
+    ml_slab_n_used++;
+    ovs_mutex_unlock(&ml_slab_mutex);
+
+    return e;
+}
+
+/* Returns FDB entry to the slab. Most recently freed is reused first, its
+ * cache line is likely still warm. */
+static void
+ml_entry_free(struct fpa_mac_entry *e)
+{
+    ovs_mutex_lock(&ml_slab_mutex);
+    list_push_front(&ml_slab_free, &e->port_node);
+    ml_slab_n_used--;
+    ovs_mutex_unlock(&ml_slab_mutex);
+}
+
+/* Fills AU message 'msg' with address and port of entry 'e' */
+static void
+ml_entry_msg(const struct fpa_mac_entry *e, FPA_EVENT_ADDRESS_MSG_STC *msg)
+{
+    memset(msg, 0, sizeof *msg);
+    msg->vid = ops_fpa_ml_key_vid(e->key);
+    ops_fpa_ml_key_mac(e->key, &msg->address);
+    msg->portNum = e->portNum;
+}
+
+static struct fpa_ml_port *
+ml_port_lookup(const struct fpa_mac_learning *ml, uint32_t portNum)
+{
+    struct fpa_ml_port *port;
+
+    HMAP_FOR_EACH_WITH_HASH (port, hmap_node, hash_int(portNum, 0), &ml->ports) {
+        if (port->portNum == portNum) {
+            return port;
+        }
+    }
+
+    return NULL;
+}
+
+/* Adds entry 'e' to lists of its port and VLAN */
+static void
+ml_index_add(struct fpa_mac_learning *ml, struct fpa_mac_entry *e)
+{
+    uint32_t portNum = e->portNum;
+    uint16_t vid = ops_fpa_ml_key_vid(e->key) % OPS_FPA_ML_MAX_VLANS;
+    struct fpa_ml_port *port;
+
+    port = ml_port_lookup(ml, portNum);
+    if (!port) {
+        port = xmalloc(sizeof *port);
+        port->portNum = portNum;
+        list_init(&port->entries);
+        port->n_entries = 0;
+        hmap_insert(&ml->ports, &port->hmap_node, hash_int(portNum, 0));
+    }
+    list_push_back(&port->entries, &e->port_node);
+    port->n_entries++;
+
+    list_push_back(&ml->vlan_entries[vid], &e->vlan_node);
+    ml->vlan_n_entries[vid]++;
+}
+
+/* Removes entry 'e' from lists of its port and VLAN */
+static void
+ml_index_remove(struct fpa_mac_learning *ml, struct fpa_mac_entry *e)
+{
+    uint16_t vid = ops_fpa_ml_key_vid(e->key) % OPS_FPA_ML_MAX_VLANS;
+    struct fpa_ml_port *port;
 
-    memcpy(p, &fdb_entry->vid, sizeof(fdb_entry->vid));
-    p += sizeof(fdb_entry->vid);
-    memcpy(p, &fdb_entry->address, sizeof(fdb_entry->address));
+    port = ml_port_lookup(ml, e->portNum);
+    ovs_assert(port);
+    list_remove(&e->port_node);
+    if (!--port->n_entries) {
+        hmap_remove(&ml->ports, &port->hmap_node);
+        free(port);
+    }
 
-    return hash_bytes(buf, sizeof(fdb_entry->vid)+sizeof(fdb_entry->address), 0);
+    list_remove(&e->vlan_node);
+    ml->vlan_n_entries[vid]--;
 }
 
 struct fpa_mac_entry *
 ops_fpa_mac_learning_lookup(const struct fpa_mac_learning *ml,
                            FPA_EVENT_ADDRESS_MSG_STC *fdb_entry)
 {
+    uint64_t key = ops_fpa_ml_key(fdb_entry->vid, &fdb_entry->address);
     struct fpa_mac_entry *e;
-    uint32_t hash = fpa_hash_fdb_entry(fdb_entry);
 
     ovs_assert(ml);
 
-    HMAP_FOR_EACH_WITH_HASH(e, hmap_node, hash, &ml->table)
-    {
-        if (!memcmp(&e->fdb_entry.address, &fdb_entry->address,
-                    sizeof(fdb_entry->address)) &&
-            e->fdb_entry.vid == fdb_entry->vid) {
+    CMAP_FOR_EACH_WITH_HASH (e, cmap_node, hash_uint64(key), &ml->table) {
+        if (e->key == key) {
             return e;
         }
     }
@@ -290,67 +517,187 @@ struct fpa_mac_entry *
 ops_fpa_mac_learning_lookup_by_vlan_and_mac(const struct fpa_mac_learning *ml,
                                             uint16_t vlan_id, FPA_MAC_ADDRESS_STC macAddr)
 {
-    struct fpa_mac_entry *e = NULL;
+    FPA_EVENT_ADDRESS_MSG_STC key;
+
     ovs_assert(ml);
 
-    HMAP_FOR_EACH (e, hmap_node, &ml->table) {
-        if (!memcmp(&e->fdb_entry.address, &macAddr, ETH_ADDR_LEN) &&
-            (e->fdb_entry.vid == vlan_id)) {
+    memset(&key, 0, sizeof key);
+    key.vid = vlan_id;
+    key.address = macAddr;
 
-            return e;
-        }
+    return ops_fpa_mac_learning_lookup(ml, &key);
+}
+
+/* Gets port 'mac' is learned on in VLAN 'vid' into 'portNum'.
+ * Returns ENOENT if it is not learned. Lock-free, may be called from any
+ * thread. */
+int
+ops_fpa_mac_learning_get_port(struct fpa_mac_learning *ml, uint16_t vid,
+                              const uint8_t mac[ETH_ADDR_LEN],
+                              uint32_t *portNum)
+{
+    FPA_EVENT_ADDRESS_MSG_STC key;
+    struct fpa_mac_entry *e;
+    int err = ENOENT;
+
+    ovs_assert(ml);
+
+    memset(&key, 0, sizeof key);
+    key.vid = vid;
+    memcpy(&key.address, mac, ETH_ADDR_LEN);
+
+    e = ops_fpa_mac_learning_lookup(ml, &key);
+    if (e) {
+        *portNum = e->portNum;
+        err = 0;
     }
 
-    return NULL;
+    return err;
 }
 
-/* Expires 'e' from the 'ml' hash table */
+/* Expires 'e' from the 'ml' hash table. 'e' is freed once concurrent
+ * lookups are done with it. */
 int
 ops_fpa_mac_learning_expire(struct fpa_mac_learning *ml, struct fpa_mac_entry *e)
 {
+    FPA_EVENT_ADDRESS_MSG_STC msg;
+
     ovs_assert(ml);
     ovs_assert(e);
 
-    /* FIXME add removing entry from HW when be supported by FPA */
+    /* Aged entries are gone from the ASIC already, flushes remove the
+     * rest with ml_entry_hw_delete() */
 
-    hmap_remove(&ml->table, &e->hmap_node);
+    cmap_remove(&ml->table, &e->cmap_node, e->hash);
+    ml_index_remove(ml, e);
+    ml_entry_msg(e, &msg);
 
     VLOG_DBG_RL(&ml_rl, "Expire entry in ML table: VLAN %d, "
-                        "MAC: " FPA_ETH_ADDR_FMT ", Intf ID: %u, index 0x%lx",
-                e->fdb_entry.vid,
-                FPA_ETH_ADDR_ARGS(e->fdb_entry.address),
-                e->fdb_entry.portNum,
-                e->hmap_node.hash);
+                        "MAC: " FPA_ETH_ADDR_FMT ", Intf ID: %u, index 0x%"PRIx32,
+                msg.vid,
+                FPA_ETH_ADDR_ARGS(msg.address),
+                e->portNum,
+                e->hash);
 
-    ops_fpa_mac_learning_mlearn_action_add(ml, &e->fdb_entry,
-                                          e->hmap_node.hash,
-                                          e->hmap_node.hash, MLEARN_DEL);
-    free(e);
+    ops_fpa_mac_learning_mlearn_action_add(ml, &msg,
+                                          e->hash, e->hash, MLEARN_DEL);
+    ovsrcu_postpone(ml_entry_free, e);
 
     return 0;
 }
 
-/* Expires all the mac-learning entries in 'ml' */
+/* Removes the FDB entry of 'e' from the L2_BRIDGING table of the ASIC.
+ * Entries are auto-learned by the hardware, so they're matched exactly
+ * by VLAN and MAC, in which case the matching mode doesn't widen the
+ * delete to any other entry. The entry may be already aged out. */
+static void
+ml_entry_hw_delete(struct fpa_mac_learning *ml, const struct fpa_mac_entry *e)
+{
+    FPA_FLOW_TABLE_ENTRY_STC flowEntry;
+    FPA_EVENT_ADDRESS_MSG_STC msg;
+    FPA_STATUS err;
+
+    ml_entry_msg(e, &msg);
+
+    err = fpaLibFlowEntryInit(ml->dev->switchId,
+                              FPA_FLOW_TABLE_TYPE_L2_BRIDGING_E, &flowEntry);
+    if (err != FPA_OK) {
+        VLOG_WARN_RL(&ml_rl, "%s: failed to init L2 bridging entry. Status: %s",
+                     __func__, ops_fpa_strerr(err));
+        return;
+    }
+
+    flowEntry.data.l2_bridging.match.vlanId = msg.vid;
+    flowEntry.data.l2_bridging.match.vlanIdMask = 0xFFFF;
+    memcpy(flowEntry.data.l2_bridging.match.destMac.addr, msg.address.addr,
+           ETH_ADDR_LEN);
+    memset(flowEntry.data.l2_bridging.match.destMacMask.addr, 0xFF, ETH_ADDR_LEN);
+
+    err = fpaLibFlowEntryDelete(ml->dev->switchId,
+                                FPA_FLOW_TABLE_TYPE_L2_BRIDGING_E, &flowEntry,
+                                ML_HW_MATCH_MODE);
+    if (err != FPA_OK && err != FPA_NOT_FOUND) {
+        VLOG_WARN_RL(&ml_rl, "Failed to remove FDB entry: VLAN %d, "
+                             "MAC: " FPA_ETH_ADDR_FMT ". Status: %s",
+                     msg.vid, FPA_ETH_ADDR_ARGS(msg.address),
+                     ops_fpa_strerr(err));
+    }
+}
+
+/* Expires all the mac-learning entries in 'ml', both from 'ml' and from
+ * the FDB of the ASIC. */
 void
 ops_fpa_mac_learning_flush(struct fpa_mac_learning *ml)
 {
     struct fpa_mac_entry *e = NULL;
-    struct fpa_mac_entry *next = NULL;
 
     ovs_assert(ml);
 
-    HMAP_FOR_EACH_SAFE (e, next, hmap_node, &ml->table) {
+    CMAP_FOR_EACH (e, cmap_node, &ml->table) {
+        ml_entry_hw_delete(ml, e);
         ops_fpa_mac_learning_expire(ml, e);
     }
 }
 
+/* Expires all the mac-learning entries learned on port 'portNum', both
+ * from 'ml' and from the FDB of the ASIC. */
+void
+ops_fpa_mac_learning_flush_port(struct fpa_mac_learning *ml, uint32_t portNum)
+{
+    struct fpa_ml_port *port;
+    struct fpa_mac_entry *e;
+
+    ovs_assert(ml);
+
+    /* Port entry goes away with its last MAC entry */
+    while ((port = ml_port_lookup(ml, portNum))) {
+        e = CONTAINER_OF(list_front(&port->entries), struct fpa_mac_entry,
+                         port_node);
+        ml_entry_hw_delete(ml, e);
+        ops_fpa_mac_learning_expire(ml, e);
+    }
+}
+
+/* Expires all the mac-learning entries in VLAN 'vid', both from 'ml' and
+ * from the FDB of the ASIC. */
+void
+ops_fpa_mac_learning_flush_vlan(struct fpa_mac_learning *ml, uint16_t vid)
+{
+    struct ovs_list *entries;
+    struct fpa_mac_entry *e;
+
+    ovs_assert(ml);
+
+    entries = &ml->vlan_entries[vid % OPS_FPA_ML_MAX_VLANS];
+    while (!list_is_empty(entries)) {
+        e = CONTAINER_OF(list_front(entries), struct fpa_mac_entry, vlan_node);
+        ml_entry_hw_delete(ml, e);
+        ops_fpa_mac_learning_expire(ml, e);
+    }
+}
+
+size_t
+ops_fpa_mac_learning_count_port(const struct fpa_mac_learning *ml,
+                                uint32_t portNum)
+{
+    struct fpa_ml_port *port = ml_port_lookup(ml, portNum);
+
+    return port ? port->n_entries : 0;
+}
+
+size_t
+ops_fpa_mac_learning_count_vlan(const struct fpa_mac_learning *ml, uint16_t vid)
+{
+    return ml->vlan_n_entries[vid % OPS_FPA_ML_MAX_VLANS];
+}
+
 /* Installs entry into hardware FDB table and then in the software table.
  * After that releases the memory allocated for the members of data. */
 int
 ops_fpa_mac_learning_learn(struct fpa_mac_learning *ml,
                           FPA_EVENT_ADDRESS_MSG_STC *data)
 {
-    struct fpa_mac_entry *e = xmalloc(sizeof(*e));
+    struct fpa_mac_entry *e;
 
     ovs_assert(ml);
     ovs_assert(data);
@@ -372,8 +719,10 @@ ops_fpa_mac_learning_learn(struct fpa_mac_learning *ml,
     }
 
     /* Add new entry to software FDB */
-    memcpy(&e->fdb_entry, data, sizeof e->fdb_entry);
-    e->port.p = NULL;
+    e = ml_entry_alloc();
+    e->key = ops_fpa_ml_key(data->vid, &data->address);
+    e->portNum = data->portNum;
+    e->learned = time_msec();
 
     return ops_fpa_mac_learning_insert(ml, e);
 }
@@ -423,61 +772,432 @@ ops_fpa_mac_learning_age_by_vlan_and_mac(struct fpa_mac_learning *ml,
     return 0;
 }
 
-/* This handler thread receives incoming learning events
- * of different types and handles them correspondingly. */
+/* Increments statistics counter owned by the calling thread */
+static inline void
+ml_stat_add(atomic_uint64_t *stat, uint64_t n)
+{
+    uint64_t value;
+
+    atomic_read_relaxed(stat, &value);
+    atomic_store_relaxed(stat, value + n);
+}
+
+/* Waits up to 'msec' ms or until the thread is asked to exit */
+static void
+mac_learning_wait(struct fpa_mac_learning *ml, long long int msec)
+{
+    poll_timer_wait(msec);
+    latch_wait(&ml->exit_latch);
+    poll_block();
+    ml_stat_add(&ml->stats.wakeups, 1);
+}
+
+/* Adds 'ev' to the event ring. Returns false if ring is full.
+ * Must be called by ASIC events thread only. */
+static inline bool
+ml_ring_push(struct fpa_mac_learning *ml, const struct fpa_ml_event *ev)
+{
+    struct ml_event_ring *ring = ml->events;
+    uint32_t head, tail, max;
+
+    atomic_read_relaxed(&ring->head, &head);
+    atomic_read_explicit(&ring->tail, &tail, memory_order_acquire);
+    if (head - tail == OPS_FPA_ML_RING_SIZE) {
+        return false;
+    }
+
+    ring->ev[head & (OPS_FPA_ML_RING_SIZE - 1)] = *ev;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    atomic_read_relaxed(&ml->stats.ring_max, &max);
+    if (head + 1 - tail > max) {
+        atomic_store_relaxed(&ml->stats.ring_max, head + 1 - tail);
+    }
+
+    return true;
+}
+
+/* Takes oldest event from the event ring if it was queued before ring
+ * position 'limit'. Returns false if there is no such event.
+ * Must be called by event thread only. */
+static inline bool
+ml_ring_pop(struct fpa_mac_learning *ml, uint32_t limit,
+            struct fpa_ml_event *ev)
+{
+    struct ml_event_ring *ring = ml->events;
+    uint32_t head, tail;
+
+    atomic_read_relaxed(&ring->tail, &tail);
+    atomic_read_explicit(&ring->head, &head, memory_order_acquire);
+    if (head == tail || (int32_t) (limit - tail) <= 0) {
+        return false;
+    }
+
+    *ev = ring->ev[tail & (OPS_FPA_ML_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+/* Takes up to ML_AU_BATCH AU events queued before ring position 'limit'
+ * into 'b'. A message for the same VLAN and MAC as an earlier one replaces
+ * it, only the latest state of an address is applied. Returns number of
+ * events taken from the ring. */
+static size_t
+mac_learning_au_drain(struct fpa_mac_learning *ml, struct ml_au_batch *b,
+                      uint32_t limit)
+{
+    struct fpa_ml_event ev;
+    size_t n = 0;
+
+    hmap_clear(&b->index);
+    b->n = 0;
+
+    while (b->n < ML_AU_BATCH && ml_ring_pop(ml, limit, &ev)) {
+        struct ml_au_msg *m = &b->msgs[b->n];
+        struct ml_au_msg *old;
+        uint32_t hash;
+
+        m->msg = ev.data.msg;
+        m->aged = false;
+        n++;
+
+        hash = hash_bytes(m->msg.address.addr, ETH_ADDR_LEN, m->msg.vid);
+        HMAP_FOR_EACH_WITH_HASH (old, node, hash, &b->index) {
+            if (old->msg.vid == m->msg.vid
+                && !memcmp(old->msg.address.addr, m->msg.address.addr, ETH_ADDR_LEN)) {
+                break;
+            }
+        }
+        if (old) {
+            old->aged |= old->msg.type == FPA_EVENT_ADDRESS_UPDATE_AGED_E;
+            old->msg = m->msg;
+            ml_stat_add(&ml->stats.au_coalesced, 1);
+            continue;
+        }
+
+        hmap_insert(&b->index, &m->node, hash);
+        b->n++;
+    }
+
+    return n;
+}
+
+/* Releases table write lock taken at 'start' and accounts the hold */
+static void
+mac_learning_au_unlock(struct fpa_mac_learning *ml, long long int start)
+    OVS_RELEASES(ml->rwlock)
+{
+    uint64_t hold = time_usec() - start;
+    uint64_t max;
+
+    ovs_rwlock_unlock(&ml->rwlock);
+
+    atomic_read_relaxed(&ml->stats.lock_hold_max_us, &max);
+    if (hold > max) {
+        atomic_store_relaxed(&ml->stats.lock_hold_max_us, hold);
+    }
+}
+
+/* Applies batch 'b' to the table under one write lock hold. The lock is
+ * released and taken again if the hold takes longer than
+ * ML_AU_HOLD_MAX_US, so readers are never held off for long. */
+static void
+mac_learning_au_apply(struct fpa_mac_learning *ml, struct ml_au_batch *b)
+{
+    long long int start;
+    size_t i;
+
+    ovs_rwlock_wrlock(&ml->rwlock);
+    ml_stat_add(&ml->stats.lock_holds, 1);
+    start = time_usec();
+
+    for (i = 0; i < b->n; i++) {
+        FPA_EVENT_ADDRESS_MSG_STC *msg = &b->msgs[i].msg;
+
+        if (i && !(i % ML_AU_HOLD_CHECK)
+            && time_usec() - start >= ML_AU_HOLD_MAX_US) {
+            mac_learning_au_unlock(ml, start);
+            ml_stat_add(&ml->stats.lock_breaks, 1);
+
+            ovs_rwlock_wrlock(&ml->rwlock);
+            ml_stat_add(&ml->stats.lock_holds, 1);
+            start = time_usec();
+        }
+
+        switch (msg->type) {
+        case FPA_EVENT_ADDRESS_UPDATE_NEW_E:
+            if (b->msgs[i].aged) {
+                ops_fpa_mac_learning_age_by_entry(ml, msg);
+            }
+            ops_fpa_mac_learning_learn(ml, msg);
+            break;
+
+        case FPA_EVENT_ADDRESS_UPDATE_AGED_E:
+            ops_fpa_mac_learning_age_by_entry(ml, msg);
+            break;
+
+        default:
+            VLOG_ERR_RL(&ml_rl, "%s: illegal msg.type: %d", __func__,
+                        msg->type);
+            break;
+        }
+    }
+
+    mac_learning_au_unlock(ml, start);
+    ml_stat_add(&ml->stats.au_batches, 1);
+}
+
+/* Applies AU events queued before ring position 'limit' to the table.
+ * Returns number of events taken from the ring. */
+static size_t
+mac_learning_au_process(struct fpa_mac_learning *ml, struct ml_au_batch *b,
+                        uint32_t limit)
+{
+    size_t n = 0;
+    size_t taken;
+
+    while ((taken = mac_learning_au_drain(ml, b, limit))) {
+        mac_learning_au_apply(ml, b);
+        n += taken;
+    }
+
+    return n;
+}
+
+/* Applies port down or VLAN removed event 'ev' to the table */
+static void
+mac_learning_ctrl_apply(struct fpa_mac_learning *ml,
+                        const struct fpa_ml_event *ev)
+{
+    ovs_rwlock_wrlock(&ml->rwlock);
+    switch (ev->type) {
+    case OPS_FPA_ML_PORT_DOWN_EVENT:
+        ops_fpa_mac_learning_flush_port(ml, ev->data.portNum);
+        break;
+
+    case OPS_FPA_ML_VLAN_REMOVED_EVENT:
+        ops_fpa_mac_learning_flush_vlan(ml, ev->data.vid);
+        break;
+
+    default:
+        VLOG_ERR_RL(&ml_rl, "%s: illegal event type: %d", __func__, ev->type);
+        break;
+    }
+    ovs_rwlock_unlock(&ml->rwlock);
+    ml_stat_add(&ml->stats.ctrl_events, 1);
+}
+
+/* Queues port down or VLAN removed event 'ev' for the event thread. It is
+ * applied after all AU events read from ASIC so far. */
+static void
+mac_learning_ctrl_push(struct fpa_mac_learning *ml,
+                       const struct fpa_ml_event *ev)
+{
+    struct ml_ctrl_event *c = xmalloc(sizeof *c);
+
+    atomic_read_explicit(&ml->events->head, &c->au_seq, memory_order_acquire);
+    c->ev = *ev;
+    guarded_list_push_back(&ml->ctrl_events, &c->node, SIZE_MAX);
+    seq_change(ml->event_seq);
+}
+
+/* Removes entries learned on 'portNum' from the table and the FDB of the
+ * ASIC, asynchronously. */
+void
+ops_fpa_mac_learning_port_down(struct fpa_mac_learning *ml, uint32_t portNum)
+{
+    struct fpa_ml_event ev;
+
+    memset(&ev, 0, sizeof ev);
+    ev.type = OPS_FPA_ML_PORT_DOWN_EVENT;
+    ev.data.portNum = portNum;
+    mac_learning_ctrl_push(ml, &ev);
+}
+
+/* Removes entries learned in VLAN 'vid' from the table and the FDB of the
+ * ASIC, asynchronously. */
+void
+ops_fpa_mac_learning_vlan_removed(struct fpa_mac_learning *ml, uint16_t vid)
+{
+    struct fpa_ml_event ev;
+
+    memset(&ev, 0, sizeof ev);
+    ev.type = OPS_FPA_ML_VLAN_REMOVED_EVENT;
+    ev.data.vid = vid;
+    mac_learning_ctrl_push(ml, &ev);
+}
+
+/* This handler thread applies FDB events to the table in the order they
+ * were queued. Each port down or VLAN removed event is applied once the AU
+ * events read from ASIC before it are. */
+static void *
+mac_learning_events_handler(void *arg)
+{
+    struct fpa_mac_learning *ml = arg;
+    struct ml_au_batch *b;
+    long long int rate_start;
+    uint64_t rate_msgs = 0;
+    uint64_t max;
+
+    ovs_assert(ml);
+
+    b = xmalloc(sizeof *b);
+    hmap_init(&b->index);
+    hmap_reserve(&b->index, ML_AU_BATCH);
+
+    rate_start = time_msec();
+    while (!latch_is_set(&ml->exit_latch)) {
+        uint64_t seq = seq_read(ml->event_seq);
+        struct ml_ctrl_event *c;
+        struct ovs_list ctrl;
+        long long int now;
+        uint32_t head;
+        size_t n_msgs = 0;
+        size_t n_ctrl = 0;
+
+        /* Let expired entries be freed while busy */
+        ovsrcu_quiesce();
+
+        guarded_list_pop_all(&ml->ctrl_events, &ctrl);
+        LIST_FOR_EACH_POP (c, node, &ctrl) {
+            n_msgs += mac_learning_au_process(ml, b, c->au_seq);
+            mac_learning_ctrl_apply(ml, &c->ev);
+            free(c);
+            n_ctrl++;
+        }
+        atomic_read_explicit(&ml->events->head, &head, memory_order_acquire);
+        n_msgs += mac_learning_au_process(ml, b, head);
+        rate_msgs += n_msgs;
+
+        /* Learning rate over the last second */
+        now = time_msec();
+        if (now - rate_start >= 1000) {
+            uint64_t rate = rate_msgs * 1000 / (now - rate_start);
+
+            atomic_store_relaxed(&ml->stats.rate, rate);
+            atomic_read_relaxed(&ml->stats.rate_max, &max);
+            if (rate > max) {
+                atomic_store_relaxed(&ml->stats.rate_max, rate);
+            }
+            rate_start = now;
+            rate_msgs = 0;
+        }
+
+        if (!n_msgs && !n_ctrl) {
+            seq_wait(ml->event_seq, seq);
+            latch_wait(&ml->exit_latch);
+            poll_block();
+            ml_stat_add(&ml->stats.ev_wakeups, 1);
+        }
+    }
+    VLOG_INFO("FDB events apply thread finished");
+
+    hmap_destroy(&b->index);
+    free(b);
+
+    return NULL;
+}
+
+/* This handler thread reads AU messages from ASIC and queues them to the
+ * event thread, so slow table updates never hold off draining the ASIC.
+ * SDK offers no way to wait for AU messages, so the queue is read without
+ * blocking in bursts until it is empty, then the thread sleeps with
+ * exponential backoff. While the event ring is full messages are left
+ * in the ASIC queue. */
 static void *
 mac_learning_asic_events_handler(void *arg)
 {
     struct fpa_mac_learning *ml = arg;
     FPA_STATUS ret;
-    FPA_EVENT_ADDRESS_MSG_STC msg;
+    uint32_t backoff = ML_AU_BACKOFF_MIN;
 
     ovs_assert(ml);
 
     /* Assure that all ports are properly initialized. */
-    sleep(ML_DELAY_STARTUP_TIME);
-
-    /* Receiving and processing events loop. */
-/*TODO test exit logic
-    while (!latch_is_set(&ml->exit_latch)) {*/
-    while (1) {
-        memset(&msg, 0x0, sizeof msg);
-        /* This function blocks until the message arrived. */
-        ret = fpaLibBridgingAuMsgGet(ml->dev->switchId, false, &msg);
-        if ((ret != FPA_OK) && (ret != FPA_NO_MORE)) {
-            VLOG_ERR_RL(&ml_rl, "%s: %s", __func__, ops_fpa_strerr(ret));
-        }
-        else if (ret == FPA_OK) {
-            VLOG_INFO("AuMsg: type:%d, port:%d, vid:%d, MAC:" FPA_ETH_ADDR_FMT,
-                      msg.type, msg.portNum, msg.vid,
-                      FPA_ETH_ADDR_ARGS(msg.address));
+    mac_learning_wait(ml, ML_DELAY_STARTUP_TIME * 1000);
+
+    /* Receiving events loop. */
+    while (!latch_is_set(&ml->exit_latch)) {
+        struct fpa_ml_event ev;
+        bool full = false;
+        size_t n = 0;
+
+        /* Never hold off RCU grace periods during AU storms */
+        ovsrcu_quiesce();
+
+        ret = FPA_OK;
+        while (n < ML_AU_BATCH) {
+            uint32_t head, tail;
 
-            switch (msg.type) {
+            atomic_read_relaxed(&ml->events->head, &head);
+            atomic_read_explicit(&ml->events->tail, &tail, memory_order_acquire);
+            if (head - tail == OPS_FPA_ML_RING_SIZE) {
+                full = true;
+                break;
+            }
+
+            memset(&ev, 0x0, sizeof ev);
+            ret = fpaLibBridgingAuMsgGet(ml->dev->switchId, false, &ev.data.msg);
+            if (ret != FPA_OK) {
+                break;
+            }
+            ml_stat_add(&ml->stats.au_msgs, 1);
+
+            VLOG_DBG("AuMsg: type:%d, port:%d, vid:%d, MAC:" FPA_ETH_ADDR_FMT,
+                     ev.data.msg.type, ev.data.msg.portNum, ev.data.msg.vid,
+                     FPA_ETH_ADDR_ARGS(ev.data.msg.address));
+
+            switch (ev.data.msg.type) {
             case FPA_EVENT_ADDRESS_UPDATE_NEW_E:
-                ovs_rwlock_wrlock(&ml->rwlock);
-                ops_fpa_mac_learning_learn(ml, &msg);
-                ovs_rwlock_unlock(&ml->rwlock);
+                ev.type = OPS_FPA_ML_LEARNING_EVENT;
                 break;
 
             case FPA_EVENT_ADDRESS_UPDATE_AGED_E:
-                ovs_rwlock_wrlock(&ml->rwlock);
-                ops_fpa_mac_learning_age_by_entry(ml, &msg);
-                ovs_rwlock_unlock(&ml->rwlock);
+                ev.type = OPS_FPA_ML_AGING_EVENT;
                 break;
 
             default:
                 VLOG_ERR_RL(&ml_rl, "%s: illegal msg.type: %d", __func__,
-                            msg.type);
-                break;
+                            ev.data.msg.type);
+                continue;
             }
+
+            ml_ring_push(ml, &ev);
+            n++;
         }
-        else {
-            VLOG_DBG_RL(&ml_rl, "%s: empty AuMsg queue", __func__);
+
+        if (n) {
+            seq_change(ml->event_seq);
+        }
+
+        if (full) {
+            /* Give event thread time to catch up */
+            ml_stat_add(&ml->stats.ring_full, 1);
+            mac_learning_wait(ml, ML_AU_BACKOFF_MIN);
+            continue;
         }
 
-        /* TODO: another thread "event_thread" to be created for servicing all
-         * ML events: NA, aging, flushing interfaces/VLAN, static MAC.
-         * Current thread will just send events to event_thread */
+        if (ret == FPA_OK) {
+            backoff = ML_AU_BACKOFF_MIN;
+            continue;
+        }
+
+        if (ret == FPA_NO_MORE) {
+            ml_stat_add(&ml->stats.empty_polls, 1);
+        } else {
+            ml_stat_add(&ml->stats.au_errors, 1);
+            VLOG_ERR_RL(&ml_rl, "%s: %s", __func__, ops_fpa_strerr(ret));
+        }
+
+        /* Sleep only if the queue was already empty on the last read */
+        if (n) {
+            backoff = ML_AU_BACKOFF_MIN;
+        } else {
+            atomic_store_relaxed(&ml->stats.backoff_ms, backoff);
+            mac_learning_wait(ml, backoff);
+            backoff = MIN(backoff * 2, ML_AU_BACKOFF_MAX);
+        }
     }
     VLOG_INFO("FDB events processing thread finished");
 
@@ -488,27 +1208,115 @@ void
 ops_fpa_mac_learning_dump_table(struct fpa_mac_learning *ml, struct ds *d_str)
 {
     const struct fpa_mac_entry *e = NULL;
+    long long int now = time_msec();
 
     ovs_assert(ml);
     ovs_assert(d_str);
 
-    ds_put_cstr(d_str, " port    VLAN  MAC                index\n");
+    ds_put_cstr(d_str, " port    VLAN  MAC                index       age\n");
 
-    HMAP_FOR_EACH(e, hmap_node, &ml->table) {
+    CMAP_FOR_EACH (e, cmap_node, &ml->table) {
         if (e) {
             char iface_name[PORT_NAME_SIZE];
+            FPA_MAC_ADDRESS_STC mac;
 
-            snprintf(iface_name, PORT_NAME_SIZE, "%u", e->fdb_entry.portNum);
+            snprintf(iface_name, PORT_NAME_SIZE, "%u", e->portNum);
+            ops_fpa_ml_key_mac(e->key, &mac);
 
-            ds_put_format(d_str, "%-8s %4d  "FPA_ETH_ADDR_FMT"  0x%lx\n",
+            ds_put_format(d_str, "%-8s %4d  "FPA_ETH_ADDR_FMT"  0x%08"PRIx32"  %lld\n",
                           iface_name,
-                          e->fdb_entry.vid,
-                          FPA_ETH_ADDR_ARGS(e->fdb_entry.address),
-                          e->hmap_node.hash);
+                          ops_fpa_ml_key_vid(e->key),
+                          FPA_ETH_ADDR_ARGS(mac),
+                          e->hash, (now - e->learned) / 1000);
         }
     }
 }
 
+void
+ops_fpa_mac_learning_dump_stats(struct fpa_mac_learning *ml, struct ds *d_str)
+{
+    uint64_t wakeups, empty_polls, au_msgs, au_errors;
+    uint64_t au_batches, au_coalesced, lock_holds, lock_breaks, hold_max;
+    uint64_t rate, rate_max, ring_full, ctrl_events, ev_wakeups;
+    uint64_t notifies, notify_events;
+    uint64_t spilled, spill_max, dropped, lost, resyncs;
+    uint32_t backoff_ms, ring_max, head, tail;
+    size_t slab_chunks, slab_used;
+
+    ovs_assert(ml);
+    ovs_assert(d_str);
+
+    atomic_read_relaxed(&ml->stats.wakeups, &wakeups);
+    atomic_read_relaxed(&ml->stats.empty_polls, &empty_polls);
+    atomic_read_relaxed(&ml->stats.au_msgs, &au_msgs);
+    atomic_read_relaxed(&ml->stats.au_errors, &au_errors);
+    atomic_read_relaxed(&ml->stats.backoff_ms, &backoff_ms);
+    atomic_read_relaxed(&ml->stats.au_batches, &au_batches);
+    atomic_read_relaxed(&ml->stats.au_coalesced, &au_coalesced);
+    atomic_read_relaxed(&ml->stats.lock_holds, &lock_holds);
+    atomic_read_relaxed(&ml->stats.lock_breaks, &lock_breaks);
+    atomic_read_relaxed(&ml->stats.lock_hold_max_us, &hold_max);
+    atomic_read_relaxed(&ml->stats.rate, &rate);
+    atomic_read_relaxed(&ml->stats.rate_max, &rate_max);
+    atomic_read_relaxed(&ml->stats.ring_full, &ring_full);
+    atomic_read_relaxed(&ml->stats.ring_max, &ring_max);
+    atomic_read_relaxed(&ml->stats.ctrl_events, &ctrl_events);
+    atomic_read_relaxed(&ml->stats.ev_wakeups, &ev_wakeups);
+    atomic_read_relaxed(&ml->stats.notifies, &notifies);
+    atomic_read_relaxed(&ml->stats.notify_events, &notify_events);
+    atomic_read_relaxed(&ml->stats.mlearn_spilled, &spilled);
+    atomic_read_relaxed(&ml->stats.mlearn_spill_max, &spill_max);
+    atomic_read_relaxed(&ml->stats.mlearn_dropped, &dropped);
+    atomic_read_relaxed(&ml->stats.mlearn_lost, &lost);
+    atomic_read_relaxed(&ml->stats.mlearn_resyncs, &resyncs);
+    atomic_read_relaxed(&ml->events->head, &head);
+    atomic_read_relaxed(&ml->events->tail, &tail);
+
+    ovs_mutex_lock(&ml_slab_mutex);
+    slab_chunks = ml_slab_n_chunks;
+    slab_used = ml_slab_n_used;
+    ovs_mutex_unlock(&ml_slab_mutex);
+
+    ds_put_format(d_str, "FDB events of switch %d:\n", ml->dev->switchId);
+    ovs_rwlock_rdlock(&ml->rwlock);
+    ds_put_format(d_str, "  Entries:               %"PRIuSIZE" on %"PRIuSIZE" ports\n",
+                  cmap_count(&ml->table), hmap_count(&ml->ports));
+    ds_put_format(d_str, "  Put off MAC events now: %"PRIuSIZE"%s\n",
+                  hmap_count(&ml->mlearn_spill),
+                  ml->mlearn_resync ? ", resync pending" : "");
+    ovs_rwlock_unlock(&ml->rwlock);
+    ds_put_format(d_str, "  Entry memory:          %"PRIuSIZE" bytes/entry, %"PRIuSIZE" kB slab, %"PRIuSIZE" in use\n",
+                  sizeof(struct fpa_mac_entry),
+                  slab_chunks * sizeof(struct ml_slab_chunk) / 1024, slab_used);
+    ds_put_format(d_str, "  AU messages:           %"PRIu64"\n", au_msgs);
+    ds_put_format(d_str, "  AU read errors:        %"PRIu64"\n", au_errors);
+    ds_put_format(d_str, "  AU batches:            %"PRIu64" (avg %.1f messages, %"PRIu64" coalesced)\n",
+                  au_batches,
+                  au_batches ? (double) (au_msgs - au_coalesced) / au_batches : 0.0,
+                  au_coalesced);
+    ds_put_format(d_str, "  Table lock holds:      %"PRIu64" (%"PRIu64" cut at %d us, max %"PRIu64" us)\n",
+                  lock_holds, lock_breaks, ML_AU_HOLD_MAX_US, hold_max);
+    ds_put_format(d_str, "  Event ring:            %"PRIu32" queued (max %"PRIu32" of %d, full %"PRIu64" times)\n",
+                  head - tail, ring_max, OPS_FPA_ML_RING_SIZE, ring_full);
+    ds_put_format(d_str, "  Port/VLAN flushes:     %"PRIu64"\n", ctrl_events);
+    ds_put_format(d_str, "  Event thread wakeups:  %"PRIu64"\n", ev_wakeups);
+    ds_put_format(d_str, "  vswitchd notifies:     %"PRIu64" (avg %.1f events, window %d ms or %d events)\n",
+                  notifies,
+                  notifies ? (double) notify_events / notifies : 0.0,
+                  ML_NOTIFY_DELAY_MS, ML_NOTIFY_EVENTS);
+    ds_put_format(d_str, "  Put off MAC events:    %"PRIu64" (max %"PRIu64" pending, high-water %d)\n",
+                  spilled, spill_max, ML_SPILL_MAX);
+    ds_put_format(d_str, "  Dropped MAC events:    %"PRIu64" add, %"PRIu64" delete (lost)\n",
+                  dropped, lost);
+    ds_put_format(d_str, "  Full FDB resyncs:      %"PRIu64"\n", resyncs);
+    ds_put_format(d_str, "  Learning rate:         %"PRIu64" entries/s (max %"PRIu64")\n",
+                  rate, rate_max);
+    ds_put_format(d_str, "  Empty AU polls:        %"PRIu64"\n", empty_polls);
+    ds_put_format(d_str, "  Wakeups:               %"PRIu64"\n", wakeups);
+    ds_put_format(d_str, "  Current backoff:       %"PRIu32" ms (max %d ms)\n",
+                  backoff_ms, ML_AU_BACKOFF_MAX);
+}
+
 /* Checks if the hmap has reached it's capacity or not. */
 static bool
 ops_fpa_mac_learning_mlearn_table_is_full(const struct mlearn_hmap *mhmap)
@@ -527,17 +1335,29 @@ ops_fpa_mac_learning_clear_mlearn_hmap(struct mlearn_hmap *mhmap)
     }
 }
 
-/* Fills mlearn_hmap_node fields. */
-static void
+/* Fills mlearn_hmap_node fields. Returns false, leaving 'entry' intact, if
+ * the port of 'fdb_entry' is deleted already. */
+static bool
 ops_fpa_mac_learning_mlearn_entry_fill_data(struct fpa_dev *dev,
                                            struct mlearn_hmap_node *entry,
                                            FPA_EVENT_ADDRESS_MSG_STC *fdb_entry,
                                            const mac_event event)
 {
+    struct fpa_ofport *port;
+
     ovs_assert(dev);
     ovs_assert(entry);
     ovs_assert(fdb_entry);
 
+    port = ops_fpa_get_ofport_by_pid(fdb_entry->portNum);
+    if (!port) {
+        VLOG_WARN_RL(&ml_rl, "%s: Skip MAC event for VLAN %d and MAC: "
+                     FPA_ETH_ADDR_FMT ", port %u is deleted", __func__,
+                     fdb_entry->vid, FPA_ETH_ADDR_ARGS(fdb_entry->address),
+                     fdb_entry->portNum);
+        return false;
+    }
+
     /*ops_fpa_mac_copy_and_reverse(entry->mac.ea, fdb_entry->address.addr);*/
     memcpy(entry->mac.ea, fdb_entry->address.addr, ETH_ADDR_LEN);
 
@@ -545,28 +1365,134 @@ ops_fpa_mac_learning_mlearn_entry_fill_data(struct fpa_dev *dev,
     entry->vlan = fdb_entry->vid;
     entry->hw_unit = dev->switchId;
     entry->oper = event;
-
-    struct fpa_ofport *port = ops_fpa_get_ofport_by_pid(fdb_entry->portNum);
-    ovs_assert(port);
     strncpy(entry->port_name, netdev_get_name(port->up.netdev), PORT_NAME_SIZE);
+
+    return true;
+}
+
+/* Sets when pending mlearn events are handed to vswitchd to 'due' unless
+ * it is set earlier already. */
+static void
+mac_learning_mlearn_arm(struct fpa_mac_learning *ml, long long int due)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    long long int deadline;
+
+    /* Nothing to hand over to until mac learning plugin is found */
+    if (!ml->plugin_interface) {
+        return;
+    }
+
+    atomic_read_relaxed(&ml->mlearn_deadline, &deadline);
+    if (due < deadline) {
+        atomic_store_relaxed(&ml->mlearn_deadline, due);
+        seq_change(ml->mlearn_seq);
+    }
+}
+
+static struct ml_spill_event *
+mac_learning_spill_lookup(const struct fpa_mac_learning *ml, uint32_t index)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    struct hmap_node *node = hmap_first_with_hash(&ml->mlearn_spill, index);
+
+    return node ? CONTAINER_OF(node, struct ml_spill_event, hmap_node) : NULL;
+}
+
+/* Puts off event which found current mlearn table full. Add events past
+ * ML_SPILL_MAX are dropped and the whole table is handed over again
+ * instead. Resync itself stops short of ML_SPILL_MAX, see
+ * mac_learning_mlearn_resync(). */
+static void
+mac_learning_mlearn_spill(struct fpa_mac_learning *ml,
+                          FPA_EVENT_ADDRESS_MSG_STC *fdb_entry,
+                          uint32_t index, const mac_event event)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    size_t n = hmap_count(&ml->mlearn_spill);
+    struct ml_spill_event *s;
+    uint64_t max;
+
+    if (event == MLEARN_ADD && n >= ML_SPILL_MAX) {
+        if (!ml->mlearn_resync) {
+            VLOG_WARN_RL(&ml_rl, "%s: %"PRIuSIZE" MAC events pending, "
+                         "vswitchd will get whole FDB again", __func__, n);
+            ml->mlearn_resync = true;
+        }
+        /* Dropped entry may be behind resync in progress, start over */
+        memset(&ml->mlearn_resync_pos, 0, sizeof ml->mlearn_resync_pos);
+        ml_stat_add(&ml->stats.mlearn_dropped, 1);
+        return;
+    }
+    if (n >= ML_SPILL_HARD_MAX) {
+        VLOG_ERR_RL(&ml_rl, "%s: Unable to queue MAC event for VLAN %d "
+                    "and MAC: " FPA_ETH_ADDR_FMT ", %"PRIuSIZE" pending",
+                    __func__, fdb_entry->vid,
+                    FPA_ETH_ADDR_ARGS(fdb_entry->address), n);
+        ml_stat_add(&ml->stats.mlearn_lost, 1);
+        return;
+    }
+
+    s = xmalloc(sizeof *s);
+    if (!ops_fpa_mac_learning_mlearn_entry_fill_data(ml->dev, &s->data,
+                                                    fdb_entry, event)) {
+        free(s);
+        return;
+    }
+    hmap_insert(&ml->mlearn_spill, &s->hmap_node, index);
+    ml_stat_add(&ml->stats.mlearn_spilled, 1);
+
+    atomic_read_relaxed(&ml->stats.mlearn_spill_max, &max);
+    if (n + 1 > max) {
+        atomic_store_relaxed(&ml->stats.mlearn_spill_max, n + 1);
+    }
+}
+
+/* Moves put off events to current mlearn table while there is room */
+static void
+mac_learning_mlearn_unspill(struct fpa_mac_learning *ml)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    struct mlearn_hmap *mhmap;
+    struct ml_spill_event *s, *next;
+
+    mhmap = &ml->mlearn_event_tables[ml->curr_mlearn_table_in_use];
+    HMAP_FOR_EACH_SAFE (s, next, hmap_node, &ml->mlearn_spill) {
+        struct mlearn_hmap_node *e;
+
+        if (ops_fpa_mac_learning_mlearn_table_is_full(mhmap)) {
+            break;
+        }
+
+        e = &(mhmap->buffer.nodes[mhmap->buffer.actual_size]);
+        memcpy(e, &s->data, sizeof *e);
+        hmap_insert(&mhmap->table, &(e->hmap_node), s->hmap_node.hash);
+        mhmap->buffer.actual_size++;
+
+        hmap_remove(&ml->mlearn_spill, &s->hmap_node);
+        free(s);
+    }
 }
 
 /* Adds the action entry in the mlearn_event_tables hmap.
  *
  * If the entry is already present, it is modified or else it's created.
+ * If the current hmap is full, the entry is put off until it is handed
+ * over to vswitchd.
  */
 /* TODO: reHashIndex usage to be revised */
 static void
-ops_fpa_mac_learning_mlearn_action_add(struct fpa_mac_learning *ml,
-                                      FPA_EVENT_ADDRESS_MSG_STC *fdb_entry,
-                                      uint32_t index,
-                                      uint32_t reHashIndex,
-                                      const mac_event event)
+mac_learning_mlearn_add(struct fpa_mac_learning *ml,
+                        FPA_EVENT_ADDRESS_MSG_STC *fdb_entry,
+                        uint32_t index,
+                        uint32_t reHashIndex,
+                        const mac_event event)
     OVS_REQ_WRLOCK(ml->rwlock)
 {
     struct mlearn_hmap_node *e;
     struct hmap_node *node;
     struct mlearn_hmap *mhmap;
+    struct ml_spill_event *s;
     int actual_size = 0;
 
     ovs_assert(ml);
@@ -597,33 +1523,91 @@ ops_fpa_mac_learning_mlearn_action_add(struct fpa_mac_learning *ml,
 #endif
         ops_fpa_mac_learning_mlearn_entry_fill_data(ml->dev, e,
                                                    fdb_entry, event);
+    } else if ((s = mac_learning_spill_lookup(ml, index))) {
+        /* Entry is put off - just fill it with new data. */
+        ops_fpa_mac_learning_mlearn_entry_fill_data(ml->dev, &s->data,
+                                                   fdb_entry, event);
     } else {
 
         /* Entry doesn't exist - add a new one. */
         if (actual_size < mhmap->buffer.size) {
             e = &(mhmap->buffer.nodes[actual_size]);
-            ops_fpa_mac_learning_mlearn_entry_fill_data(ml->dev, e,
-                                                       fdb_entry, event);
-            hmap_insert(&mhmap->table, &(e->hmap_node), index);
-            mhmap->buffer.actual_size++;
+            if (ops_fpa_mac_learning_mlearn_entry_fill_data(ml->dev, e,
+                                                           fdb_entry, event)) {
+                hmap_insert(&mhmap->table, &(e->hmap_node), index);
+                mhmap->buffer.actual_size++;
+            }
         } else {
-            VLOG_ERR("Not able to insert elements in hmap, size is: %u",
-                      mhmap->buffer.actual_size);
+            mac_learning_mlearn_spill(ml, fdb_entry, index, event);
         }
     }
+}
 
-    /* Notify vswitchd */
-    if (ops_fpa_mac_learning_mlearn_table_is_full(mhmap)) {
-        ops_fpa_mac_learning_process_mlearn(ml);
+static void
+ops_fpa_mac_learning_mlearn_action_add(struct fpa_mac_learning *ml,
+                                      FPA_EVENT_ADDRESS_MSG_STC *fdb_entry,
+                                      uint32_t index,
+                                      uint32_t reHashIndex,
+                                      const mac_event event)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    struct mlearn_hmap *mhmap;
+
+    mac_learning_mlearn_add(ml, fdb_entry, index, reHashIndex, event);
+
+    /* Notify vswitchd from main thread once coalescing window ends or
+     * enough events are pending, whichever comes first */
+    mhmap = &ml->mlearn_event_tables[ml->curr_mlearn_table_in_use];
+    if (mhmap->buffer.actual_size >= ML_NOTIFY_EVENTS
+        || ops_fpa_mac_learning_mlearn_table_is_full(mhmap)) {
+        mac_learning_mlearn_arm(ml, time_msec());
+    } else {
+        mac_learning_mlearn_arm(ml, time_msec() + ML_NOTIFY_DELAY_MS);
     }
 }
 
+/* Hands over add event for every entry of the table after add events
+ * were dropped. Goes after events put off so far, so it overrides them.
+ * Entries are handed over from 'mlearn_resync_pos' until ML_SPILL_MAX
+ * events are put off, the rest goes with next hand overs. */
+static void
+mac_learning_mlearn_resync(struct fpa_mac_learning *ml)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    struct cmap_node *node;
+
+    for (;;) {
+        FPA_EVENT_ADDRESS_MSG_STC msg;
+        struct fpa_mac_entry *e;
+
+        if (hmap_count(&ml->mlearn_spill) >= ML_SPILL_MAX) {
+            return;
+        }
+
+        node = cmap_next_position(&ml->table, &ml->mlearn_resync_pos);
+        if (!node) {
+            break;
+        }
+
+        e = CONTAINER_OF(node, struct fpa_mac_entry, cmap_node);
+        ml_entry_msg(e, &msg);
+        mac_learning_mlearn_add(ml, &msg, e->hash, e->hash, MLEARN_ADD);
+    }
+
+    ml->mlearn_resync = false;
+    memset(&ml->mlearn_resync_pos, 0, sizeof ml->mlearn_resync_pos);
+    ml_stat_add(&ml->stats.mlearn_resyncs, 1);
+    VLOG_INFO("Whole FDB of %"PRIuSIZE" entries handed over to vswitchd",
+              cmap_count(&ml->table));
+}
+
 /* Main processing function for OPS mlearn tables.
  *
- * This function will be invoked when either of the two conditions
- * are satisfied:
- * 1. current in use hmap for storing all macs learnt is full
- * 2. timer thread times out
+ * This function will be invoked by main thread when either of the
+ * conditions are satisfied:
+ * 1. ML_NOTIFY_EVENTS are pending or current in use hmap is full
+ * 2. ML_NOTIFY_DELAY_MS passed since the first pending event
+ * 3. timer thread times out
  *
  * This function will check if there is any new MACs learnt, if yes,
  * then it triggers callback from bridge.
@@ -636,16 +1620,72 @@ static void
 ops_fpa_mac_learning_process_mlearn(struct fpa_mac_learning *ml)
     OVS_REQ_WRLOCK(ml->rwlock)
 {
+    if (ml && !ml->plugin_interface) {
+        mac_learning_plugin_lookup(ml);
+    }
+
     if (ml && ml->plugin_interface) {
-        if (hmap_count(&(ml->mlearn_event_tables[ml->curr_mlearn_table_in_use].table))) {
+        size_t n;
+
+        if (ml->mlearn_resync) {
+            mac_learning_mlearn_resync(ml);
+        }
+
+        n = hmap_count(&(ml->mlearn_event_tables[ml->curr_mlearn_table_in_use].table));
+        if (n) {
             ml->plugin_interface->mac_learning_trigger_callback();
+            ml_stat_add(&ml->stats.notifies, 1);
+            ml_stat_add(&ml->stats.notify_events, n);
             ml->curr_mlearn_table_in_use = ml->curr_mlearn_table_in_use ^ 1;
             ops_fpa_mac_learning_clear_mlearn_hmap(&ml->mlearn_event_tables[ml->curr_mlearn_table_in_use]);
         }
     } else {
-        VLOG_ERR("%s: Unable to find mac learning plugin interface",
-                 __func__);
+        /* Events wait in the tables for the plugin, the mlearn timer looks
+         * it up again */
+        VLOG_WARN_ONCE("%s: Unable to find mac learning plugin interface",
+                       __func__);
+    }
+
+    if (ml) {
+        atomic_store_relaxed(&ml->mlearn_deadline, LLONG_MAX);
+
+        /* Put off events go with the next hand over */
+        mac_learning_mlearn_unspill(ml);
+        if (ml->mlearn_event_tables[ml->curr_mlearn_table_in_use].buffer.actual_size
+            || ml->mlearn_resync) {
+            mac_learning_mlearn_arm(ml, time_msec() + ML_NOTIFY_DELAY_MS);
+        }
+    }
+}
+
+/* Notifies vswitchd of pending mlearn events once they are due. Must be
+ * called from main thread, which reads the handed over hmap. */
+void
+ops_fpa_mac_learning_run(struct fpa_mac_learning *ml)
+{
+    long long int deadline;
+
+    atomic_read_relaxed(&ml->mlearn_deadline, &deadline);
+    if (deadline <= time_msec()) {
+        ovs_rwlock_wrlock(&ml->rwlock);
+        ops_fpa_mac_learning_process_mlearn(ml);
+        ovs_rwlock_unlock(&ml->rwlock);
+    }
+}
+
+void
+ops_fpa_mac_learning_wait(struct fpa_mac_learning *ml)
+{
+    long long int deadline;
+    uint64_t seq = seq_read(ml->mlearn_seq);
+
+    atomic_read_relaxed(&ml->mlearn_deadline, &deadline);
+    if (deadline != LLONG_MAX) {
+        poll_timer_wait_until(deadline);
+    } else {
+        seq_wait(ml->mlearn_seq, seq);
     }
+    timer_wait(&ml->mlearn_timer);
 }
 
 /* Mlearn timer expiration handler. */
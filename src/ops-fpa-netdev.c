@@ -20,6 +20,8 @@
 #include <openswitch-dflt.h>
 #include <netinet/ether.h>
 #include "ops-fpa.h"
+#include "ops-fpa-dev.h"
+#include "ops-fpa-mac-learning.h"
 #include "ops-fpa-tap.h"
 
 VLOG_DEFINE_THIS_MODULE(ops_fpa_netdev);
@@ -45,6 +47,12 @@ struct fpa_netdev {
     /* For virtual interfaces we have no sid/pid and thus can't access flags
      * via FPA calls. */
     enum netdev_flags flags;
+
+    /* Switch and VLAN of CPU packet counters reported as statistics of
+     * virtual interface, 'cpu_vid' is -1 for all VLANs and 'cpu_sid' is
+     * FPA_INVALID_SWITCH_ID if interface has none. */
+    int cpu_sid;
+    int cpu_vid;
 };
 
 #define FPA_NETDEV(PTR) CONTAINER_OF(PTR, struct fpa_netdev, up)
@@ -87,6 +95,15 @@ ops_fpa_netdev_run(void)
             dev->link_status = link_status;
             if (link_status) dev->link_resets++;
             netdev_change_seq_changed(&dev->up);
+
+            /* Addresses learned on the port are gone with the link */
+            if (!link_status) {
+                struct fpa_mac_learning *ml = ops_fpa_dev_by_id(dev->sid)->ml;
+
+                if (ml) {
+                    ops_fpa_mac_learning_port_down(ml, dev->pid);
+                }
+            }
         }
     }
 }
@@ -111,6 +128,36 @@ ops_fpa_netdev_dealloc(struct netdev *up)
     free(dev);
 }
 
+/* Resolves CPU packet counters of virtual interface 'dev' once, so
+ * statistics are read without parsing its name. Bridge interface gets
+ * totals, "vlanN" and "port.N" interfaces get counters of VLAN N. */
+static void
+ops_fpa_netdev_cpu_stats_init(struct fpa_netdev *dev)
+{
+    const struct netdev *up = &dev->up;
+    const char *dot;
+
+    dev->cpu_sid = FPA_INVALID_SWITCH_ID;
+    dev->cpu_vid = -1;
+
+    if (STR_EQ(up->netdev_class->type, "vlansubint")) {
+        dot = strrchr(up->name, '.');
+        if (!dot || ops_fpa_str2int(dot + 1, &dev->cpu_vid)) {
+            return;
+        }
+    } else if (!STR_EQ(up->netdev_class->type, "internal")) {
+        return;
+    } else if (!STR_EQ(up->name, "bridge_normal")) { /*TODO need to take correct bridge interface name for our ofproto */
+        if (strncmp(up->name, "vlan", 4) || ops_fpa_str2int(up->name + 4, &dev->cpu_vid)) {
+            dev->cpu_vid = -1;
+            return;
+        }
+    }
+
+    /* Virtual interfaces belong to the only FPA device */
+    dev->cpu_sid = FPA_DEV_SWITCH_ID_DEFAULT;
+}
+
 static int
 ops_fpa_netdev_construct(struct netdev *up)
 {
@@ -140,9 +187,21 @@ ops_fpa_netdev_construct(struct netdev *up)
 
     dev->tap_fd = 0;
 
+    ops_fpa_netdev_cpu_stats_init(dev);
+
     return 0;
 }
 
+/* Gets VLAN ID of SVI interface "vlanN" into 'vid'.
+ * Returns false if 'up' is not SVI interface. */
+static bool
+ops_fpa_netdev_svi_vid(const struct netdev *up, int *vid)
+{
+    return STR_EQ(up->netdev_class->type, "internal")
+           && !strncmp(up->name, "vlan", 4)
+           && !ops_fpa_str2int(up->name + 4, vid);
+}
+
 static void
 ops_fpa_netdev_destruct(struct netdev *up)
 {
@@ -164,6 +223,11 @@ ops_fpa_netdev_destruct(struct netdev *up)
         ops_fpa_bridge_delete("bridge_normal");
     }
 
+    int vid;
+    if (dev->inited && ops_fpa_netdev_svi_vid(up, &vid)) {
+        ops_fpa_tap_svi_vlan_set(FPA_DEV_SWITCH_ID_DEFAULT, vid, false);
+    }
+
     ovs_mutex_destroy(&dev->mutex);
 }
 
@@ -439,15 +503,44 @@ ops_fpa_netdev_set_miimon_interval(struct netdev *up, long long int interval)
     return 0;
 }
 
+/* Fills 'stats' of virtual interface from CPU packet path counters */
+static int
+ops_fpa_netdev_get_cpu_stats(const struct netdev *up, struct netdev_stats *stats)
+{
+    struct fpa_netdev *dev = FPA_NETDEV(up);
+    struct ops_fpa_tap_cpu_stats cpu_stats;
+    int err;
+
+    memset(stats, 0xFF, sizeof(*stats));
+
+    if (dev->cpu_sid == FPA_INVALID_SWITCH_ID) {
+        return 0;
+    }
+
+    err = ops_fpa_tap_cpu_stats_get(dev->cpu_sid, dev->cpu_vid, &cpu_stats);
+    if (err) {
+        return 0;
+    }
+
+    stats->rx_packets      = cpu_stats.rx_packets;
+    stats->tx_packets      = cpu_stats.tx_packets;
+    stats->rx_bytes        = cpu_stats.rx_bytes;
+    stats->tx_bytes        = cpu_stats.tx_bytes;
+    stats->rx_dropped      = cpu_stats.rx_dropped;
+    stats->tx_dropped      = cpu_stats.tx_dropped;
+
+    return 0;
+}
+
 static int
 ops_fpa_netdev_get_stats(const struct netdev *up, struct netdev_stats *stats)
 {
     VLOG_DBG("%s<%s,%s>:", __func__, up->netdev_class->type, up->name);
     struct fpa_netdev *dev = FPA_NETDEV(up);
 
-    if (STR_EQ(up->netdev_class->type, "internal")) {
-        memset(stats, 0xFF, sizeof(*stats));
-        return 0;
+    if (STR_EQ(up->netdev_class->type, "internal") ||
+        STR_EQ(up->netdev_class->type, "vlansubint")) {
+        return ops_fpa_netdev_get_cpu_stats(up, stats);
     }
 
     FPA_PORT_COUNTERS_STC counters;
@@ -719,6 +812,12 @@ internal_netdev_set_hw_intf_info(struct netdev *up, const struct smap *args)
             }
         }
 
+        /* SVI traffic bypasses port TAP interfaces in direct SVI mode */
+        int vid;
+        if (ops_fpa_netdev_svi_vid(up, &vid)) {
+            ops_fpa_tap_svi_vlan_set(FPA_DEV_SWITCH_ID_DEFAULT, vid, true);
+        }
+
         dev->inited = true;
     }
     ovs_mutex_unlock(&dev->mutex);
@@ -801,7 +900,7 @@ static struct netdev_class fpa_netdev_internal = {
     .get_carrier          = NULL,
     .get_carrier_resets   = NULL,
     .set_miimon_interval  = NULL,
-    .get_stats            = NULL,
+    .get_stats            = ops_fpa_netdev_get_stats,
     .get_features         = NULL,
     .set_advertisements   = NULL,
     .set_policing         = NULL,
@@ -863,7 +962,7 @@ static struct netdev_class fpa_netdev_vlansubint = {
     .get_carrier          = ops_fpa_netdev_get_carrier,
     .get_carrier_resets   = NULL,
     .set_miimon_interval  = NULL,
-    .get_stats            = NULL,
+    .get_stats            = ops_fpa_netdev_get_stats,
     .get_features         = NULL,
     .set_advertisements   = NULL,
     .set_policing         = NULL,
@@ -0,0 +1,407 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *  File: ops-fpa-offload.c
+ *
+ *  Purpose: Software checksum, TCP segmentation (GSO) and receive
+ *           coalescing (GRO) for CPU TAP interfaces with vnet header.
+ */
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <csum.h>
+
+#include "ops-fpa.h"
+#include "ops-fpa-offload.h"
+
+#define OPS_FPA_ETH_HDR_LEN     14
+#define OPS_FPA_DOT1Q_LEN       4
+#define OPS_FPA_IPV4_HDR_LEN    20
+#define OPS_FPA_IPV6_HDR_LEN    40
+#define OPS_FPA_TCP_HDR_LEN     20
+
+#define OPS_FPA_TCP_FIN         0x01
+#define OPS_FPA_TCP_PSH         0x08
+#define OPS_FPA_TCP_ACK         0x10
+#define OPS_FPA_TCP_CWR         0x80
+
+/* Packets received from ASIC or TAP are not aligned, so multibyte header
+ * fields are accessed bytewise */
+static inline uint16_t
+get_be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline void
+put_be16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static inline uint32_t
+get_be32(const uint8_t *p)
+{
+    return ((uint32_t)get_be16(p) << 16) | get_be16(p + 2);
+}
+
+static inline void
+put_be32(uint8_t *p, uint32_t value)
+{
+    put_be16(p, value >> 16);
+    put_be16(p + 2, value);
+}
+
+static inline void
+put_csum(uint8_t *p, ovs_be16 csum)
+{
+    memcpy(p, &csum, sizeof csum);
+}
+
+/* Headers of TCP frame */
+struct offload_tcp {
+    uint32_t l3_off;
+    uint32_t l4_off;
+    uint32_t hdr_len;
+    bool ipv6;
+};
+
+/* Parses TCP over IPv4 or IPv6 (without extension headers) frame,
+ * optionally 802.1Q tagged. Returns 0 on success. */
+static int
+offload_parse_tcp(const uint8_t *data, uint32_t len, struct offload_tcp *t)
+{
+    const uint8_t *ip;
+    uint16_t type;
+
+    if (len < OPS_FPA_ETH_HDR_LEN) {
+        return EINVAL;
+    }
+
+    t->l3_off = OPS_FPA_ETH_HDR_LEN;
+    type = get_be16(data + 12);
+    if (type == ETHERTYPE_VLAN) {
+        if (len < OPS_FPA_ETH_HDR_LEN + OPS_FPA_DOT1Q_LEN) {
+            return EINVAL;
+        }
+        type = get_be16(data + 16);
+        t->l3_off += OPS_FPA_DOT1Q_LEN;
+    }
+
+    ip = data + t->l3_off;
+    if (type == ETHERTYPE_IP) {
+        if (len < t->l3_off + OPS_FPA_IPV4_HDR_LEN || (ip[0] >> 4) != 4
+            || (ip[0] & 0x0f) * 4 < OPS_FPA_IPV4_HDR_LEN || ip[9] != IPPROTO_TCP) {
+            return EINVAL;
+        }
+        t->l4_off = t->l3_off + (ip[0] & 0x0f) * 4;
+        t->ipv6 = false;
+    } else if (type == ETHERTYPE_IPV6) {
+        if (len < t->l3_off + OPS_FPA_IPV6_HDR_LEN || ip[6] != IPPROTO_TCP) {
+            return EINVAL;
+        }
+        t->l4_off = t->l3_off + OPS_FPA_IPV6_HDR_LEN;
+        t->ipv6 = true;
+    } else {
+        return EINVAL;
+    }
+
+    if (len < t->l4_off + OPS_FPA_TCP_HDR_LEN) {
+        return EINVAL;
+    }
+    t->hdr_len = t->l4_off + (data[t->l4_off + 12] >> 4) * 4;
+    if (t->hdr_len < t->l4_off + OPS_FPA_TCP_HDR_LEN || t->hdr_len > len) {
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+/* Returns partial checksum of TCP pseudo header */
+static uint32_t
+offload_pseudo4(const uint8_t *ip, uint32_t tcp_len)
+{
+    uint32_t partial;
+
+    partial = csum_continue(0, ip + 12, 8);
+    partial = csum_add16(partial, htons(IPPROTO_TCP));
+    return csum_add16(partial, htons(tcp_len));
+}
+
+static uint32_t
+offload_pseudo6(const uint8_t *ip, uint32_t tcp_len)
+{
+    uint32_t partial;
+
+    partial = csum_continue(0, ip + 8, 32);
+    partial = csum_add32(partial, htonl(tcp_len));
+    return csum_add16(partial, htons(IPPROTO_TCP));
+}
+
+/* Completes checksum left partial by kernel as requested by 'vh'.
+ * Returns 0 on success or if nothing to do. */
+int
+ops_fpa_csum_complete(uint8_t *data, uint32_t len,
+                      const struct virtio_net_hdr *vh)
+{
+    uint32_t start = vh->csum_start;
+    uint32_t offset = vh->csum_offset;
+
+    if (!(vh->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) {
+        return 0;
+    }
+    if (start >= len || start + offset + sizeof(ovs_be16) > len) {
+        return EINVAL;
+    }
+
+    /* Checksum field already holds pseudo header sum */
+    put_csum(data + start + offset, csum(data + start, len - start));
+
+    return 0;
+}
+
+/* Splits TCP frame 'data' of 'len' bytes into segments of 'vh' gso_size
+ * and calls 'cb' for each of them in order.
+ *
+ * Segmentation is done in place: headers of every segment are written
+ * just before its payload over the tail of previous segment, which has
+ * already been passed to 'cb'. So payload is never copied.
+ * Returns 0 on success. */
+int
+ops_fpa_gso_segment(uint8_t *data, uint32_t len,
+                    const struct virtio_net_hdr *vh,
+                    ops_fpa_gso_cb cb, void *aux)
+{
+    uint8_t hdr[OPS_FPA_GSO_MAX_HDR_LEN];
+    struct offload_tcp t;
+    uint32_t mss = vh->gso_size;
+    uint32_t off, seg_len, seq, n_segs;
+    uint16_t ip_id = 0;
+    uint8_t flags;
+    bool ipv6;
+
+    switch (vh->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+        case VIRTIO_NET_HDR_GSO_TCPV4: ipv6 = false; break;
+        case VIRTIO_NET_HDR_GSO_TCPV6: ipv6 = true; break;
+        default: return EOPNOTSUPP;
+    }
+
+    if (offload_parse_tcp(data, len, &t) || t.ipv6 != ipv6 || !mss
+        || t.hdr_len > sizeof hdr || t.hdr_len == len) {
+        return EINVAL;
+    }
+
+    memcpy(hdr, data, t.hdr_len);
+    seq = get_be32(hdr + t.l4_off + 4);
+    flags = hdr[t.l4_off + 13];
+    if (!ipv6) {
+        ip_id = get_be16(hdr + t.l3_off + 4);
+    }
+
+    for (off = t.hdr_len, n_segs = 0; off < len; off += seg_len, n_segs++) {
+        uint8_t *seg = data + off - t.hdr_len;
+        uint8_t *ip = seg + t.l3_off;
+        uint8_t *tcp = seg + t.l4_off;
+        uint32_t tcp_len, partial;
+        uint8_t seg_flags = flags;
+
+        seg_len = MIN(mss, len - off);
+        tcp_len = t.hdr_len - t.l4_off + seg_len;
+
+        memcpy(seg, hdr, t.hdr_len);
+
+        /* CWR only on the first and FIN, PSH only on the last segment */
+        if (n_segs) {
+            seg_flags &= ~OPS_FPA_TCP_CWR;
+        }
+        if (off + seg_len < len) {
+            seg_flags &= ~(OPS_FPA_TCP_FIN | OPS_FPA_TCP_PSH);
+        }
+        tcp[13] = seg_flags;
+        put_be32(tcp + 4, seq + (off - t.hdr_len));
+
+        if (ipv6) {
+            put_be16(ip + 4, tcp_len);
+            partial = offload_pseudo6(ip, tcp_len);
+        } else {
+            put_be16(ip + 2, t.l4_off - t.l3_off + tcp_len);
+            put_be16(ip + 4, ip_id + n_segs);
+            put_be16(ip + 10, 0);
+            put_csum(ip + 10, csum(ip, t.l4_off - t.l3_off));
+            partial = offload_pseudo4(ip, tcp_len);
+        }
+
+        put_be16(tcp + 16, 0);
+        put_csum(tcp + 16, csum_finish(csum_continue(partial, tcp, tcp_len)));
+
+        cb(aux, seg, t.hdr_len + seg_len);
+    }
+
+    return 0;
+}
+
+void
+ops_fpa_gro_init(struct ops_fpa_gro *gro, ops_fpa_gro_cb cb, void *aux)
+{
+    memset(gro, 0, sizeof *gro);
+    gro->cb = cb;
+    gro->aux = aux;
+    gro->buf = xmalloc(OPS_FPA_GSO_MAX_LEN);
+}
+
+void
+ops_fpa_gro_destroy(struct ops_fpa_gro *gro)
+{
+    free(gro->buf);
+}
+
+/* Returns true if 'data' is untagged TCP/IPv4 segment with payload which
+ * may be coalesced. Checksums are verified, since kernel recomputes TCP
+ * checksum of coalesced frame and would hide corrupted segment. */
+static bool
+gro_candidate(const uint8_t *data, uint32_t len, struct offload_tcp *t)
+{
+    const uint8_t *ip = data + OPS_FPA_ETH_HDR_LEN;
+    uint32_t tcp_len;
+
+    if (offload_parse_tcp(data, len, t) || t->ipv6
+        || t->l3_off != OPS_FPA_ETH_HDR_LEN) {
+        return false;
+    }
+
+    /* No IP options, fragments or L2 padding */
+    if ((ip[0] & 0x0f) * 4 != OPS_FPA_IPV4_HDR_LEN
+        || (get_be16(ip + 6) & 0x3fff)
+        || get_be16(ip + 2) != len - OPS_FPA_ETH_HDR_LEN) {
+        return false;
+    }
+
+    /* Plain data segment */
+    if ((data[t->l4_off + 13] & ~OPS_FPA_TCP_PSH) != OPS_FPA_TCP_ACK
+        || len <= t->hdr_len) {
+        return false;
+    }
+
+    /* Segment with bad checksum is delivered as is, kernel drops it */
+    tcp_len = len - t->l4_off;
+    return !csum(ip, OPS_FPA_IPV4_HDR_LEN)
+           && !csum_finish(csum_continue(offload_pseudo4(ip, tcp_len),
+                                         data + t->l4_off, tcp_len));
+}
+
+/* Returns true if segment continues pending frame of 'gro' */
+static bool
+gro_match(const struct ops_fpa_gro *gro, const void *owner,
+          const uint8_t *data, uint32_t len, const struct offload_tcp *t)
+{
+    const uint8_t *ip = data + t->l3_off;
+    const uint8_t *tcp = data + t->l4_off;
+    const uint8_t *pip = gro->buf + t->l3_off;
+    const uint8_t *ptcp = gro->buf + t->l4_off;
+
+    return gro->owner == owner
+           && gro->hdr_len == t->hdr_len
+           && !memcmp(data, gro->buf, 2 * ETH_ALEN)
+           && ip[1] == pip[1] && ip[8] == pip[8]    /* TOS and TTL */
+           && !memcmp(ip + 12, pip + 12, 8)         /* Addresses */
+           && !memcmp(tcp, ptcp, 4)                 /* Ports */
+           && get_be32(tcp + 4) == gro->next_seq
+           && !memcmp(tcp + 8, ptcp + 8, 4)         /* Ack */
+           && !memcmp(tcp + 14, ptcp + 14, 2)       /* Window */
+           && !memcmp(tcp + OPS_FPA_TCP_HDR_LEN, ptcp + OPS_FPA_TCP_HDR_LEN,
+                      t->hdr_len - t->l4_off - OPS_FPA_TCP_HDR_LEN)
+           && len - t->hdr_len <= gro->mss
+           && gro->len + len - t->hdr_len <= OPS_FPA_ETH_HDR_LEN + UINT16_MAX;
+}
+
+/* Coalesces TCP segment 'data' destined to 'owner' with pending frame.
+ * Returns false if the packet can't be coalesced, caller must send it
+ * as is. Pending frame is flushed in that case to keep order. */
+bool
+ops_fpa_gro_add(struct ops_fpa_gro *gro, void *owner,
+                const uint8_t *data, uint32_t len)
+{
+    struct offload_tcp t;
+    uint32_t payload;
+    uint8_t flags;
+
+    if (!gro_candidate(data, len, &t)) {
+        ops_fpa_gro_flush(gro);
+        return false;
+    }
+
+    payload = len - t.hdr_len;
+    flags = data[t.l4_off + 13];
+
+    if (gro->owner && gro_match(gro, owner, data, len, &t)) {
+        memcpy(gro->buf + gro->len, data + t.hdr_len, payload);
+        gro->buf[t.l4_off + 13] |= flags & OPS_FPA_TCP_PSH;
+        gro->len += payload;
+        gro->next_seq += payload;
+        gro->n_segs++;
+    } else {
+        ops_fpa_gro_flush(gro);
+        memcpy(gro->buf, data, len);
+        gro->owner = owner;
+        gro->len = len;
+        gro->hdr_len = t.hdr_len;
+        gro->mss = payload;
+        gro->next_seq = get_be32(data + t.l4_off + 4) + payload;
+        gro->n_segs = 1;
+    }
+
+    /* Pushed or short segment ends the frame */
+    if ((flags & OPS_FPA_TCP_PSH) || payload < gro->mss) {
+        ops_fpa_gro_flush(gro);
+    }
+
+    return true;
+}
+
+/* Passes pending frame, if any, to callback */
+void
+ops_fpa_gro_flush(struct ops_fpa_gro *gro)
+{
+    struct virtio_net_hdr vh;
+
+    if (!gro->owner) {
+        return;
+    }
+
+    memset(&vh, 0, sizeof vh);
+    if (gro->n_segs > 1) {
+        uint32_t l4_off = OPS_FPA_ETH_HDR_LEN + OPS_FPA_IPV4_HDR_LEN;
+        uint8_t *ip = gro->buf + OPS_FPA_ETH_HDR_LEN;
+        uint8_t *tcp = gro->buf + l4_off;
+
+        put_be16(ip + 2, gro->len - OPS_FPA_ETH_HDR_LEN);
+        put_be16(ip + 10, 0);
+        put_csum(ip + 10, csum(ip, OPS_FPA_IPV4_HDR_LEN));
+
+        /* Kernel completes checksum, field holds pseudo header sum */
+        put_csum(tcp + 16, ~csum_finish(offload_pseudo4(ip, gro->len - l4_off)));
+
+        vh.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        vh.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+        vh.gso_size = gro->mss;
+        vh.hdr_len = gro->hdr_len;
+        vh.csum_start = l4_off;
+        vh.csum_offset = 16;
+    }
+
+    gro->cb(gro->aux, gro->owner, &vh, gro->buf, gro->len, gro->n_segs);
+    gro->owner = NULL;
+}
@@ -214,6 +214,7 @@ ops_fpa_ofproto_run(struct ofproto *up)
     }
 
     if (STR_EQ(up->type, "system") && STR_EQ(up->name, DEFAULT_BRIDGE_NAME)) {
+        ops_fpa_mac_learning_run(this->dev->ml);
         if (timer_expired(&this->dev->ml->mlearn_timer)) {
             ops_fpa_mac_learning_on_mlearn_timer_expired(this->dev->ml);
         }
@@ -225,6 +226,11 @@ ops_fpa_ofproto_run(struct ofproto *up)
 static void
 ops_fpa_ofproto_wait(struct ofproto *up)
 {
+    struct fpa_ofproto *this = FPA_OFPROTO(up);
+
+    if (STR_EQ(up->type, "system") && STR_EQ(up->name, DEFAULT_BRIDGE_NAME)) {
+        ops_fpa_mac_learning_wait(this->dev->ml);
+    }
 }
 
 static void
@@ -289,6 +295,9 @@ static void
 ops_fpa_ofproto_port_destruct(struct ofport *up)
 {
     FPA_TRACE_FN();
+
+    struct fpa_ofproto *this = FPA_OFPROTO(up->ofproto);
+    ops_fpa_vlan_port_remove(this->switch_id, netdev_get_ifindex(up->netdev));
 }
 
 static void
@@ -882,6 +891,11 @@ ops_fpa_ofproto_set_vlan(struct ofproto *up, int vid, bool add)
     /* update ofproto vlans state bitmap */
     bitmap_set(this->vlans, vid, add);
 
+    /* Addresses learned in removed VLAN are stale */
+    if (!add && this->dev->ml) {
+        ops_fpa_mac_learning_vlan_removed(this->dev->ml, vid);
+    }
+
     return 0;
 }
 
@@ -994,12 +1008,10 @@ add_l3_host_entry(const struct ofproto *up, void *aux,
         FPA_MAC_ADDRESS_STC mac;
         memcpy(&mac, &dst_mac_addr, sizeof mac);
 
-        ovs_rwlock_rdlock(&dev->ml->rwlock);
         struct fpa_mac_entry *mac_entry =
             ops_fpa_mac_learning_lookup_by_vlan_and_mac(dev->ml, vlan_id, mac);
-        ovs_rwlock_unlock(&dev->ml->rwlock);
 
-        *l3_egress_id = mac_entry->fdb_entry.portNum;
+        *l3_egress_id = mac_entry->portNum;
     }
     VLOG_INFO("    l3_egress_id = %d", *l3_egress_id);
 
@@ -1426,9 +1438,31 @@ fpa_unixctl_fdb_show(struct unixctl_conn *conn, int argc OVS_UNUSED,
     ovs_assert(ofproto->dev);
     ovs_assert(ofproto->dev->ml);
 
-    ovs_rwlock_rdlock(&ofproto->dev->ml->rwlock);
     ops_fpa_mac_learning_dump_table(ofproto->dev->ml, &d_str);
-    ovs_rwlock_unlock(&ofproto->dev->ml->rwlock);
+
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
+
+static void
+fpa_unixctl_fdb_stats(struct unixctl_conn *conn, int argc,
+                      const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    struct fpa_ofproto *ofproto;
+
+    if (argc > 1) {
+        ofproto = ops_fpa_ofproto_lookup(argv[1]);
+        if (!ofproto) {
+            unixctl_command_reply_error(conn, "no such bridge");
+            return;
+        }
+        ops_fpa_mac_learning_dump_stats(ofproto->dev->ml, &d_str);
+    } else {
+        HMAP_FOR_EACH (ofproto, node, &protos) {
+            ops_fpa_mac_learning_dump_stats(ofproto->dev->ml, &d_str);
+        }
+    }
 
     unixctl_command_reply(conn, ds_cstr(&d_str));
     ds_destroy(&d_str);
@@ -1505,6 +1539,8 @@ ops_fpa_ofproto_unixctl_init(void)
                             fpa_unixctl_fdb_flush, NULL);
     unixctl_command_register("fpa/fdb/show", "bridge", 1, 1,
                             fpa_unixctl_fdb_show, NULL);
+    unixctl_command_register("fpa/fdb/stats", "[bridge]", 0, 1,
+                            fpa_unixctl_fdb_stats, NULL);
     unixctl_command_register("fpa/fdb/get-age", "bridge",
                              1, 1, fpa_unixctl_fdb_get_aging, NULL);
     unixctl_command_register("fpa/fdb/set-age", "bridge aging_time",
@@ -23,32 +23,91 @@
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sched.h>
 #include <linux/if_tun.h>
 #include <netinet/ether.h>
+#ifdef HAVE_LIBURING
+#include <poll.h>
+#include <liburing.h>
+#endif
 #include <openswitch-idl.h>
 
 #include <ofp-parse.h>
 #include <socket-util.h>
 #include <hmap.h>
+#include <list.h>
+#include <hash.h>
+#include <dynamic-string.h>
+#include <ovs-rcu.h>
 
 #include "ops-fpa-util.h"
 #include "ops-fpa-dev.h"
 #include "ops-fpa-tap.h"
 #include "ops-fpa-vlan.h"
+#include "ops-fpa-offload.h"
+#include "ops-fpa-bpf.h"
+#include "ops-fpa-mac-learning.h"
+#include "ops-fpa-capture.h"
 
 #define FPA_HAL_MAX_MTU_CNS     10240
 
-#define OPS_FPA_THREAD_TAP          0
-#define OPS_FPA_THREAD_ASIC         1
-#define OPS_FPA_THREAD_CNT          2
+#define FPA_PKT_SAFEGUARD   32 /* offset due to bug in FPA */
+#define VNET_HDR_LEN        sizeof(struct virtio_net_hdr)
+#define DOT1Q_LEN           4  /* size of 802.1q header */
+
+#define OPS_FPA_TAP_OFFLOADS        (TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6) /* Requested from TAP interfaces */
+
+#define OPS_FPA_TAP_WORKERS_DFLT    4   /* Max default number of TAP workers */
+#define OPS_FPA_TAP_WORKERS_MAX     8
+
+#define OPS_FPA_TAP_MAX_EVENTS      64 /* Max TAP events handled per wakeup */
+#define OPS_FPA_TAP_READ_BUDGET     64 /* Max frames read from one TAP interface per round */
+#define OPS_FPA_TAP_DRAIN_TIME      5  /* Seconds packets from TAP interfaces are drained at startup */
+
+#define OPS_FPA_URING_ENTRIES       256 /* io_uring submission queue size */
+#define OPS_FPA_URING_RX_BUFS       32  /* Provided receive buffers per worker, power of 2 */
+#define OPS_FPA_URING_BGID          0   /* Buffer group of provided receive buffers */
+
+#define OPS_FPA_SVI_FLOOD_MAX       128 /* Max ports frame from SVI TAP interface is flooded to */
+#define TAP_SVI_PORT                FPA_INVALID_INTF_ID /* HW port number of SVI TAP interface */
+
+#define OPS_FPA_RX_BURST            32  /* Max packets received from ASIC per wakeup */
+#define OPS_FPA_RX_RING_SIZE        128 /* Worker ring size, power of 2, not less than sum of class depths */
+#define OPS_FPA_RX_DEPTH_HIGH       32  /* Max packets queued to worker per priority class */
+#define OPS_FPA_RX_DEPTH_NORMAL     64
+#define OPS_FPA_RX_DEPTH_LOW        32
+#define OPS_FPA_RX_DEPTH_TOTAL      (OPS_FPA_RX_DEPTH_HIGH + OPS_FPA_RX_DEPTH_NORMAL + OPS_FPA_RX_DEPTH_LOW)
+#define OPS_FPA_TAP_DELIVER_BUDGET  64  /* Max packets delivered to TAPs per worker wakeup */
+#define OPS_FPA_TAP_TXQ_LEN         16  /* Packets queued per TAP interface which is not writable */
+#define OPS_FPA_TAP_TXQ_WORKER_MAX  64  /* Packets queued to all TAP interfaces of a worker */
+#define OPS_FPA_RX_TIMEOUT          10000 /* Timeout (in ms) to wait for first packet of burst */
+#define OPS_FPA_RX_NOWAIT           0   /* Timeout for the rest of the burst */
+#define OPS_FPA_RX_POLL_QUIESCE     64   /* Busy-polls between RCU quiescent states */
 
-#define OPS_FPA_THREAD_PIPE_RECV    0 /* Pipe witch use for recv command into thread listener */
-#define OPS_FPA_THREAD_PIPE_SEND    1 /* Pipe witch use for send command to thread listener */
+#define OPS_FPA_LAT_BUCKETS         24  /* Log2 microsecond buckets of CPU path latency histogram */
 
-#define OPS_FPA_PRINT_10_BYTES_FMT \
-    "0x%02"PRIx8" 0x%02"PRIx8" 0x%02"PRIx8" 0x%02"PRIx8"  0x%02"PRIx8" 0x%02"PRIx8" 0x%02"PRIx8" 0x%02"PRIx8"  0x%02"PRIx8" 0x%02"PRIx8
-#define OPS_FPA_PRINT_10_BYTES_ARGS(EAB) \
-    (EAB)[0], (EAB)[1], (EAB)[2], (EAB)[3], (EAB)[4], (EAB)[5], (EAB)[6], (EAB)[7], (EAB)[8], (EAB)[9]
+#define OPS_FPA_PBUF_SIZE           ROUND_UP(FPA_HAL_MAX_MTU_CNS, CACHE_LINE_SIZE)
+#define OPS_FPA_PBUF_CACHE_SIZE     64  /* Free packet buffers cached per thread */
+#define OPS_FPA_PBUF_CACHE_BATCH    32  /* Buffers moved between thread cache and pool at once */
+#define OPS_FPA_HUGEPAGE_SIZE       (2 * 1024 * 1024)
+
+#define OPS_FPA_CNT_MAX_PORTS       128 /* Ports with own CPU counters, the rest share one slot */
+#define OPS_FPA_CNT_MAX_REASONS     16  /* Trap reasons with own CPU counters, the rest share one slot */
+
+#define OPS_FPA_ETH_TYPE_SLOW       0x8809 /* LACP, Marker, OAM */
+#define OPS_FPA_ETH_TYPE_LLDP       0x88cc
+#define OPS_FPA_IPPROTO_OSPF        89
+#define OPS_FPA_IPPROTO_VRRP        112
+#define OPS_FPA_TCP_PORT_BGP        179
+#define OPS_FPA_UDP_PORT_BFD        3784
+#define OPS_FPA_UDP_PORT_BFD_ECHO   3785
+
+#define OPS_FPA_TRACE_RING_SIZE     1024 /* Trace records per thread, power of 2 */
+#define OPS_FPA_TRACE_DATA_LEN      32   /* Packet bytes saved in trace record */
 
 VLOG_DEFINE_THIS_MODULE(ops_fpa_tap);
 
@@ -60,925 +119,4097 @@ struct tap_if_entry {
     /* TAP interface name */
     char *name;
 
-    union {
-        /* FD of TAP interface */
-        int fd;
+    /* FD of TAP interface */
+    int fd;
 
-        /* HW port number */
-        uint32_t portNum;
-    };
+    /* HW port number */
+    uint32_t portNum;
 
     /* TAP MAC address. */
     struct ether_addr mac; /*TODO remove when TAP MAC will be obtained from netlink socket */
 
-    /* Node in map */
+    /* Node in FD map */
     struct hmap_node node;
-};
 
-/* Linux tun/tap interface information for switch once */
-struct tap_info {
+    /* Node in HW port map of TAP worker */
+    struct hmap_node port_node;
 
-    /* FPA device ID */
-    uint32_t switchId;
+    /* Being removed, io_uring read must not be rearmed */
+    bool closing;
 
-    /* FD to TAP interface entry map */
-    struct hmap fd_to_tap_if_map;
+    /* Node in ready list of TAP worker, valid if 'rx_ready' is set.
+     * Interface stays there until its frames are all read. */
+    struct ovs_list ready_node;
+    bool rx_ready;
+
+    /* Packets waiting until the interface is writable again, oldest
+     * first */
+    struct tap_pbuf *txq[OPS_FPA_TAP_TXQ_LEN];
+    uint32_t txq_head;
+    uint32_t txq_len;
+};
 
-    /* Threads */
-    pthread_t thread[OPS_FPA_THREAD_CNT];
+struct ctrl_queue;
 
-    /* Pipe which will notify thread about new/delete interface */
-    int ctrl_fds[OPS_FPA_THREAD_CNT][2];
+/* Packet direction */
+enum tap_dir {
+    TAP_DIR_TAP_TO_ASIC,
+    TAP_DIR_ASIC_TO_TAP,
+    TAP_DIR_CNT
 };
-/****************************************************************************/
 
-typedef void * (*main_thread_func)(void *);
+/* Priority class of packet received from ASIC, highest first */
+enum tap_prio {
+    TAP_PRIO_HIGH,      /* L2 and routing protocol PDUs */
+    TAP_PRIO_NORMAL,    /* Unicast traffic to host */
+    TAP_PRIO_LOW,       /* Broadcast, multicast and unresolved route traps */
+    TAP_PRIO_CNT
+};
+
+static const char *tap_prio_name[TAP_PRIO_CNT] = { "high", "normal", "low" };
 
-struct listener_info {
-    const char *name;
-    main_thread_func main_func;
+/* Max packets queued to worker and not yet delivered per class */
+static const uint32_t tap_prio_depth[TAP_PRIO_CNT] = {
+    OPS_FPA_RX_DEPTH_HIGH, OPS_FPA_RX_DEPTH_NORMAL, OPS_FPA_RX_DEPTH_LOW
 };
 
-void *tap_listener(void *arg);
-void *asic_listener(void *arg);
+/* Packets delivered per class in turn in weighted scheduling mode */
+static const uint32_t tap_prio_weight[TAP_PRIO_CNT] = { 8, 4, 1 };
+
+/* ASIC listener statistics, updated by ASIC listener only */
+struct tap_stats {
+    atomic_uint64_t rx_packets;     /* Packets received from ASIC */
+    atomic_uint64_t rx_bursts;      /* Non-empty receive bursts */
+    atomic_uint64_t rx_class_packets[TAP_PRIO_CNT]; /* Dispatched to workers */
+    atomic_uint64_t rx_class_drops[TAP_PRIO_CNT];   /* Dropped: class depth reached */
+    atomic_uint64_t rx_polls;       /* Busy-polls which found no packet */
+    atomic_uint64_t rx_poll_starts; /* Switches from blocking receive to busy-poll */
+    atomic_bool rx_polling;         /* Listener busy-polls now */
+};
 
-struct listener_info listener[OPS_FPA_THREAD_CNT] = {
-    {"tap-listener", tap_listener},
-    {"asic-listener", asic_listener}
+/* TAP worker statistics.
+ * Ring occupancy is updated by ASIC listener, the rest by the worker. */
+struct tap_worker_stats {
+    atomic_uint64_t rx_no_if;       /* Dropped: no TAP interface for port */
+    atomic_uint64_t rx_runts;       /* Dropped: frame from ASIC shorter than Ethernet header */
+    atomic_uint64_t tx_packets;     /* Packets written to TAP interfaces */
+    atomic_uint64_t tx_errors;      /* Dropped: TAP write failed */
+    atomic_uint64_t gso_frames;     /* TSO frames read from TAP interfaces */
+    atomic_uint64_t gso_segments;   /* Segments they were split into */
+    atomic_uint64_t gso_errors;     /* Dropped: invalid vnet header */
+    atomic_uint64_t gro_frames;     /* Coalesced frames written to TAP interfaces */
+    atomic_uint64_t gro_segments;   /* Packets they were made of */
+    atomic_uint64_t svi_tx;         /* Packets written to SVI TAP interface */
+    atomic_uint64_t svi_unicast;    /* Frames from SVI TAP sent to learned port */
+    atomic_uint64_t svi_flood;      /* Frames from SVI TAP flooded to VLAN */
+    atomic_uint64_t svi_flood_cut;  /* Of them not sent to all VLAN members */
+    atomic_uint64_t txq_queued;     /* Packets queued after TAP write returned EAGAIN */
+    atomic_uint64_t txq_drops;      /* Dropped: TAP transmit queue full */
+    atomic_uint32_t txq_depth;      /* Packets currently queued to TAP interfaces */
+    atomic_uint32_t txq_max;        /* Single TAP queue depth high-water mark */
+    atomic_uint32_t txq_port_depth[OPS_FPA_CNT_MAX_PORTS + 1]; /* Per port, the last slot is shared */
+    atomic_uint64_t latency[OPS_FPA_LAT_BUCKETS]; /* ASIC receive to TAP write, see tap_latency_bucket() */
+    atomic_uint32_t ring_used;      /* Current receive ring occupancy */
+    atomic_uint32_t ring_max;       /* Receive ring occupancy high-water mark */
+    atomic_uint64_t io_wakeups;     /* epoll_wait() returns with events */
+    atomic_uint64_t io_submits;     /* io_uring submissions */
+    atomic_bool io_uring;           /* io_uring backend is used */
 };
 
-/****************************************************************************
-* Commands for notify thread about new/delete interface and thread exit
-****************************************************************************/
+/* CPU packet counters.
+ * 'drops' counts every dropped packet except those drained at startup,
+ * 'eagain' is the part of 'drops' caused by full TAP transmit queue,
+ * 'queued' counts packets which waited in it for TAP to become writable. */
+struct tap_pkt_counters {
+    atomic_uint64_t packets;
+    atomic_uint64_t bytes;
+    atomic_uint64_t drops;
+    atomic_uint64_t eagain;
+    atomic_uint64_t queued;
+    atomic_uint64_t drained;
+};
 
-typedef enum {
-    OPS_FPA_CMD_THREAD_EXIT,
-    OPS_FPA_CMD_ADD_IF,
-    OPS_FPA_CMD_DEL_IF,
-    OPS_FPA_CMD_CNT
-} ops_fpa_cmd_type;
+enum tap_cnt_type {
+    TAP_CNT_FORWARDED,
+    TAP_CNT_DROP,
+    TAP_CNT_EAGAIN,
+    TAP_CNT_QUEUED,
+    TAP_CNT_DRAINED
+};
 
-struct ctrl_cmd {
+/* Counters of single direction owned by single thread.
+ * Allocated on own cache lines so threads never share them. */
+struct tap_thread_counters {
+    /* Last port and reason slot accounts everything out of range */
+    struct tap_pkt_counters port[OPS_FPA_CNT_MAX_PORTS + 1][OPS_FPA_CNT_MAX_REASONS + 1];
+    struct tap_pkt_counters vlan[VLAN_BITMAP_SIZE];
+};
 
-    ops_fpa_cmd_type type;
+/* What happened to traced packet */
+enum tap_trace_verdict {
+    TAP_TRACE_FORWARDED,
+    TAP_TRACE_DROP_VLAN,    /* Port is not egress member of packet VLAN,
+                             * or SVI frame has no VLAN members */
+    TAP_TRACE_DROP_SMAC,    /* Foreign source MAC from bridge_normal */
+    TAP_TRACE_DROP_NO_IF,   /* No TAP interface for ingress port */
+    TAP_TRACE_DROP_ERROR,   /* FPA send or TAP write failed */
+    TAP_TRACE_DROP_RING     /* Worker priority class queue full */
+};
 
-    union {
-        struct {
-            /* TAP interface name */
-            char tap_if_name[IFNAMSIZ];
+/* Binary packet trace record. Formatted to text only on dump. */
+struct tap_trace_rec {
+    uint64_t time_ns;       /* CLOCK_MONOTONIC timestamp */
+    uint32_t port;
+    uint32_t reason;
+    uint32_t tableId;
+    uint16_t vid;
+    uint16_t len;           /* Packet length */
+    uint8_t dir;            /* enum tap_dir */
+    uint8_t verdict;        /* enum tap_trace_verdict */
+    uint8_t data_len;       /* Saved bytes in 'data' */
+    uint8_t data[OPS_FPA_TRACE_DATA_LEN];
+};
 
-            /* FD of TAP interface */
-            int fd;
+/* Packet trace ring of one thread.
+ * Written only by owner thread, oldest records are overwritten. */
+struct tap_trace_ring {
+    atomic_uint64_t head;   /* Number of records ever written */
+    struct tap_trace_rec rec[OPS_FPA_TRACE_RING_SIZE];
+};
 
-            /* HW port number */
-            uint32_t portNum;
+/* Packet buffer with its descriptor. Buffers are passed between CPU path
+ * threads without copying, every holder owns a reference and the last one
+ * returns buffer to its thread cache. */
+struct tap_pbuf {
+    char *buf;
+    struct ovs_refcount ref_cnt;
+
+    /* Packet received from ASIC and waiting for delivery */
+    FPA_PACKET_BUFFER_STC pkt;
+    enum tap_prio prio;
+    uint64_t rx_ns;             /* CLOCK_MONOTONIC time of receive */
+
+    /* Write to TAP interface, kept until it completes */
+    struct iovec iov[4];
+    uint16_t tag[2];
+    int iovcnt;
+    uint32_t len;
+    struct tap_if_entry *tx_if; /* NULL if written to SVI TAP interface */
+};
 
-            /* TAP MAC address. */
-            struct ether_addr mac; /*TODO remove when TAP MAC will be obtained from netlink socket */
-        } add;
-        struct {
-            /* FD of TAP interface */
-            int fd;
+/* Preallocated cache line aligned packet buffers shared by all CPU path
+ * threads. Threads allocate and free buffers through own caches, the pool
+ * is locked only to move a batch of buffers between cache and pool. */
+struct tap_pbuf_pool {
+    char *mem;
+    size_t mem_size;
+    bool hugepages;             /* 'mem' is mapped from hugepages */
+    struct tap_pbuf *descs;
+    size_t size;
+
+    struct ovs_mutex mutex;
+    struct tap_pbuf **free_descs OVS_GUARDED;
+    size_t n_free OVS_GUARDED;
+
+    atomic_uint64_t refills;    /* Batches taken by thread caches */
+    atomic_uint64_t flushes;    /* Batches returned by thread caches */
+};
 
-            /* HW port number */
-            uint32_t portNum;
-        } del;
-    };
+/* Free packet buffers of one thread */
+struct tap_pbuf_cache {
+    struct tap_pbuf_pool *pool;
+    size_t n;
+    struct tap_pbuf *descs[OPS_FPA_PBUF_CACHE_SIZE];
 };
 
-int send_ctrl_cmd(int fd, const struct ctrl_cmd *cmd);
-int recv_ctrl_cmd(int fd, struct ctrl_cmd *cmd);
+/* Single producer single consumer ring of packet descriptors */
+struct tap_spsc_ring {
+    atomic_uint32_t head;   /* Next slot to fill, producer side */
+    uint8_t pad0[CACHE_LINE_SIZE - sizeof(atomic_uint32_t)];
+    atomic_uint32_t tail;   /* Next slot to take, consumer side */
+    uint8_t pad1[CACHE_LINE_SIZE - sizeof(atomic_uint32_t)];
+    struct tap_pbuf *desc[OPS_FPA_RX_RING_SIZE];
+};
 
-int send_ctrl_cmd(int fd, const struct ctrl_cmd *cmd)
-{
-    ovs_assert(fd >= 0);
-    ovs_assert(cmd);
+/* TAP worker thread. Owns TAP interfaces of HW ports sharded to it and
+ * handles their packets in both directions, so per-port order is kept. */
+struct tap_worker {
 
-    /* TODO: Need processing return value from call 'write' */
-    ignore(write(fd, cmd, sizeof(struct ctrl_cmd)));
+    /* Parent TAP info */
+    struct tap_info *info;
 
-    return 0;
-}
+    /* Worker index, HW port 'portNum' belongs to worker portNum % n_workers */
+    int id;
 
-int recv_ctrl_cmd(int fd, struct ctrl_cmd *cmd)
-{
-    int size;
+    pthread_t thread;
 
-    ovs_assert(fd >= 0);
-    ovs_assert(cmd);
+    /* Queue which notifies worker about new/delete interface and exit */
+    struct ctrl_queue *ctrl;
 
-    size = read(fd, cmd, sizeof(struct ctrl_cmd));
+    /* Packets received from ASIC by ASIC listener, per priority class */
+    struct tap_spsc_ring *rx_ring[TAP_PRIO_CNT];
 
-    return size;
-}
-/****************************************************************************/
+    /* Wakeup eventfd of 'rx_ring' */
+    int rx_efd;
 
-struct tap_if_entry *get_if_entry(const struct hmap *map, int key);
+    /* epoll instance of the worker */
+    int epoll_fd;
 
-extern bool
-ops_fpa_is_internal_vlan(int vid);
+    /* Packets queued to all TAP interfaces of the worker */
+    uint32_t txq_total;
 
-int ops_fpa_net_if_setup(const char *name, const struct ether_addr *mac);
-int ops_fpa_tun_alloc(char *name, int flags);
+    /* Packets given to worker and not yet delivered, per class.
+     * Incremented by ASIC listener, decremented by the worker. */
+    atomic_uint32_t class_outstanding[TAP_PRIO_CNT];
 
-int get_port_eg_tag_state(uint32_t switchId, uint32_t portNum, uint16_t vlanId, bool *pop_tag);
+    /* Free packet buffers of the worker */
+    struct tap_pbuf_cache cache;
 
-uint16_t
-ops_fpa_get_eth_type(void *pkt)
-{
-    return ntohs(((struct ether_header *)pkt)->ether_type);
-}
+    /* Weighted scheduler state: class in turn and its remaining packets */
+    enum tap_prio wrr_class;
+    uint32_t wrr_credit;
 
-struct tap_info *
-ops_fpa_tap_init(uint32_t switchId)
-{
-    int i, n, rc;
-    struct tap_info *info;
+    /* Coalescing of packets written to TAP interfaces. Packets of pending
+     * coalesced frames are kept until the frame is written, oldest first,
+     * there are no more of them than are delivered per wakeup. */
+    struct ops_fpa_gro gro;
+    struct tap_pbuf *gro_descs[OPS_FPA_TAP_DELIVER_BUDGET];
+    uint32_t gro_n;
 
-    ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
+    /* io_uring backend, NULL if TAP interfaces are polled by epoll */
+    struct tap_uring *uring;
 
-    VLOG_INFO("TAP interface init for FPA device (%d)", switchId);
+    /* Packets read from TAP interfaces are drained during
+     * OPS_FPA_TAP_DRAIN_TIME after the first one */
+    struct timeval drain_start;
+    bool drain_started;
 
-    info = get_tap_info_by_switch_id(switchId);
-    if (info) {
-        VLOG_ERR("TAP interfaces for FPA device (%d) already exist", switchId);
-        return info;
-    }
+    struct tap_worker_stats stats;
 
-    /* Create TAP info for switch */
-    info = xzalloc(sizeof *info);
-    info->switchId = switchId;
+    /* Per port, trap reason and VLAN counters */
+    struct tap_thread_counters *counters[TAP_DIR_CNT];
 
-    hmap_init(&info->fd_to_tap_if_map);
+    /* Packet trace */
+    struct tap_trace_ring *trace;
+};
 
-    /* For all threads */
-    for (i = 0; i < OPS_FPA_THREAD_CNT; i++) {
+/* Linux tun/tap interface information for switch once */
+struct tap_info {
 
-        /* Create control pipes */
-        xpipe(info->ctrl_fds[i]);
+    /* FPA device ID */
+    uint32_t switchId;
 
-        /* Set a fds into nonblocking mode */
-        for (n = 0; n < 2; n++) {
-            rc = set_nonblocking(info->ctrl_fds[i][n]);
-            if (rc) {
-                VLOG_ERR("Unable to set control pipe %d into nonblocking mode", info->ctrl_fds[i][n]);
-                close(info->ctrl_fds[i][n]);
-                return NULL;
-            }
-        }
+    /* FDB of the switch, set before workers start */
+    struct fpa_mac_learning *ml;
 
-        /* Run thread */
-        info->thread[i] = ovs_thread_create(listener[i].name, listener[i].main_func, info);
-        VLOG_INFO("%s thread started", listener[i].name);
-    }
+    /* ASIC listener statistics */
+    struct tap_stats stats;
 
-    return info;
-}
+    /* ASIC listener counters of packets dropped before dispatch */
+    struct tap_thread_counters *counters;
 
-void
-ops_fpa_tap_deinit(uint32_t switchId)
-{
-    int i;
-    struct tap_if_entry *e;
-    struct tap_if_entry *next;
-    struct tap_info *info;
-    struct ctrl_cmd cmd = { .type = OPS_FPA_CMD_THREAD_EXIT };
+    /* Packet tracing */
+    atomic_bool trace_enabled;
+    struct tap_trace_ring *trace;
 
-    ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
+    /* Priority classes are served in weighted round robin order instead
+     * of strict priority */
+    atomic_bool sched_weighted;
 
-    info = get_tap_info_by_switch_id(switchId);
+    /* TAP workers use io_uring backend if supported */
+    bool use_uring;
 
-    if (!info) {
-        return;
-    }
+    /* TCP segments are coalesced before writing to TAP interfaces */
+    atomic_bool gro_enabled;
 
-    /* Remove TAP interfaces */
-    HMAP_FOR_EACH_SAFE(e, next, node, &info->fd_to_tap_if_map) {
-        ops_fpa_tap_if_delete(switchId, e->fd);
-    }
+    /* ASIC listener busy-polls while packets keep coming and blocks after
+     * no packet came for this many microseconds. 0 always blocks. */
+    atomic_uint32_t rx_poll_us;
 
-    hmap_destroy(&info->fd_to_tap_if_map);
+    /* CPU ASIC listener is bound to, -1 if not bound, and its CPU set
+     * before. Guarded by FPA device mutex. */
+    int rx_cpu;
+    cpu_set_t rx_cpus_dflt;
 
-    /* For all threads */
-    for (i = 0; i < OPS_FPA_THREAD_CNT; i++) {
+    /* Latency histogram at last clear, guarded by FPA device mutex */
+    uint64_t latency_base[OPS_FPA_LAT_BUCKETS];
 
-        /* Stop listener thread */
-        send_ctrl_cmd(info->ctrl_fds[i][OPS_FPA_THREAD_PIPE_SEND], &cmd);
-        xpthread_join(info->thread[i], NULL);
+    /* FD of SVI TAP interface, -1 if SVI traffic goes through port TAP
+     * interfaces. Workers read it outside of quiescent state, it is
+     * closed only after RCU grace period. */
+    atomic_int svi_fd;
 
-        close(info->ctrl_fds[i][OPS_FPA_THREAD_PIPE_RECV]);
-        close(info->ctrl_fds[i][OPS_FPA_THREAD_PIPE_SEND]);
-    }
+    /* VLANs with SVI, their traffic is written to SVI TAP interface */
+    atomic_uint64_t svi_vlans[VLAN_BITMAP_SIZE / 64];
 
-    free(info);
+    /* FD to TAP interface entry map */
+    struct hmap fd_to_tap_if_map;
 
-    VLOG_INFO("Host interface TAP-based instance deallocated");
-}
+    /* Packet buffers of all CPU path threads */
+    struct tap_pbuf_pool pool;
 
-int
-ops_fpa_bridge_create(const char *name, const struct ether_addr *mac)
-{
-    int rc;
+    /* Serializes packet sends of TAP workers, FPA does not document
+     * fpaLibPortPktSend() as thread safe */
+    struct ovs_mutex tx_mutex;
 
-    rc = ops_fpa_system("ip link add name %s type bridge", name);
-    if (rc) {
-        VLOG_WARN("Error executing ip for creating bridge '%s', rc=%d. Possibly bridge is already created",
-            name, rc);
+    /* ASIC listener thread, its control queue and buffer cache */
+    pthread_t thread;
+    struct ctrl_queue *ctrl;
+    struct tap_pbuf_cache cache;
+
+    /* TAP workers */
+    struct tap_worker *workers;
+    int n_workers;
+};
+/****************************************************************************/
+
+void *tap_worker_main(void *arg);
+void *asic_listener(void *arg);
+
+static void ops_fpa_tap_unixctl_init(void);
+
+/****************************************************************************
+* Packet buffer pool and rings between CPU path threads
+****************************************************************************/
+
+static void
+tap_pbuf_pool_init(struct tap_pbuf_pool *pool, size_t size, bool hugepages)
+{
+    size_t i;
+
+    /* Hugepages keep all buffers in a few TLB entries. Memory is mapped
+     * and faulted in at once, falls back to heap if none are reserved. */
+    pool->mem_size = size * OPS_FPA_PBUF_SIZE;
+    pool->hugepages = false;
+    if (hugepages) {
+        size_t len = ROUND_UP(pool->mem_size, OPS_FPA_HUGEPAGE_SIZE);
+        void *mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                         -1, 0);
+
+        if (mem != MAP_FAILED) {
+            pool->mem = mem;
+            pool->mem_size = len;
+            pool->hugepages = true;
+        } else {
+            VLOG_WARN("Unable to map %"PRIuSIZE" bytes of hugepages for packet buffers, using heap. Error(%d) - %s",
+                      len, errno, strerror(errno));
+        }
+    }
+    if (!pool->hugepages) {
+        pool->mem = xmalloc_cacheline(pool->mem_size);
     }
 
-    if (0 != ops_fpa_net_if_setup(name, mac)) {
-        VLOG_ERR("Unable to setup bridge interface '%s'", name);
-        return EPERM;
+    pool->descs = xcalloc(size, sizeof *pool->descs);
+    pool->free_descs = xcalloc(size, sizeof *pool->free_descs);
+    for (i = 0; i < size; i++) {
+        pool->descs[i].buf = pool->mem + i * OPS_FPA_PBUF_SIZE;
+        pool->free_descs[i] = &pool->descs[i];
     }
+    pool->n_free = size;
+    pool->size = size;
+    ovs_mutex_init(&pool->mutex);
+    atomic_init(&pool->refills, 0);
+    atomic_init(&pool->flushes, 0);
+
+    VLOG_INFO("%"PRIuSIZE" packet buffers allocated from %s",
+              size, pool->hugepages ? "hugepages" : "heap");
+}
 
-    rc = ops_fpa_system("ip link set %s up", name);
-    if (rc) {
-        VLOG_ERR("Error setting bridge '%s' up, rc=%d", name, rc);
-        return EPERM;
+/* Frees pool memory. Buffers still held by anybody are released too. */
+static void
+tap_pbuf_pool_destroy(struct tap_pbuf_pool *pool)
+{
+    ovs_mutex_destroy(&pool->mutex);
+    free(pool->free_descs);
+    free(pool->descs);
+    if (pool->hugepages) {
+        munmap(pool->mem, pool->mem_size);
+    } else {
+        free_cacheline(pool->mem);
     }
+}
 
-    return 0;
+static void
+tap_pbuf_cache_init(struct tap_pbuf_cache *cache, struct tap_pbuf_pool *pool)
+{
+    cache->pool = pool;
+    cache->n = 0;
 }
 
-int
-ops_fpa_bridge_delete(const char *name)
+/* Returns buffers of 'cache' above 'keep' to the pool */
+static void
+tap_pbuf_cache_flush(struct tap_pbuf_cache *cache, size_t keep)
 {
-    int rc;
+    struct tap_pbuf_pool *pool = cache->pool;
+    uint64_t orig;
 
-    rc = ops_fpa_system("ip link delete %s type bridge", name);
-    if (rc) {
-        VLOG_ERR("Error deleting bridge '%s', rc=%d", name, rc);
-        return EFAULT;
+    if (cache->n <= keep) {
+        return;
     }
 
-    return 0;
+    ovs_mutex_lock(&pool->mutex);
+    while (cache->n > keep) {
+        ovs_assert(pool->n_free < pool->size);
+        pool->free_descs[pool->n_free++] = cache->descs[--cache->n];
+    }
+    ovs_mutex_unlock(&pool->mutex);
+
+    atomic_add_relaxed(&pool->flushes, 1, &orig);
 }
 
-int
-ops_fpa_bridge_port_add(const char *name)
+/* Takes up to a batch of buffers from the pool to empty 'cache' */
+static void
+tap_pbuf_cache_refill(struct tap_pbuf_cache *cache)
 {
-    int rc;
+    struct tap_pbuf_pool *pool = cache->pool;
+    uint64_t orig;
 
-    rc = ops_fpa_system("ip link set %s master %s", name, DEFAULT_BRIDGE_NAME);
-    if (rc) {
-        VLOG_ERR("Error adding TAP '%s' to bridge '%s' up, rc=%d", name, DEFAULT_BRIDGE_NAME, rc);
-        return EFAULT;
+    ovs_mutex_lock(&pool->mutex);
+    while (pool->n_free && cache->n < OPS_FPA_PBUF_CACHE_BATCH) {
+        cache->descs[cache->n++] = pool->free_descs[--pool->n_free];
     }
+    ovs_mutex_unlock(&pool->mutex);
 
-    return 0;
+    atomic_add_relaxed(&pool->refills, 1, &orig);
 }
 
-int
-ops_fpa_bridge_port_rm(const char *name)
+/* Allocates buffer with single reference from thread 'cache'.
+ * Returns NULL if all buffers are in use. */
+static inline struct tap_pbuf *
+tap_pbuf_alloc(struct tap_pbuf_cache *cache)
 {
-    int rc;
+    struct tap_pbuf *desc;
 
-    rc = ops_fpa_system("ip link set %s nomaster", name);
-    if (rc) {
-        VLOG_ERR("Error removing TAP '%s' from bridge, rc=%d", name, rc);
+    if (!cache->n) {
+        tap_pbuf_cache_refill(cache);
+        if (!cache->n) {
+            return NULL;
+        }
     }
 
-    return 0;
+    desc = cache->descs[--cache->n];
+    ovs_refcount_init(&desc->ref_cnt);
+
+    return desc;
 }
 
-int
-ops_fpa_tap_if_create(uint32_t switchId, uint32_t portNum, const char *name,
-                      const struct ether_addr *mac, int* tap_fd)
+static inline void
+tap_pbuf_ref(struct tap_pbuf *desc)
 {
-    int i, rc, fd;
-    char tap_if_name[IFNAMSIZ];
-    struct tap_info *info;
-    struct tap_if_entry *if_entry;
-    struct ctrl_cmd cmd;
-
-    ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
-    ovs_assert(name);
-    ovs_assert(mac);
-    ovs_assert(tap_fd);
+    ovs_refcount_ref(&desc->ref_cnt);
+}
 
-    ops_fpa_dev_mutex_lock();
-    info = get_tap_info_by_switch_id(switchId);
-    if (!info) {
-        VLOG_ERR("TAP interface not initialized for FPA device (%d)", switchId);
-        return EFAULT;
+/* Drops reference to 'desc', the last one returns buffer to 'cache' of
+ * calling thread */
+static inline void
+tap_pbuf_unref(struct tap_pbuf_cache *cache, struct tap_pbuf *desc)
+{
+    if (ovs_refcount_unref(&desc->ref_cnt) > 1) {
+        return;
     }
 
-    snprintf(tap_if_name, IFNAMSIZ, "%s", name);
-    fd = ops_fpa_tun_alloc(tap_if_name, (IFF_TAP | IFF_NO_PI));
-    if (fd <= 0) {
-        VLOG_ERR("Unable to create TAP interface '%s'", tap_if_name);
-        return EFAULT;
+    if (cache->n == OPS_FPA_PBUF_CACHE_SIZE) {
+        tap_pbuf_cache_flush(cache, OPS_FPA_PBUF_CACHE_SIZE - OPS_FPA_PBUF_CACHE_BATCH);
     }
+    cache->descs[cache->n++] = desc;
+}
 
-    rc = set_nonblocking(fd);
-    if (rc) {
-        VLOG_ERR("Unable to set TAP interface '%s' into nonblocking mode", tap_if_name);
-        close(fd);
-        return EFAULT;
-    }
+/* Adds 'desc' to 'ring'. Returns false if ring is full.
+ * Must be called by ring producer only. */
+static inline bool
+tap_spsc_push(struct tap_spsc_ring *ring, struct tap_pbuf *desc)
+{
+    uint32_t head, tail;
 
-    if (0 != ops_fpa_net_if_setup(tap_if_name, mac)) {
-        VLOG_ERR("Unable to setup TAP interface '%s'", tap_if_name);
-        close(fd);
-        return EFAULT;
+    atomic_read_relaxed(&ring->head, &head);
+    atomic_read_explicit(&ring->tail, &tail, memory_order_acquire);
+    if (head - tail == OPS_FPA_RX_RING_SIZE) {
+        return false;
     }
 
-    /* Creates new TAP interface entry */
-    if_entry = xzalloc(sizeof(* if_entry));
-    if_entry->portNum = portNum;
-    if_entry->name = xstrdup(tap_if_name);
-    memcpy(&if_entry->mac, mac, ETH_ALEN);
-
-    VLOG_INFO("TAP interface '%s' created: portNum=%d, fd=%d, MAC=" ETH_ADDR_FMT,
-              tap_if_name, portNum, fd,
-              ETH_ADDR_BYTES_ARGS(mac->ether_addr_octet));
-
-    *tap_fd = fd;
+    ring->desc[head & (OPS_FPA_RX_RING_SIZE - 1)] = desc;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
 
-    /* Inserts TAP info entry to map */
-    hmap_insert(&info->fd_to_tap_if_map, &if_entry->node, fd);
+    return true;
+}
 
-    /* Creates add ctrl command for listener threads */
-    cmd.type = OPS_FPA_CMD_ADD_IF;
-    cmd.add.fd = fd;
-    cmd.add.portNum = portNum;
-    memcpy(cmd.add.tap_if_name, tap_if_name, IFNAMSIZ);
-    memcpy(&cmd.add.mac, &if_entry->mac, ETH_ALEN);
+/* Takes oldest descriptor from 'ring' or returns NULL if ring is empty.
+ * Must be called by ring consumer only. */
+static inline struct tap_pbuf *
+tap_spsc_pop(struct tap_spsc_ring *ring)
+{
+    struct tap_pbuf *desc;
+    uint32_t head, tail;
 
-    /* Notifies all listener threads about new TAP interface */
-    for (i = 0; i < OPS_FPA_THREAD_CNT; i++) {
-        send_ctrl_cmd(info->ctrl_fds[i][OPS_FPA_THREAD_PIPE_SEND], &cmd);
+    atomic_read_relaxed(&ring->tail, &tail);
+    atomic_read_explicit(&ring->head, &head, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
     }
 
-    ops_fpa_dev_mutex_unlock();
+    desc = ring->desc[tail & (OPS_FPA_RX_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
 
-    return 0;
+    return desc;
 }
 
-int
-ops_fpa_tap_if_delete(uint32_t switchId, int tap_fd)
+/* Writes 'efd' to wake up its reader */
+static void
+tap_efd_signal(int efd)
 {
-    int i;
-    struct tap_info *info;
-    struct tap_if_entry *if_entry;
-    struct ctrl_cmd cmd;
+    uint64_t one = 1;
+
+    /* Counter can't overflow, so only EINTR is possible */
+    while (write(efd, &one, sizeof one) < 0 && errno == EINTR) {
+        continue;
+    }
+}
+
+/* Clears wakeup of 'efd' before the source is drained */
+static void
+tap_efd_clear(int efd)
+{
+    uint64_t value;
+
+    ignore(read(efd, &value, sizeof value));
+}
+
+/* Saves packet trace record into 'ring' of the calling thread */
+static void
+tap_trace_record__(struct tap_trace_ring *ring, enum tap_dir dir,
+                   enum tap_trace_verdict verdict, uint32_t port,
+                   uint16_t vid, uint32_t reason, uint32_t tableId,
+                   const uint8_t *data, uint32_t len)
+{
+    struct tap_trace_rec *rec;
+    struct timespec ts;
+    uint64_t head;
+
+    atomic_read_relaxed(&ring->head, &head);
+    rec = &ring->rec[head & (OPS_FPA_TRACE_RING_SIZE - 1)];
+
+    /* Slot is overwritten only after 'head' of previous record is
+     * visible, so reader which copied any of new data also sees 'head'
+     * which marks the record as overwritten */
+    atomic_thread_fence(memory_order_release);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec->time_ns = (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+    rec->dir = dir;
+    rec->verdict = verdict;
+    rec->port = port;
+    rec->vid = vid;
+    rec->reason = reason;
+    rec->tableId = tableId;
+    rec->len = MIN(len, UINT16_MAX);
+    rec->data_len = MIN(len, OPS_FPA_TRACE_DATA_LEN);
+    memcpy(rec->data, data, rec->data_len);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* Traces packet into 'RING' if tracing is enabled.
+ * Costs single flag check otherwise. */
+#define tap_trace_record(INFO, RING, ...)                              \
+    do {                                                                \
+        bool enabled__;                                                 \
+        atomic_read_relaxed(&(INFO)->trace_enabled, &enabled__);        \
+        if (OVS_UNLIKELY(enabled__)) {                                  \
+            tap_trace_record__(RING, __VA_ARGS__);                      \
+        }                                                               \
+    } while (0)
+
+static inline uint64_t
+tap_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/* Latency histogram bucket of 'ns': 0 is below 1 us, bucket 'i' counts
+ * [2^(i-1), 2^i) us, the last one everything longer */
+static inline int
+tap_latency_bucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+
+    return us ? MIN(log_2_floor(us) + 1, OPS_FPA_LAT_BUCKETS - 1) : 0;
+}
+
+/* Increments statistics counter owned by the calling thread */
+static inline void
+tap_stat_add(atomic_uint64_t *stat, uint64_t n)
+{
+    uint64_t value;
+
+    atomic_read_relaxed(stat, &value);
+    atomic_store_relaxed(stat, value + n);
+}
+
+static void
+tap_pkt_counters_add(struct tap_pkt_counters *cnt, enum tap_cnt_type type,
+                     uint32_t bytes)
+{
+    switch (type) {
+        case TAP_CNT_FORWARDED:
+            tap_stat_add(&cnt->packets, 1);
+            tap_stat_add(&cnt->bytes, bytes);
+            break;
+        case TAP_CNT_EAGAIN:
+            tap_stat_add(&cnt->eagain, 1);
+            /* fall through */
+        case TAP_CNT_DROP:
+            tap_stat_add(&cnt->drops, 1);
+            break;
+        case TAP_CNT_QUEUED:
+            tap_stat_add(&cnt->queued, 1);
+            break;
+        case TAP_CNT_DRAINED:
+            tap_stat_add(&cnt->drained, 1);
+            break;
+    }
+}
+
+/* Accounts packet in counters 'c' owned by the calling thread */
+static void
+tap_count(struct tap_thread_counters *c, enum tap_cnt_type type,
+          uint32_t port, uint32_t reason, uint16_t vid, uint32_t bytes)
+{
+    port = MIN(port, OPS_FPA_CNT_MAX_PORTS);
+    reason = MIN(reason, OPS_FPA_CNT_MAX_REASONS);
+
+    tap_pkt_counters_add(&c->port[port][reason], type, bytes);
+    tap_pkt_counters_add(&c->vlan[vid % VLAN_BITMAP_SIZE], type, bytes);
+}
+
+/* Reads 'cnt' and adds it to 'sum' */
+static void
+tap_pkt_counters_read(const struct tap_pkt_counters *cnt,
+                      struct tap_pkt_counters *sum)
+{
+    uint64_t value, total;
+
+#define TAP_CNT_ACCUMULATE(FIELD)                   \
+    atomic_read_relaxed(&cnt->FIELD, &value);       \
+    atomic_read_relaxed(&sum->FIELD, &total);       \
+    atomic_store_relaxed(&sum->FIELD, total + value);
+
+    TAP_CNT_ACCUMULATE(packets);
+    TAP_CNT_ACCUMULATE(bytes);
+    TAP_CNT_ACCUMULATE(drops);
+    TAP_CNT_ACCUMULATE(eagain);
+    TAP_CNT_ACCUMULATE(queued);
+    TAP_CNT_ACCUMULATE(drained);
+#undef TAP_CNT_ACCUMULATE
+}
+
+/* Reads all counters of 'c' and adds them to 'sum' */
+static void
+tap_thread_counters_read(const struct tap_thread_counters *c,
+                         struct tap_thread_counters *sum)
+{
+    int port, reason, vid;
+
+    for (port = 0; port <= OPS_FPA_CNT_MAX_PORTS; port++) {
+        for (reason = 0; reason <= OPS_FPA_CNT_MAX_REASONS; reason++) {
+            tap_pkt_counters_read(&c->port[port][reason], &sum->port[port][reason]);
+        }
+    }
+    for (vid = 0; vid < VLAN_BITMAP_SIZE; vid++) {
+        tap_pkt_counters_read(&c->vlan[vid], &sum->vlan[vid]);
+    }
+}
+
+/****************************************************************************
+* Commands for notify thread about new/delete interface and thread exit
+****************************************************************************/
+
+typedef enum {
+    OPS_FPA_CMD_THREAD_EXIT,
+    OPS_FPA_CMD_ADD_IF,
+    OPS_FPA_CMD_DEL_IF,
+    OPS_FPA_CMD_CNT
+} ops_fpa_cmd_type;
+
+struct ctrl_cmd {
+
+    /* Next command in queue */
+    ATOMIC(struct ctrl_cmd *) next;
+
+    ops_fpa_cmd_type type;
+
+    union {
+        struct {
+            /* TAP interface name */
+            char tap_if_name[IFNAMSIZ];
+
+            /* FD of TAP interface */
+            int fd;
+
+            /* HW port number */
+            uint32_t portNum;
+
+            /* TAP MAC address. */
+            struct ether_addr mac; /*TODO remove when TAP MAC will be obtained from netlink socket */
+        } add;
+        struct {
+            /* FD of TAP interface */
+            int fd;
+
+            /* HW port number */
+            uint32_t portNum;
+        } del;
+    };
+};
+
+/* Lock-free multiple producers single consumer command queue (intrusive
+ * Vyukov queue). Producers never block, consumer is woken up via eventfd
+ * which it can wait on together with other fds. */
+struct ctrl_queue {
+
+    /* Last pushed command, producers side */
+    ATOMIC(struct ctrl_cmd *) head;
+
+    /* Oldest command, consumer side */
+    struct ctrl_cmd *tail;
+
+    /* Placeholder to keep queue never empty */
+    struct ctrl_cmd stub;
+
+    /* Wakeup eventfd */
+    int efd;
+};
+
+static struct ctrl_queue *
+ctrl_queue_create(void)
+{
+    struct ctrl_queue *q = xzalloc_cacheline(sizeof *q);
+
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->head, &q->stub);
+    q->tail = &q->stub;
+
+    q->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (q->efd < 0) {
+        ovs_abort(errno, "%s: eventfd failed", __func__);
+    }
+
+    return q;
+}
+
+static void
+ctrl_queue_push(struct ctrl_queue *q, struct ctrl_cmd *cmd)
+{
+    struct ctrl_cmd *prev;
+
+    atomic_store_relaxed(&cmd->next, NULL);
+
+    atomic_read_relaxed(&q->head, &prev);
+    while (!atomic_compare_exchange_weak_explicit(&q->head, &prev, cmd,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed)) {
+        continue;
+    }
+
+    atomic_store_explicit(&prev->next, cmd, memory_order_release);
+}
+
+/* Sends copy of 'cmd' to thread and wakes it up */
+static void
+send_ctrl_cmd(struct ctrl_queue *q, const struct ctrl_cmd *cmd)
+{
+    ovs_assert(q);
+    ovs_assert(cmd);
+
+    ctrl_queue_push(q, xmemdup(cmd, sizeof *cmd));
+    tap_efd_signal(q->efd);
+}
+
+/* Returns next command which caller must free, or NULL if queue is empty.
+ * Must be called by queue owner thread only. */
+static struct ctrl_cmd *
+recv_ctrl_cmd(struct ctrl_queue *q)
+{
+    struct ctrl_cmd *tail = q->tail;
+    struct ctrl_cmd *next, *head;
+
+    atomic_read_explicit(&tail->next, &next, memory_order_acquire);
+
+    if (tail == &q->stub) {
+        if (!next) {
+            return NULL;
+        }
+        q->tail = tail = next;
+        atomic_read_explicit(&tail->next, &next, memory_order_acquire);
+    }
+
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    atomic_read_explicit(&q->head, &head, memory_order_acquire);
+    if (tail != head) {
+        /* Producer is in the middle of push, it will wake us up again */
+        return NULL;
+    }
+
+    ctrl_queue_push(q, &q->stub);
+
+    atomic_read_explicit(&tail->next, &next, memory_order_acquire);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+/* Clears wakeup of queue before it is drained */
+static void
+ctrl_queue_clear_wakeup(struct ctrl_queue *q)
+{
+    tap_efd_clear(q->efd);
+}
+
+static void
+ctrl_queue_destroy(struct ctrl_queue *q)
+{
+    struct ctrl_cmd *cmd;
+
+    while ((cmd = recv_ctrl_cmd(q))) {
+        free(cmd);
+    }
+    close(q->efd);
+    free_cacheline(q);
+}
+/****************************************************************************/
+
+struct tap_if_entry *get_if_entry(const struct hmap *map, int key);
+static void tap_if_delete__(struct tap_info *info, struct tap_if_entry *if_entry);
+static void tap_if_entry_destroy(struct tap_if_entry *if_entry);
+static int tap_svi_detach(struct tap_info *info);
+static void tap_uring_poll_out(struct tap_worker *w, struct tap_if_entry *if_entry);
+
+extern bool
+ops_fpa_is_internal_vlan(int vid);
+
+int ops_fpa_net_if_setup(const char *name, const struct ether_addr *mac);
+int ops_fpa_tun_alloc(char *name, int flags);
+
+uint16_t
+ops_fpa_get_eth_type(void *pkt)
+{
+    return ntohs(((struct ether_header *)pkt)->ether_type);
+}
+
+/* CPU path configuration, shown and changed by "fpa/tap/config". Number of
+ * workers, TAP I/O backend and packet buffer memory are applied by restart
+ * of CPU path threads, SVI mode when bridge interface is created.
+ * Accessed from main thread only. */
+static struct tap_config {
+    int n_workers;      /* 0 for number of CPU cores up to OPS_FPA_TAP_WORKERS_DFLT */
+    bool use_uring;     /* io_uring backend for TAP interfaces, epoll otherwise */
+    bool hugepages;     /* Packet buffers in hugepages, heap otherwise */
+    bool svi_direct;    /* Direct delivery of SVI traffic, Linux bridge otherwise */
+} tap_config;
+
+/* Bridge interface exists and SVI mode it was created in */
+static bool tap_bridge_created;
+static bool tap_bridge_svi_direct;
+
+/* Returns number of TAP workers to start */
+static int
+tap_n_workers(void)
+{
+    int n;
+
+    if (tap_config.n_workers) {
+        return tap_config.n_workers;
+    }
+
+    n = count_cpu_cores();
+    return MAX(1, MIN(n, OPS_FPA_TAP_WORKERS_DFLT));
+}
+
+/* Returns true if SVI traffic is delivered directly. Then bridge interface
+ * is SVI TAP interface served by TAP workers instead of Linux bridge of
+ * port TAP interfaces. Configured mode does not change mode of existing
+ * bridge interface. */
+static bool
+tap_svi_direct(void)
+{
+    return tap_bridge_created ? tap_bridge_svi_direct : tap_config.svi_direct;
+}
+
+/* Returns true if VLAN 'vid' has SVI */
+static inline bool
+tap_svi_vlan(struct tap_info *info, uint16_t vid)
+{
+    uint64_t word;
+
+    if (vid >= VLAN_BITMAP_SIZE) {
+        return false;
+    }
+    atomic_read_relaxed(&info->svi_vlans[vid / 64], &word);
+    return word & (UINT64_C(1) << (vid % 64));
+}
+
+/* Returns TAP worker which owns HW port 'portNum' */
+static inline struct tap_worker *
+tap_worker_by_port(const struct tap_info *info, uint32_t portNum)
+{
+    return &info->workers[portNum % info->n_workers];
+}
+
+/* Starts CPU path threads of 'info' with current CPU path configuration:
+ * TAP workers and ASIC listener which dispatches to them, with their
+ * packet buffers. */
+static void
+tap_threads_start(struct tap_info *info)
+{
+    int i;
+
+    info->n_workers = tap_n_workers();
+    info->use_uring = tap_config.use_uring;
+
+    /* Every worker may hold all its class queues and TAP transmit queues
+     * full of buffers, one buffer of TAP read and a full cache, the rest
+     * is enough for one burst and full cache of ASIC listener. */
+    BUILD_ASSERT(OPS_FPA_RX_DEPTH_TOTAL <= OPS_FPA_RX_RING_SIZE);
+    tap_pbuf_pool_init(&info->pool,
+                       info->n_workers * (OPS_FPA_RX_DEPTH_TOTAL + OPS_FPA_TAP_TXQ_WORKER_MAX
+                                          + 1 + OPS_FPA_PBUF_CACHE_SIZE)
+                       + OPS_FPA_RX_BURST + OPS_FPA_PBUF_CACHE_SIZE,
+                       tap_config.hugepages);
+    tap_pbuf_cache_init(&info->cache, &info->pool);
+
+    /* Start workers before ASIC listener which dispatches to them */
+    info->workers = xcalloc(info->n_workers, sizeof *info->workers);
+    for (i = 0; i < info->n_workers; i++) {
+        struct tap_worker *w = &info->workers[i];
+        enum tap_prio prio;
+        enum tap_dir dir;
+
+        w->info = info;
+        w->id = i;
+        w->ctrl = ctrl_queue_create();
+        for (prio = 0; prio < TAP_PRIO_CNT; prio++) {
+            w->rx_ring[prio] = xzalloc_cacheline(sizeof *w->rx_ring[prio]);
+        }
+        w->wrr_class = TAP_PRIO_HIGH;
+        w->wrr_credit = tap_prio_weight[TAP_PRIO_HIGH];
+        for (prio = 0; prio < TAP_PRIO_CNT; prio++) {
+            atomic_init(&w->class_outstanding[prio], 0);
+        }
+        tap_pbuf_cache_init(&w->cache, &info->pool);
+        w->rx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (w->rx_efd < 0) {
+            ovs_abort(errno, "%s: eventfd failed", __func__);
+        }
+        w->trace = xzalloc_cacheline(sizeof *w->trace);
+        for (dir = 0; dir < TAP_DIR_CNT; dir++) {
+            w->counters[dir] = xzalloc_cacheline(sizeof *w->counters[dir]);
+        }
+
+        w->thread = ovs_thread_create("tap-worker", tap_worker_main, w);
+    }
+    VLOG_INFO("%d TAP worker threads started", info->n_workers);
+
+    info->ctrl = ctrl_queue_create();
+    info->thread = ovs_thread_create("asic-listener", asic_listener, info);
+    pthread_getaffinity_np(info->thread, sizeof info->rx_cpus_dflt,
+                           &info->rx_cpus_dflt);
+    if (info->rx_cpu >= 0) {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(info->rx_cpu, &cpus);
+        if (pthread_setaffinity_np(info->thread, sizeof cpus, &cpus)) {
+            info->rx_cpu = -1;
+        }
+    }
+    VLOG_INFO("asic-listener thread started");
+}
+
+/* Stops CPU path threads started by tap_threads_start() and releases their
+ * resources. TAP interfaces still added to workers stay open. */
+static void
+tap_threads_stop(struct tap_info *info)
+{
+    struct ctrl_cmd cmd = { .type = OPS_FPA_CMD_THREAD_EXIT };
+    int i;
+
+    /* Stop ASIC listener first, so nothing is dispatched to workers */
+    send_ctrl_cmd(info->ctrl, &cmd);
+    xpthread_join(info->thread, NULL);
+    ctrl_queue_destroy(info->ctrl);
+
+    for (i = 0; i < info->n_workers; i++) {
+        struct tap_worker *w = &info->workers[i];
+        enum tap_prio prio;
+        enum tap_dir dir;
+
+        send_ctrl_cmd(w->ctrl, &cmd);
+        xpthread_join(w->thread, NULL);
+
+        ctrl_queue_destroy(w->ctrl);
+        close(w->rx_efd);
+        for (prio = 0; prio < TAP_PRIO_CNT; prio++) {
+            free_cacheline(w->rx_ring[prio]);
+        }
+        free_cacheline(w->trace);
+        for (dir = 0; dir < TAP_DIR_CNT; dir++) {
+            free_cacheline(w->counters[dir]);
+        }
+    }
+    free(info->workers);
+    info->workers = NULL;
+    info->n_workers = 0;
+
+    /* Buffers still in worker rings and caches are released with the pool */
+    tap_pbuf_pool_destroy(&info->pool);
+}
+
+/* Notifies TAP worker owning 'if_entry' of new TAP interface.
+ * Must be called with FPA device mutex held. */
+static void
+tap_if_add__(struct tap_info *info, const struct tap_if_entry *if_entry)
+{
+    struct ctrl_cmd cmd;
+
+    cmd.type = OPS_FPA_CMD_ADD_IF;
+    cmd.add.fd = if_entry->fd;
+    cmd.add.portNum = if_entry->portNum;
+    snprintf(cmd.add.tap_if_name, IFNAMSIZ, "%s", if_entry->name);
+    memcpy(&cmd.add.mac, &if_entry->mac, ETH_ALEN);
+
+    send_ctrl_cmd(tap_worker_by_port(info, if_entry->portNum)->ctrl, &cmd);
+}
+
+/* Restarts CPU path threads of 'info' to apply changed CPU path
+ * configuration. TAP interfaces are handed over to new workers, packets
+ * in flight and worker statistics are lost.
+ * Must be called with FPA device mutex held. */
+static void
+tap_threads_restart(struct tap_info *info)
+{
+    struct tap_if_entry *e;
+
+    tap_threads_stop(info);
+    tap_threads_start(info);
+
+    /* Histogram restarts from zero with new workers */
+    memset(info->latency_base, 0, sizeof info->latency_base);
+
+    HMAP_FOR_EACH (e, node, &info->fd_to_tap_if_map) {
+        tap_if_add__(info, e);
+    }
+}
+
+struct tap_info *
+ops_fpa_tap_init(uint32_t switchId, struct fpa_mac_learning *ml)
+{
+    struct tap_info *info;
 
     ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
-    ovs_assert(tap_fd>0);
 
-    ops_fpa_dev_mutex_lock();
-    info = get_tap_info_by_switch_id(switchId);
-    if (!info) {
-        VLOG_ERR("TAP interface not initialized for FPA device (%d)", switchId);
-        return EFAULT;
+    VLOG_INFO("TAP interface init for FPA device (%d)", switchId);
+
+    info = get_tap_info_by_switch_id(switchId);
+    if (info) {
+        VLOG_ERR("TAP interfaces for FPA device (%d) already exist", switchId);
+        return info;
+    }
+
+    /* Create TAP info for switch */
+    info = xzalloc(sizeof *info);
+    info->switchId = switchId;
+    info->ml = ml;
+
+    hmap_init(&info->fd_to_tap_if_map);
+
+    /* Trace rings, tracing is disabled by default */
+    atomic_init(&info->trace_enabled, false);
+    atomic_init(&info->sched_weighted, false);
+    atomic_init(&info->gro_enabled, false);
+    atomic_init(&info->rx_poll_us, 0);
+    atomic_init(&info->svi_fd, -1);
+    info->trace = xzalloc_cacheline(sizeof *info->trace);
+    info->counters = xzalloc_cacheline(sizeof *info->counters);
+    ovs_mutex_init(&info->tx_mutex);
+    info->rx_cpu = -1;
+
+    tap_threads_start(info);
+
+    ops_fpa_tap_unixctl_init();
+
+    return info;
+}
+
+void
+ops_fpa_tap_deinit(uint32_t switchId)
+{
+    struct tap_if_entry *e;
+    struct tap_if_entry *next;
+    struct tap_info *info;
+
+    ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
+
+    info = get_tap_info_by_switch_id(switchId);
+
+    if (!info) {
+        return;
+    }
+
+    /* Workers must not write to SVI TAP interface once it is removed */
+    tap_svi_detach(info);
+
+    /* Remove TAP interfaces. FPA device mutex is held by caller. */
+    HMAP_FOR_EACH_SAFE(e, next, node, &info->fd_to_tap_if_map) {
+        tap_if_delete__(info, e);
+        tap_if_entry_destroy(e);
+    }
+
+    hmap_destroy(&info->fd_to_tap_if_map);
+
+    tap_threads_stop(info);
+    ovs_mutex_destroy(&info->tx_mutex);
+
+    free_cacheline(info->trace);
+    free_cacheline(info->counters);
+
+    free(info);
+
+    VLOG_INFO("Host interface TAP-based instance deallocated");
+}
+
+/* Stops new writes to SVI TAP interface of 'info'. Returns its FD or -1
+ * if there is no SVI TAP interface. Workers which have already read the FD
+ * may write to it until grace period, so its reading worker closes it
+ * only after one. Must be called with FPA device mutex held. */
+static int
+tap_svi_detach(struct tap_info *info)
+{
+    int fd;
+
+    atomic_read_relaxed(&info->svi_fd, &fd);
+    if (fd >= 0) {
+        atomic_store_relaxed(&info->svi_fd, -1);
+    }
+
+    return fd;
+}
+
+/* Creates SVI TAP interface 'name' in place of Linux bridge. Kernel vlan
+ * subinterfaces are stacked on it as on the bridge, while its frames are
+ * exchanged with ASIC ports by TAP workers directly: from ASIC by VLAN,
+ * to ASIC by FDB. */
+static int
+tap_svi_create(uint32_t switchId, const char *name, const struct ether_addr *mac)
+{
+    char tap_if_name[IFNAMSIZ];
+    struct tap_if_entry *if_entry;
+    struct tap_info *info;
+    int fd, cur_fd;
+
+    ops_fpa_dev_mutex_lock();
+    info = get_tap_info_by_switch_id(switchId);
+    if (!info) {
+        VLOG_ERR("TAP interface not initialized for FPA device (%d)", switchId);
+        ops_fpa_dev_mutex_unlock();
+        return EFAULT;
+    }
+
+    atomic_read_relaxed(&info->svi_fd, &cur_fd);
+    if (cur_fd >= 0) {
+        VLOG_WARN("SVI TAP interface '%s' is already created", name);
+        ops_fpa_dev_mutex_unlock();
+        return 0;
+    }
+
+    /* Kernel never offloads to it, so vnet header is always empty, but
+     * is still exchanged as with port TAP interfaces */
+    snprintf(tap_if_name, IFNAMSIZ, "%s", name);
+    fd = ops_fpa_tun_alloc(tap_if_name, (IFF_TAP | IFF_NO_PI | IFF_VNET_HDR));
+    if (fd <= 0) {
+        VLOG_ERR("Unable to create SVI TAP interface '%s'", tap_if_name);
+        ops_fpa_dev_mutex_unlock();
+        return EPERM;
+    }
+
+    if (set_nonblocking(fd) || ops_fpa_net_if_setup(tap_if_name, mac)) {
+        VLOG_ERR("Unable to setup SVI TAP interface '%s'", tap_if_name);
+        close(fd);
+        ops_fpa_dev_mutex_unlock();
+        return EPERM;
+    }
+
+    if_entry = xzalloc(sizeof(* if_entry));
+    if_entry->fd = fd;
+    if_entry->portNum = TAP_SVI_PORT;
+    if_entry->name = xstrdup(tap_if_name);
+    memcpy(&if_entry->mac, mac, ETH_ALEN);
+    hmap_insert(&info->fd_to_tap_if_map, &if_entry->node, fd);
+
+    /* One worker reads it, all workers write to it */
+    tap_if_add__(info, if_entry);
+
+    atomic_store_relaxed(&info->svi_fd, fd);
+
+    VLOG_INFO("SVI TAP interface '%s' created: fd=%d, MAC=" ETH_ADDR_FMT,
+              tap_if_name, fd, ETH_ADDR_BYTES_ARGS(mac->ether_addr_octet));
+
+    ops_fpa_dev_mutex_unlock();
+
+    return 0;
+}
+
+/* Removes SVI TAP interface created by tap_svi_create() */
+static int
+tap_svi_delete(uint32_t switchId)
+{
+    struct tap_if_entry *if_entry;
+    struct tap_info *info;
+    int fd;
+
+    ops_fpa_dev_mutex_lock();
+    info = get_tap_info_by_switch_id(switchId);
+    fd = info ? tap_svi_detach(info) : -1;
+    if (fd < 0) {
+        ops_fpa_dev_mutex_unlock();
+        return ENOENT;
+    }
+
+    if_entry = get_if_entry(&info->fd_to_tap_if_map, fd);
+    ovs_assert(if_entry);
+    tap_if_delete__(info, if_entry);
+
+    ops_fpa_dev_mutex_unlock();
+
+    tap_if_entry_destroy(if_entry);
+
+    return 0;
+}
+
+void
+ops_fpa_tap_svi_vlan_set(uint32_t switchId, int vid, bool svi)
+{
+    struct tap_info *info;
+    uint64_t bit, orig;
+
+    if (vid <= 0 || vid >= VLAN_BITMAP_SIZE) {
+        return;
+    }
+
+    ops_fpa_dev_mutex_lock();
+    info = get_tap_info_by_switch_id(switchId);
+    if (info) {
+        bit = UINT64_C(1) << (vid % 64);
+        if (svi) {
+            atomic_or_relaxed(&info->svi_vlans[vid / 64], bit, &orig);
+        } else {
+            atomic_and_relaxed(&info->svi_vlans[vid / 64], ~bit, &orig);
+        }
+    }
+    ops_fpa_dev_mutex_unlock();
+}
+
+int
+ops_fpa_bridge_create(const char *name, const struct ether_addr *mac)
+{
+    int rc;
+
+    /* Mode is kept until bridge interface is deleted */
+    tap_bridge_svi_direct = tap_config.svi_direct;
+    tap_bridge_created = true;
+
+    if (tap_svi_direct()) {
+        return tap_svi_create(FPA_DEV_SWITCH_ID_DEFAULT, name, mac);
+    }
+
+    rc = ops_fpa_system("ip link add name %s type bridge", name);
+    if (rc) {
+        VLOG_WARN("Error executing ip for creating bridge '%s', rc=%d. Possibly bridge is already created",
+            name, rc);
+    }
+
+    if (0 != ops_fpa_net_if_setup(name, mac)) {
+        VLOG_ERR("Unable to setup bridge interface '%s'", name);
+        return EPERM;
+    }
+
+    rc = ops_fpa_system("ip link set %s up", name);
+    if (rc) {
+        VLOG_ERR("Error setting bridge '%s' up, rc=%d", name, rc);
+        return EPERM;
+    }
+
+    return 0;
+}
+
+int
+ops_fpa_bridge_delete(const char *name)
+{
+    bool direct = tap_svi_direct();
+    int rc;
+
+    tap_bridge_created = false;
+
+    if (direct) {
+        return tap_svi_delete(FPA_DEV_SWITCH_ID_DEFAULT);
+    }
+
+    rc = ops_fpa_system("ip link delete %s type bridge", name);
+    if (rc) {
+        VLOG_ERR("Error deleting bridge '%s', rc=%d", name, rc);
+        return EFAULT;
+    }
+
+    return 0;
+}
+
+int
+ops_fpa_bridge_port_add(const char *name)
+{
+    int rc;
+
+    /* Port TAP interfaces carry no SVI traffic */
+    if (tap_svi_direct()) {
+        return 0;
+    }
+
+    rc = ops_fpa_system("ip link set %s master %s", name, DEFAULT_BRIDGE_NAME);
+    if (rc) {
+        VLOG_ERR("Error adding TAP '%s' to bridge '%s' up, rc=%d", name, DEFAULT_BRIDGE_NAME, rc);
+        return EFAULT;
+    }
+
+    return 0;
+}
+
+int
+ops_fpa_bridge_port_rm(const char *name)
+{
+    int rc;
+
+    if (tap_svi_direct()) {
+        return 0;
+    }
+
+    rc = ops_fpa_system("ip link set %s nomaster", name);
+    if (rc) {
+        VLOG_ERR("Error removing TAP '%s' from bridge, rc=%d", name, rc);
+    }
+
+    return 0;
+}
+
+static void
+tap_if_entry_destroy(struct tap_if_entry *if_entry)
+{
+    /* Try to remove interface from bridge before shutting down */
+    ops_fpa_bridge_port_rm(if_entry->name);
+
+    ops_fpa_system("/sbin/ifconfig %s down", if_entry->name);
+
+    free(if_entry->name);
+    free(if_entry);
+}
+
+int
+ops_fpa_tap_if_create(uint32_t switchId, uint32_t portNum, const char *name,
+                      const struct ether_addr *mac, int* tap_fd)
+{
+    int rc, fd, prog_fd;
+    char tap_if_name[IFNAMSIZ];
+    struct tap_info *info;
+    struct tap_if_entry *if_entry;
+
+    ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
+    ovs_assert(name);
+    ovs_assert(mac);
+    ovs_assert(tap_fd);
+
+    ops_fpa_dev_mutex_lock();
+    info = get_tap_info_by_switch_id(switchId);
+    if (!info) {
+        VLOG_ERR("TAP interface not initialized for FPA device (%d)", switchId);
+        ops_fpa_dev_mutex_unlock();
+        return EFAULT;
+    }
+
+    snprintf(tap_if_name, IFNAMSIZ, "%s", name);
+    fd = ops_fpa_tun_alloc(tap_if_name, (IFF_TAP | IFF_NO_PI | IFF_VNET_HDR));
+    if (fd <= 0) {
+        VLOG_ERR("Unable to create TAP interface '%s'", tap_if_name);
+        ops_fpa_dev_mutex_unlock();
+        return EFAULT;
+    }
+
+    /* Let kernel pass TCP super-frames with partial checksum, they are
+     * completed and segmented by TAP worker. Without offloads vnet header
+     * is still exchanged, just never requests anything. */
+    if (ioctl(fd, TUNSETOFFLOAD, OPS_FPA_TAP_OFFLOADS) < 0) {
+        VLOG_WARN("Unable to enable offloads on TAP interface '%s'. Error(%d) - %s",
+                  tap_if_name, errno, strerror(errno));
+    }
+
+    /* Drop frames TAP worker would drop in kernel already. TAP worker
+     * still checks them, so the filter is optional. */
+    prog_fd = ops_fpa_bpf_tap_filter_load(switchId, portNum, mac);
+    if (prog_fd >= 0) {
+        if (ioctl(fd, TUNSETFILTEREBPF, &prog_fd) < 0) {
+            VLOG_WARN("Unable to attach filter to TAP interface '%s'. Error(%d) - %s",
+                      tap_if_name, errno, strerror(errno));
+        }
+        close(prog_fd);
+    }
+
+    rc = set_nonblocking(fd);
+    if (rc) {
+        VLOG_ERR("Unable to set TAP interface '%s' into nonblocking mode", tap_if_name);
+        close(fd);
+        ops_fpa_dev_mutex_unlock();
+        return EFAULT;
+    }
+
+    if (0 != ops_fpa_net_if_setup(tap_if_name, mac)) {
+        VLOG_ERR("Unable to setup TAP interface '%s'", tap_if_name);
+        close(fd);
+        ops_fpa_dev_mutex_unlock();
+        return EFAULT;
+    }
+
+    /* Creates new TAP interface entry */
+    if_entry = xzalloc(sizeof(* if_entry));
+    if_entry->fd = fd;
+    if_entry->portNum = portNum;
+    if_entry->name = xstrdup(tap_if_name);
+    memcpy(&if_entry->mac, mac, ETH_ALEN);
+
+    VLOG_INFO("TAP interface '%s' created: portNum=%d, fd=%d, MAC=" ETH_ADDR_FMT,
+              tap_if_name, portNum, fd,
+              ETH_ADDR_BYTES_ARGS(mac->ether_addr_octet));
+
+    *tap_fd = fd;
+
+    /* Inserts TAP info entry to map */
+    hmap_insert(&info->fd_to_tap_if_map, &if_entry->node, fd);
+
+    /* Notifies TAP worker owning the port about new TAP interface */
+    tap_if_add__(info, if_entry);
+
+    ops_fpa_dev_mutex_unlock();
+
+    return 0;
+}
+
+/* Unregisters TAP interface from its TAP worker and removes it from
+ * TAP info. TAP worker closes interface FD.
+ * Must be called with FPA device mutex held. */
+static void
+tap_if_delete__(struct tap_info *info, struct tap_if_entry *if_entry)
+{
+    struct ctrl_cmd cmd;
+
+    /* Creates delete ctrl command for TAP worker */
+    cmd.type = OPS_FPA_CMD_DEL_IF;
+    cmd.del.fd = if_entry->fd;
+    cmd.del.portNum = if_entry->portNum;
+
+    /* Notifies TAP worker about remove TAP interface */
+    send_ctrl_cmd(tap_worker_by_port(info, if_entry->portNum)->ctrl, &cmd);
+
+    /* Remove TAP info from maps */
+    hmap_remove(&info->fd_to_tap_if_map, &if_entry->node);
+
+    if (if_entry->portNum != TAP_SVI_PORT) {
+        ops_fpa_bpf_port_remove(info->switchId, if_entry->portNum);
+    }
+}
+
+int
+ops_fpa_tap_if_delete(uint32_t switchId, int tap_fd)
+{
+    struct tap_info *info;
+    struct tap_if_entry *if_entry;
+
+    ovs_assert(switchId != FPA_INVALID_SWITCH_ID);
+    ovs_assert(tap_fd>0);
+
+    ops_fpa_dev_mutex_lock();
+    info = get_tap_info_by_switch_id(switchId);
+    if (!info) {
+        VLOG_ERR("TAP interface not initialized for FPA device (%d)", switchId);
+        ops_fpa_dev_mutex_unlock();
+        return EFAULT;
+    }
+
+    /* Get TAP interface entry for fd */
+    if_entry = get_if_entry(&info->fd_to_tap_if_map, tap_fd);
+    if (!if_entry) {
+        ops_fpa_dev_mutex_unlock();
+        return ENOENT;
+    }
+
+    tap_if_delete__(info, if_entry);
+
+    ops_fpa_dev_mutex_unlock();
+
+    tap_if_entry_destroy(if_entry);
+
+    return 0;
+}
+
+/* Finds TAP interface entry by key */
+struct tap_if_entry *
+get_if_entry(const struct hmap *map, int key)
+{
+    struct hmap_node *entry;
+
+    ovs_assert(map);
+
+    entry = hmap_first_with_hash(map, key);
+    if (entry) {
+        return CONTAINER_OF(entry, struct tap_if_entry, node);
+    } else {
+       VLOG_ERR("%s: Not found TAP interface entry by key %d", __func__, key);
+    }
+
+    return NULL;
+}
+
+/* Creates Linux tun/tap interface.
+ *
+ * Arguments taken by the function:
+ * name:  The name of an interface (or '\0'). MUST have enough
+ *        space to hold the interface name if '\0' is passed.
+ * flags: IFF_TUN   - TUN device (no Ethernet headers)
+ *        IFF_TAP   - TAP device
+ *
+ *        IFF_NO_PI - Do not provide packet information
+ *        IFF_VNET_HDR - Prepend virtio_net_hdr to every packet
+ */
+
+int
+ops_fpa_tun_alloc(char *name, int flags)
+{
+
+    struct ifreq ifr;
+    int fd, err;
+    static const char tun_dev[] = "/dev/net/tun";
+
+    ovs_assert(name);
+
+    /* Open the clone device */
+    fd = open(tun_dev, O_RDWR);
+    if (fd < 0) {
+        VLOG_WARN("opening \"%s\" failed: %s", tun_dev, ovs_strerror(errno));
+        return -errno;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = flags;
+    if (*name) {
+        /* if a device name was specified, put it in the structure; otherwise,
+         * the kernel will try to allocate the "next" device of the
+         * specified type */
+        ovs_strzcpy(ifr.ifr_name, name, sizeof ifr.ifr_name);
+    }
+
+    /* try to create the device */
+    err = ioctl(fd, TUNSETIFF, &ifr);
+    if (err < 0) {
+        VLOG_WARN("%s: creating TAP device failed: %s", name,
+                  ovs_strerror(errno));
+        close(fd);
+        return -errno;
+    }
+
+    /* Write back the name of the interface */
+    strcpy(name, ifr.ifr_name);
+    return fd;
+}
+
+/* Returns true if 'dst' is IEEE 802.1D reserved group address: STP, LACP,
+ * LLDP, 802.1X */
+static inline bool
+tap_eth_is_link_local(const uint8_t *dst)
+{
+    static const uint8_t ieee_reserved[5] = { 0x01, 0x80, 0xc2, 0x00, 0x00 };
+
+    return !memcmp(dst, ieee_reserved, sizeof ieee_reserved) && dst[5] < 0x10;
+}
+
+/* Strips 802.1Q tag of 'pkt' in place. FPA needs contiguous packet, so
+ * only MAC addresses are relocated over the tag. Payload is never moved. */
+static inline void
+tap_pkt_pop(FPA_PACKET_OUT_BUFFER_STC *pkt)
+{
+    memmove(pkt->pktDataPtr + DOT1Q_LEN, pkt->pktDataPtr, 2*ETH_ALEN);
+    pkt->pktDataPtr += DOT1Q_LEN;
+    pkt->pktDataSize -= DOT1Q_LEN;
+}
+
+/* Sends packet 'pkt' of VLAN 'vid' (0 if unknown) read from TAP interface
+ * to ASIC port 'portNum' and accounts it */
+static void
+tap_pkt_send(struct tap_worker *w, uint32_t portNum, uint16_t vid,
+             FPA_PACKET_OUT_BUFFER_STC *pkt)
+{
+    FPA_STATUS err;
+
+    pkt->outPortNum = portNum;
+
+    if (ops_fpa_capture_enabled()) {
+        struct ops_fpa_capture_meta meta = {
+            .inbound = false, .port = portNum, .vid = vid,
+        };
+        ops_fpa_capture_packet(&meta, pkt->pktDataPtr, pkt->pktDataSize);
+    }
+
+    /* Send packet to ASIC */
+    ovs_mutex_lock(&w->info->tx_mutex);
+    err = fpaLibPortPktSend(w->info->switchId, FPA_INVALID_INTF_ID, pkt);
+    ovs_mutex_unlock(&w->info->tx_mutex);
+    if (err != FPA_OK) {
+        VLOG_ERR_RL(&rl, "%s, fpaLibPortPktSend: failed send packet to portNum %d. Status: %s",
+                    __func__, portNum, ops_fpa_strerr(err));
+    }
+
+    tap_count(w->counters[TAP_DIR_TAP_TO_ASIC],
+              err == FPA_OK ? TAP_CNT_FORWARDED : TAP_CNT_DROP,
+              portNum, 0, vid, pkt->pktDataSize);
+    tap_trace_record(w->info, w->trace, TAP_DIR_TAP_TO_ASIC,
+                     err == FPA_OK ? TAP_TRACE_FORWARDED : TAP_TRACE_DROP_ERROR,
+                     portNum, vid, 0, 0, pkt->pktDataPtr, pkt->pktDataSize);
+}
+
+/* Drops packet 'pkt' of VLAN 'vid' read from TAP interface, which port
+ * 'portNum' is not egress member of */
+static void
+tap_pkt_drop_vlan(struct tap_worker *w, uint32_t portNum, uint16_t vid,
+                  const FPA_PACKET_OUT_BUFFER_STC *pkt)
+{
+    VLOG_DBG_RL(&rl, "%s, packet dropped: pid %d is not member of vid %d",
+                __func__, portNum, vid);
+    tap_count(w->counters[TAP_DIR_TAP_TO_ASIC], TAP_CNT_DROP, portNum, 0, vid,
+              pkt->pktDataSize);
+    tap_trace_record(w->info, w->trace, TAP_DIR_TAP_TO_ASIC,
+                     TAP_TRACE_DROP_VLAN, portNum, vid, 0, 0,
+                     pkt->pktDataPtr, pkt->pktDataSize);
+}
+
+/* Handles single packet read from SVI TAP interface. Its VLAN is given by
+ * tag of the vlan subinterface it comes from. Packet is sent to the port
+ * its destination MAC is learned on, or flooded to egress members of the
+ * VLAN if destination is not unicast or not learned yet. */
+static void
+tap_svi_handle_packet(struct tap_worker *w, FPA_PACKET_OUT_BUFFER_STC *pkt)
+{
+    struct tap_info *info = w->info;
+    struct fpa_mac_learning *ml = info->ml;
+    struct ether_header *eth_hdr = (struct ether_header *)pkt->pktDataPtr;
+    uint32_t pids[OPS_FPA_SVI_FLOOD_MAX];
+    bool pops[OPS_FPA_SVI_FLOOD_MAX];
+    uint32_t portNum;
+    bool pop, popped;
+    uint16_t vid;
+    size_t i, n;
+
+    /* Untagged frames are of SVI TAP interface itself, not of any VLAN */
+    if (pkt->pktDataSize < sizeof *eth_hdr + DOT1Q_LEN
+        || ops_fpa_get_eth_type(pkt->pktDataPtr) != ETHERTYPE_VLAN) {
+        tap_pkt_drop_vlan(w, TAP_SVI_PORT, 0, pkt);
+        return;
+    }
+    vid = ntohs(*(uint16_t*)(eth_hdr+1)) & VLAN_VID_MASK;
+
+    if (!(eth_hdr->ether_dhost[0] & 0x01) && ml
+        && !ops_fpa_mac_learning_get_port(ml, vid, eth_hdr->ether_dhost, &portNum)) {
+        if (ops_fpa_vlan_egress_state(info->switchId, portNum, vid, &pop)) {
+            tap_pkt_drop_vlan(w, portNum, vid, pkt);
+            return;
+        }
+        if (pop) {
+            tap_pkt_pop(pkt);
+        }
+        tap_stat_add(&w->stats.svi_unicast, 1);
+        tap_pkt_send(w, portNum, vid, pkt);
+        return;
+    }
+
+    n = ops_fpa_vlan_egress_members(info->switchId, vid, pids, pops,
+                                    ARRAY_SIZE(pids));
+    if (!n) {
+        tap_pkt_drop_vlan(w, TAP_SVI_PORT, vid, pkt);
+        return;
+    }
+    tap_stat_add(&w->stats.svi_flood, 1);
+    if (n > ARRAY_SIZE(pids)) {
+        VLOG_WARN_RL(&rl, "VLAN %d has %"PRIuSIZE" member ports, frame from SVI TAP interface is flooded to first %d",
+                     vid, n, OPS_FPA_SVI_FLOOD_MAX);
+        tap_stat_add(&w->stats.svi_flood_cut, 1);
+        n = ARRAY_SIZE(pids);
+    }
+
+    /* Tagged members get packet as is, then tag is stripped once for
+     * untagged members */
+    for (i = 0; i < n; i++) {
+        if (!pops[i]) {
+            tap_pkt_send(w, pids[i], vid, pkt);
+        }
+    }
+    popped = false;
+    for (i = 0; i < n; i++) {
+        if (pops[i]) {
+            if (!popped) {
+                tap_pkt_pop(pkt);
+                popped = true;
+            }
+            tap_pkt_send(w, pids[i], vid, pkt);
+        }
+    }
+}
+
+/* Handles single packet read from TAP interface 'if_entry' and sends it
+ * to the corresponding ASIC port. */
+static void
+tap_if_handle_packet(struct tap_worker *w, const struct tap_if_entry *if_entry,
+                     FPA_PACKET_OUT_BUFFER_STC *pkt)
+{
+    struct tap_thread_counters *cnt = w->counters[TAP_DIR_TAP_TO_ASIC];
+    struct tap_info *info = w->info;
+    struct ether_header *eth_hdr;
+    uint16_t vid = 0;
+
+    if (if_entry->portNum == TAP_SVI_PORT) {
+        tap_svi_handle_packet(w, pkt);
+        return;
+    }
+
+    eth_hdr = (struct ether_header *)pkt->pktDataPtr;
+
+    /* If tagged packet from port TAP (forwarded from some vlanXXX subinterface)
+     * then check if port is member of that VLAN.
+     * If not - drop it.
+     * Also check egress tag state and decide to strip tag or not before sending to ASIC
+    */
+    if (ops_fpa_get_eth_type(pkt->pktDataPtr) == ETHERTYPE_VLAN) {
+        bool pop;
+
+        vid = ntohs(*(uint16_t*)(eth_hdr+1)) & VLAN_VID_MASK;
+        if (ops_fpa_vlan_egress_state(info->switchId, if_entry->portNum, vid, &pop)) {
+            /* No L2 group entry found for port/VID combination - dropping packet */
+            tap_pkt_drop_vlan(w, if_entry->portNum, vid, pkt);
+            return;
+        }
+
+        if (pop) {
+            tap_pkt_pop(pkt);
+        }
+    }
+    else {
+        /* Check for packet forwarded by bridge_normal from other TAP interface with SMAC different from system MAC.
+         * If detected - drop it. */
+        if (memcmp(&eth_hdr->ether_shost, &if_entry->mac, ETH_ALEN)) { /*TODO get actual TAP MAC by fd from netlink socket */
+            tap_count(cnt, TAP_CNT_DROP, if_entry->portNum, 0, 0,
+                      pkt->pktDataSize);
+            tap_trace_record(info, w->trace, TAP_DIR_TAP_TO_ASIC,
+                             TAP_TRACE_DROP_SMAC, if_entry->portNum, 0, 0, 0,
+                             pkt->pktDataPtr, pkt->pktDataSize);
+            return;
+        }
+    }
+
+    tap_pkt_send(w, if_entry->portNum, vid, pkt);
+}
+
+/* Finds TAP interface entry of TAP worker by HW port number */
+static struct tap_if_entry *
+tap_worker_if_by_port(const struct hmap *port_to_tap_if_map, uint32_t portNum)
+{
+    struct tap_if_entry *if_entry;
+
+    HMAP_FOR_EACH_WITH_HASH(if_entry, port_node, hash_int(portNum, 0),
+                            port_to_tap_if_map) {
+        if (if_entry->portNum == portNum) {
+            return if_entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Takes next packet to deliver from worker priority class queues or
+ * returns NULL if all are empty. */
+static struct tap_pbuf *
+tap_worker_sched(struct tap_worker *w, bool weighted)
+{
+    struct tap_pbuf *desc;
+    int i;
+
+    if (!weighted) {
+        /* Strict priority: lower class is served only when all higher
+         * classes are empty */
+        for (i = 0; i < TAP_PRIO_CNT; i++) {
+            desc = tap_spsc_pop(w->rx_ring[i]);
+            if (desc) {
+                return desc;
+            }
+        }
+        return NULL;
+    }
+
+    /* Weighted round robin: class in turn delivers up to its weight of
+     * packets, empty class passes its turn on. One extra step returns to
+     * the starting class with fresh credit. */
+    for (i = 0; i <= TAP_PRIO_CNT; i++) {
+        if (w->wrr_credit) {
+            desc = tap_spsc_pop(w->rx_ring[w->wrr_class]);
+            if (desc) {
+                w->wrr_credit--;
+                return desc;
+            }
+        }
+        w->wrr_class = (w->wrr_class + 1) % TAP_PRIO_CNT;
+        w->wrr_credit = tap_prio_weight[w->wrr_class];
+    }
+
+    return NULL;
+}
+
+/* Segment of TCP frame read from TAP interface */
+struct tap_gso_ctx {
+    struct tap_worker *w;
+    const struct tap_if_entry *if_entry;
+    uint64_t n_segs;
+};
+
+static void
+tap_worker_gso_send(void *aux, uint8_t *data, uint32_t len)
+{
+    struct tap_gso_ctx *ctx = aux;
+    FPA_PACKET_OUT_BUFFER_STC pkt = {0};
+
+    pkt.pktDataPtr = data;
+    pkt.pktDataSize = len;
+    tap_if_handle_packet(ctx->w, ctx->if_entry, &pkt);
+    ctx->n_segs++;
+}
+
+/* Handles frame of 'len' bytes with vnet header 'vh' read from TAP
+ * interface 'if_entry'. 'data' must have FPA_PKT_SAFEGUARD bytes of
+ * headroom. */
+static void
+tap_worker_rx_frame(struct tap_worker *w, const struct tap_if_entry *if_entry,
+                    const struct virtio_net_hdr *vh, uint8_t *data, uint32_t len)
+{
+    FPA_PACKET_OUT_BUFFER_STC pkt = {0};
+    struct timeval cur_time, delta_time;
+    int err;
+
+    pkt.pktDataPtr = data;
+    pkt.pktDataSize = len;
+
+    /* Check time */
+    if (!w->drain_started) {
+        gettimeofday(&w->drain_start, NULL);
+        w->drain_started = true;
+    }
+
+    gettimeofday(&cur_time, NULL);
+    timersub(&cur_time, &w->drain_start, &delta_time);
+
+    if (delta_time.tv_sec < OPS_FPA_TAP_DRAIN_TIME) {
+        VLOG_WARN_RL(&rl, "%s, Drain %u bytes from TAP interface '%s'",
+                     __func__, pkt.pktDataSize, if_entry->name);
+        tap_count(w->counters[TAP_DIR_TAP_TO_ASIC], TAP_CNT_DRAINED,
+                  if_entry->portNum, 0, 0, pkt.pktDataSize);
+        return;
+    }
+
+    /* Kernel leaves segmentation and checksum to us, as ASIC
+     * port does not offload them. */
+    if (vh->gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+        struct tap_gso_ctx ctx = { w, if_entry, 0 };
+
+        err = ops_fpa_gso_segment(pkt.pktDataPtr, pkt.pktDataSize,
+                                  vh, tap_worker_gso_send, &ctx);
+        if (!err) {
+            tap_stat_add(&w->stats.gso_frames, 1);
+            tap_stat_add(&w->stats.gso_segments, ctx.n_segs);
+            return;
+        }
+    } else {
+        err = ops_fpa_csum_complete(pkt.pktDataPtr, pkt.pktDataSize, vh);
+        if (!err) {
+            tap_if_handle_packet(w, if_entry, &pkt);
+            return;
+        }
+    }
+
+    tap_stat_add(&w->stats.gso_errors, 1);
+    tap_count(w->counters[TAP_DIR_TAP_TO_ASIC], TAP_CNT_DROP,
+              if_entry->portNum, 0, 0, pkt.pktDataSize);
+    VLOG_WARN_RL(&rl, "%s, Unable to offload %u bytes frame from TAP interface '%s' (gso type %d). Error(%d) - %s",
+                 __func__, pkt.pktDataSize, if_entry->name,
+                 vh->gso_type, err, strerror(err));
+}
+
+/* Gives back class slot of packet 'desc' taken from receive ring, so ASIC
+ * listener may dispatch next packet of its class to the worker */
+static inline void
+tap_worker_class_put(struct tap_worker *w, struct tap_pbuf *desc)
+{
+    uint32_t orig;
+
+    if (desc->prio != TAP_PRIO_CNT) {
+        atomic_sub_relaxed(&w->class_outstanding[desc->prio], 1, &orig);
+        desc->prio = TAP_PRIO_CNT;
+    }
+}
+
+/* Releases delivered packet 'desc' */
+static inline void
+tap_worker_desc_put(struct tap_worker *w, struct tap_pbuf *desc)
+{
+    tap_worker_class_put(w, desc);
+    tap_pbuf_unref(&w->cache, desc);
+}
+
+/* Accounts write of 'desc' to TAP interface which completed with 'err'
+ * (0 or errno value) and returns its buffer. Returns true if packet was
+ * written. */
+static bool
+tap_worker_tx_done(struct tap_worker *w, struct tap_pbuf *desc, int err)
+{
+    struct tap_thread_counters *cnt = w->counters[TAP_DIR_ASIC_TO_TAP];
+    FPA_PACKET_BUFFER_STC *pkt = &desc->pkt;
+
+    if (err) {
+        tap_stat_add(&w->stats.tx_errors, 1);
+        tap_count(cnt, err == EAGAIN ? TAP_CNT_EAGAIN : TAP_CNT_DROP,
+                  pkt->inPortNum, pkt->reason, pkt->vid, desc->len);
+        VLOG_ERR_RL(&rl, "%s, Error sending packet to TAP interface of port %d. rc(%d) - %s",
+                    __func__, pkt->inPortNum, err, strerror(err));
+    } else {
+        tap_count(cnt, TAP_CNT_FORWARDED, pkt->inPortNum, pkt->reason,
+                  pkt->vid, desc->len);
+        tap_stat_add(&w->stats.latency[tap_latency_bucket(tap_time_ns() - desc->rx_ns)], 1);
+    }
+
+    tap_trace_record(w->info, w->trace, TAP_DIR_ASIC_TO_TAP,
+                     err ? TAP_TRACE_DROP_ERROR : TAP_TRACE_FORWARDED,
+                     pkt->inPortNum, pkt->vid, pkt->reason, pkt->tableId,
+                     pkt->pktDataPtr, pkt->pktDataSize);
+
+    tap_worker_desc_put(w, desc);
+
+    return !err;
+}
+
+/* Publishes transmit queue depth of TAP interface 'if_entry' */
+static void
+tap_txq_depth_update(struct tap_worker *w, const struct tap_if_entry *if_entry)
+{
+    uint32_t max;
+
+    atomic_store_relaxed(&w->stats.txq_depth, w->txq_total);
+    atomic_store_relaxed(&w->stats.txq_port_depth[MIN(if_entry->portNum, OPS_FPA_CNT_MAX_PORTS)],
+                         if_entry->txq_len);
+    atomic_read_relaxed(&w->stats.txq_max, &max);
+    if (if_entry->txq_len > max) {
+        atomic_store_relaxed(&w->stats.txq_max, if_entry->txq_len);
+    }
+}
+
+/* Asks epoll to report when TAP interface 'if_entry' becomes writable,
+ * as long as it has queued packets. io_uring polls it once per call. */
+static void
+tap_txq_watch(struct tap_worker *w, struct tap_if_entry *if_entry, bool out)
+{
+    struct epoll_event ev;
+
+    if (w->uring) {
+        if (out) {
+            tap_uring_poll_out(w, if_entry);
+        }
+        return;
+    }
+
+    memset(&ev, 0, sizeof ev);
+    ev.events = EPOLLIN | EPOLLET | (out ? EPOLLOUT : 0);
+    ev.data.ptr = if_entry;
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, if_entry->fd, &ev) < 0) {
+        VLOG_WARN_RL(&rl, "%s, Unable to update events of TAP interface '%s'. Error(%d) - %s",
+                     __func__, if_entry->name, errno, strerror(errno));
+    }
+}
+
+/* Queues packet 'desc' which TAP interface 'if_entry' could not take.
+ * Queued packet gives back its class slot, so slow interface fills only
+ * its own transmit queue and never holds back other interfaces of the
+ * worker. Packet is dropped if the queue is full. */
+static void
+tap_txq_push(struct tap_worker *w, struct tap_if_entry *if_entry,
+             struct tap_pbuf *desc)
+{
+    struct tap_thread_counters *cnt = w->counters[TAP_DIR_ASIC_TO_TAP];
+    FPA_PACKET_BUFFER_STC *pkt = &desc->pkt;
+
+    if (if_entry->txq_len == OPS_FPA_TAP_TXQ_LEN
+        || w->txq_total == OPS_FPA_TAP_TXQ_WORKER_MAX) {
+        tap_stat_add(&w->stats.txq_drops, 1);
+        tap_worker_tx_done(w, desc, EAGAIN);
+        return;
+    }
+
+    if (!if_entry->txq_len) {
+        tap_txq_watch(w, if_entry, true);
+    }
+
+    tap_worker_class_put(w, desc);
+    if_entry->txq[(if_entry->txq_head + if_entry->txq_len) % OPS_FPA_TAP_TXQ_LEN] = desc;
+    if_entry->txq_len++;
+    w->txq_total++;
+
+    tap_stat_add(&w->stats.txq_queued, 1);
+    tap_count(cnt, TAP_CNT_QUEUED, pkt->inPortNum, pkt->reason, pkt->vid,
+              desc->len);
+    tap_txq_depth_update(w, if_entry);
+}
+
+/* Takes the oldest queued packet of TAP interface 'if_entry' */
+static struct tap_pbuf *
+tap_txq_pop(struct tap_worker *w, struct tap_if_entry *if_entry)
+{
+    struct tap_pbuf *desc = if_entry->txq[if_entry->txq_head];
+
+    if_entry->txq_head = (if_entry->txq_head + 1) % OPS_FPA_TAP_TXQ_LEN;
+    if_entry->txq_len--;
+    w->txq_total--;
+
+    return desc;
+}
+
+/* Writes packets queued to TAP interface 'if_entry' until it would block
+ * again. Returns number of packets written. */
+static uint64_t
+tap_txq_flush(struct tap_worker *w, struct tap_if_entry *if_entry)
+{
+    uint64_t n_tx = 0;
+
+    while (if_entry->txq_len) {
+        struct tap_pbuf *desc = if_entry->txq[if_entry->txq_head];
+        int ret;
+
+        do {
+            ret = writev(if_entry->fd, desc->iov, desc->iovcnt);
+        } while ((ret < 0) && (errno == EINTR));
+
+        if (ret < 0 && errno == EAGAIN) {
+            break;
+        }
+
+        tap_txq_pop(w, if_entry);
+        n_tx += tap_worker_tx_done(w, desc, ret < 0 ? errno : 0);
+    }
+
+    if (!if_entry->txq_len || w->uring) {
+        tap_txq_watch(w, if_entry, if_entry->txq_len);
+    }
+    tap_txq_depth_update(w, if_entry);
+
+    return n_tx;
+}
+
+/* Drops packets queued to TAP interface 'if_entry' which is removed */
+static void
+tap_txq_purge(struct tap_worker *w, struct tap_if_entry *if_entry)
+{
+    while (if_entry->txq_len) {
+        tap_worker_tx_done(w, tap_txq_pop(w, if_entry), ECANCELED);
+    }
+    tap_txq_depth_update(w, if_entry);
+}
+
+/* Writes packet 'desc' to TAP interface 'if_entry' with 'fd', or to SVI
+ * TAP interface 'fd' if 'if_entry' is NULL. Packet is queued if the
+ * interface is not writable or already has queued packets, so their order
+ * is kept. Returns number of packets written. */
+static uint64_t
+tap_worker_write(struct tap_worker *w, struct tap_if_entry *if_entry, int fd,
+                 struct tap_pbuf *desc)
+{
+    int ret;
+
+    if (if_entry && if_entry->txq_len) {
+        tap_txq_push(w, if_entry, desc);
+        return 0;
+    }
+
+    do {
+        ret = writev(fd, desc->iov, desc->iovcnt);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (if_entry && ret < 0 && errno == EAGAIN) {
+        tap_txq_push(w, if_entry, desc);
+        return 0;
+    }
+
+    return tap_worker_tx_done(w, desc, ret < 0 ? errno : 0);
+}
+
+#ifdef HAVE_LIBURING
+/* io_uring backend of TAP worker.
+ * Every TAP interface is read by one multishot read into buffers provided
+ * by the worker, writes of a delivery pass are submitted at once. The
+ * worker polls completion eventfd along with its other fds. */
+struct tap_uring {
+    struct io_uring ring;
+    struct io_uring_buf_ring *br;
+    char *bufs;     /* OPS_FPA_URING_RX_BUFS receive buffers */
+    int efd;        /* Signalled on completions */
+};
+
+/* Request type in low bits of user data, the rest is a pointer */
+enum tap_uring_op {
+    TAP_URING_READ,         /* TAP interface entry */
+    TAP_URING_WRITE,        /* Receive descriptor */
+    TAP_URING_POLL_OUT,     /* TAP interface entry with queued packets */
+    TAP_URING_OP_MASK = 3
+};
+
+/* Receive buffer: safeguard, vnet header and frame of max size */
+#define TAP_URING_BUF_STRIDE ROUND_UP(FPA_PKT_SAFEGUARD + OPS_FPA_GSO_MAX_LEN, CACHE_LINE_SIZE)
+#define TAP_URING_BUF_LEN    (VNET_HDR_LEN + OPS_FPA_GSO_MAX_LEN)
+
+/* Returns receive buffer 'bid'. Frame after vnet header starts at
+ * FPA_PKT_SAFEGUARD offset in its slot. */
+static uint8_t *
+tap_uring_buf(const struct tap_uring *u, unsigned int bid)
+{
+    return (uint8_t *) u->bufs + bid * TAP_URING_BUF_STRIDE
+           + FPA_PKT_SAFEGUARD - VNET_HDR_LEN;
+}
+
+/* Provides receive buffer 'bid' to kernel */
+static void
+tap_uring_buf_put(struct tap_uring *u, unsigned int bid)
+{
+    io_uring_buf_ring_add(u->br, tap_uring_buf(u, bid), TAP_URING_BUF_LEN,
+                          bid, io_uring_buf_ring_mask(OPS_FPA_URING_RX_BUFS), 0);
+    io_uring_buf_ring_advance(u->br, 1);
+}
+
+/* Creates io_uring backend for TAP worker 'id'. Returns NULL if kernel
+ * does not support it. */
+static struct tap_uring *
+tap_uring_create(int id)
+{
+    struct io_uring_probe *probe;
+    struct tap_uring *u;
+    unsigned int bid;
+    bool supported;
+    int err;
+
+    u = xzalloc(sizeof *u);
+
+    err = -io_uring_queue_init(OPS_FPA_URING_ENTRIES, &u->ring, 0);
+    if (err) {
+        goto error;
+    }
+
+    /* Multishot read is the newest operation used */
+    probe = io_uring_get_probe_ring(&u->ring);
+    supported = probe
+                && io_uring_opcode_supported(probe, IORING_OP_READ_MULTISHOT)
+                && io_uring_opcode_supported(probe, IORING_OP_WRITEV);
+    io_uring_free_probe(probe);
+    if (!supported) {
+        err = EOPNOTSUPP;
+        goto error_ring;
+    }
+
+    u->br = io_uring_setup_buf_ring(&u->ring, OPS_FPA_URING_RX_BUFS,
+                                    OPS_FPA_URING_BGID, 0, &err);
+    if (!u->br) {
+        err = -err;
+        goto error_ring;
+    }
+
+    u->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (u->efd < 0) {
+        err = errno;
+        goto error_br;
+    }
+    err = -io_uring_register_eventfd(&u->ring, u->efd);
+    if (err) {
+        goto error_efd;
+    }
+
+    u->bufs = xmalloc_cacheline(OPS_FPA_URING_RX_BUFS * TAP_URING_BUF_STRIDE);
+    for (bid = 0; bid < OPS_FPA_URING_RX_BUFS; bid++) {
+        tap_uring_buf_put(u, bid);
+    }
+
+    VLOG_INFO("TAP worker %d uses io_uring backend", id);
+    return u;
+
+error_efd:
+    close(u->efd);
+error_br:
+    io_uring_free_buf_ring(&u->ring, u->br, OPS_FPA_URING_RX_BUFS,
+                           OPS_FPA_URING_BGID);
+error_ring:
+    io_uring_queue_exit(&u->ring);
+error:
+    VLOG_WARN("TAP worker %d: io_uring backend is not available, using epoll. Error(%d) - %s",
+              id, err, strerror(err));
+    free(u);
+    return NULL;
+}
+
+static void
+tap_uring_destroy(struct tap_uring *u)
+{
+    struct io_uring_sync_cancel_reg reg;
+
+    /* Receive buffers and descriptors are released by caller, so nothing
+     * may stay in flight */
+    memset(&reg, 0, sizeof reg);
+    reg.flags = IORING_ASYNC_CANCEL_ANY;
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    io_uring_register_sync_cancel(&u->ring, &reg);
+
+    io_uring_free_buf_ring(&u->ring, u->br, OPS_FPA_URING_RX_BUFS,
+                           OPS_FPA_URING_BGID);
+    io_uring_queue_exit(&u->ring);
+    close(u->efd);
+    free_cacheline(u->bufs);
+    free(u);
+}
+
+static int
+tap_uring_efd(const struct tap_uring *u)
+{
+    return u->efd;
+}
+
+static void
+tap_uring_submit(struct tap_worker *w)
+{
+    if (io_uring_submit(&w->uring->ring) > 0) {
+        tap_stat_add(&w->stats.io_submits, 1);
+    }
+}
+
+/* Returns free submission queue entry, submitting queued ones if full */
+static struct io_uring_sqe *
+tap_uring_get_sqe(struct tap_worker *w)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = io_uring_get_sqe(&w->uring->ring);
+    if (!sqe) {
+        tap_uring_submit(w);
+        sqe = io_uring_get_sqe(&w->uring->ring);
+        ovs_assert(sqe);
+    }
+    return sqe;
+}
+
+/* Queues multishot read of TAP interface 'if_entry' */
+static void
+tap_uring_arm_read(struct tap_worker *w, struct tap_if_entry *if_entry)
+{
+    struct io_uring_sqe *sqe = tap_uring_get_sqe(w);
+
+    io_uring_prep_read_multishot(sqe, if_entry->fd, 0, 0, OPS_FPA_URING_BGID);
+    io_uring_sqe_set_data64(sqe, (uintptr_t) if_entry | TAP_URING_READ);
+}
+
+/* Queues write of 'desc' to TAP interface 'fd' */
+static void
+tap_uring_write(struct tap_worker *w, int fd, struct tap_pbuf *desc)
+{
+    struct io_uring_sqe *sqe = tap_uring_get_sqe(w);
+
+    io_uring_prep_writev(sqe, fd, desc->iov, desc->iovcnt, -1);
+    io_uring_sqe_set_data64(sqe, (uintptr_t) desc | TAP_URING_WRITE);
+}
+
+/* Queues one-shot poll for TAP interface 'if_entry' becoming writable */
+static void
+tap_uring_poll_out(struct tap_worker *w, struct tap_if_entry *if_entry)
+{
+    struct io_uring_sqe *sqe = tap_uring_get_sqe(w);
+
+    io_uring_prep_poll_add(sqe, if_entry->fd, POLLOUT);
+    io_uring_sqe_set_data64(sqe, (uintptr_t) if_entry | TAP_URING_POLL_OUT);
+}
+
+/* Handles completed reads, writes and polls. Reads which ended, e.g.
+ * because receive buffers ran out, are rearmed unless interface is
+ * removed. */
+static void
+tap_uring_complete(struct tap_worker *w)
+{
+    struct tap_uring *u = w->uring;
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    unsigned int n = 0;
+    uint64_t n_tx = 0;
+
+    io_uring_for_each_cqe(&u->ring, head, cqe) {
+        uint64_t data = io_uring_cqe_get_data64(cqe);
+        void *ptr = (void *) (uintptr_t) (data & ~(uint64_t) TAP_URING_OP_MASK);
+        struct tap_if_entry *if_entry;
+
+        n++;
+
+        if ((data & TAP_URING_OP_MASK) == TAP_URING_WRITE) {
+            struct tap_pbuf *desc = ptr;
+
+            /* Packet TAP interface could not take waits in its queue as
+             * with epoll backend */
+            if (cqe->res == -EAGAIN && desc->tx_if && !desc->tx_if->closing) {
+                tap_txq_push(w, desc->tx_if, desc);
+            } else {
+                n_tx += tap_worker_tx_done(w, desc, cqe->res < 0 ? -cqe->res : 0);
+            }
+            continue;
+        }
+
+        if_entry = ptr;
+        if ((data & TAP_URING_OP_MASK) == TAP_URING_POLL_OUT) {
+            if (!if_entry->closing && if_entry->txq_len) {
+                n_tx += tap_txq_flush(w, if_entry);
+            }
+            continue;
+        }
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t *buf = tap_uring_buf(u, bid);
+            struct virtio_net_hdr vh;
+
+            if (cqe->res > (int) VNET_HDR_LEN) {
+                memcpy(&vh, buf, VNET_HDR_LEN);
+                tap_worker_rx_frame(w, if_entry, &vh, buf + VNET_HDR_LEN,
+                                    cqe->res - VNET_HDR_LEN);
+            }
+            tap_uring_buf_put(u, bid);
+        }
+
+        if (cqe->flags & IORING_CQE_F_MORE || if_entry->closing) {
+            continue;
+        }
+        if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+            VLOG_WARN_RL(&rl, "%s, Read from TAP interface '%s' failed. Error(%d) - %s",
+                         __func__, if_entry->name, -cqe->res, strerror(-cqe->res));
+            continue;
+        }
+        tap_uring_arm_read(w, if_entry);
+    }
+    io_uring_cq_advance(&u->ring, n);
+
+    tap_stat_add(&w->stats.tx_packets, n_tx);
+}
+
+/* Cancels read, writes and poll of TAP interface 'if_entry' and handles
+ * their completions, so the entry may be freed after return */
+static void
+tap_uring_cancel(struct tap_worker *w, struct tap_if_entry *if_entry)
+{
+    struct io_uring_sync_cancel_reg reg;
+    int err;
+
+    if_entry->closing = true;
+
+    /* Requests may be still queued */
+    tap_uring_submit(w);
+
+    memset(&reg, 0, sizeof reg);
+    reg.fd = if_entry->fd;
+    reg.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    err = -io_uring_register_sync_cancel(&w->uring->ring, &reg);
+    if (err && err != ENOENT) {
+        VLOG_WARN("%s, Unable to cancel I/O of TAP interface '%s'. Error(%d) - %s",
+                  __func__, if_entry->name, err, strerror(err));
+    }
+
+    tap_uring_complete(w);
+}
+#else /* !HAVE_LIBURING */
+static struct tap_uring *
+tap_uring_create(int id)
+{
+    VLOG_WARN("TAP worker %d: io_uring backend is not built in, using epoll", id);
+    return NULL;
+}
+
+static void tap_uring_destroy(struct tap_uring *u OVS_UNUSED) { OVS_NOT_REACHED(); }
+static int tap_uring_efd(const struct tap_uring *u OVS_UNUSED) { OVS_NOT_REACHED(); }
+static void tap_uring_submit(struct tap_worker *w OVS_UNUSED) { OVS_NOT_REACHED(); }
+static void tap_uring_complete(struct tap_worker *w OVS_UNUSED) { OVS_NOT_REACHED(); }
+
+static void
+tap_uring_arm_read(struct tap_worker *w OVS_UNUSED,
+                   struct tap_if_entry *if_entry OVS_UNUSED)
+{
+    OVS_NOT_REACHED();
+}
+
+static void
+tap_uring_write(struct tap_worker *w OVS_UNUSED, int fd OVS_UNUSED,
+                struct tap_pbuf *desc OVS_UNUSED)
+{
+    OVS_NOT_REACHED();
+}
+
+static void
+tap_uring_poll_out(struct tap_worker *w OVS_UNUSED,
+                   struct tap_if_entry *if_entry OVS_UNUSED)
+{
+    OVS_NOT_REACHED();
+}
+
+static void
+tap_uring_cancel(struct tap_worker *w OVS_UNUSED,
+                 struct tap_if_entry *if_entry OVS_UNUSED)
+{
+    OVS_NOT_REACHED();
+}
+#endif /* HAVE_LIBURING */
+
+/* Writes coalesced frame to TAP interface 'owner' and accounts its
+ * packets, the oldest 'n_segs' of worker's pending ones. If interface is
+ * not writable, the packets are queued to it one by one as they came. */
+static void
+tap_worker_gro_write(void *aux, void *owner, const struct virtio_net_hdr *vh,
+                     const uint8_t *data, uint32_t len, uint32_t n_segs)
+{
+    struct tap_worker *w = aux;
+    struct tap_if_entry *if_entry = owner;
+    struct tap_pbuf **descs = w->gro_descs;
+    struct iovec iov[2];
+    uint64_t n_tx = 0;
+    uint32_t i;
+    int ret, err;
+
+    ovs_assert(n_segs <= w->gro_n);
+
+    iov[0].iov_base = CONST_CAST(struct virtio_net_hdr *, vh);
+    iov[0].iov_len = VNET_HDR_LEN;
+    iov[1].iov_base = CONST_CAST(uint8_t *, data);
+    iov[1].iov_len = len;
+
+    /* Coalescing buffer is reused right away, so frame is written
+     * directly, after packets queued before it */
+    if (w->uring) {
+        tap_uring_submit(w);
+    }
+
+    if (if_entry->txq_len) {
+        err = EAGAIN;
+    } else {
+        do {
+            ret = writev(if_entry->fd, iov, ARRAY_SIZE(iov));
+        } while ((ret < 0) && (errno == EINTR));
+        err = ret < 0 ? errno : 0;
+    }
+
+    for (i = 0; i < n_segs; i++) {
+        if (err == EAGAIN) {
+            descs[i]->tx_if = if_entry;
+            tap_txq_push(w, if_entry, descs[i]);
+        } else {
+            n_tx += tap_worker_tx_done(w, descs[i], err);
+        }
+    }
+    if (!err && n_segs > 1) {
+        tap_stat_add(&w->stats.gro_frames, 1);
+        tap_stat_add(&w->stats.gro_segments, n_segs);
+    }
+    tap_stat_add(&w->stats.tx_packets, n_tx);
+
+    w->gro_n -= n_segs;
+    memmove(descs, descs + n_segs, w->gro_n * sizeof *descs);
+}
+
+/* Delivery stage of TAP worker.
+ * Writes packets dispatched by ASIC listener to corresponding TAP
+ * interfaces in scheduling order and returns their buffers. Stops after
+ * OPS_FPA_TAP_DELIVER_BUDGET packets, so TAP interfaces of the worker
+ * are served under load too, and wakes itself up to continue. With
+ * io_uring backend writes are only queued, buffers are returned when
+ * they complete. */
+static void
+tap_worker_deliver(struct tap_worker *w, const struct hmap *port_to_tap_if_map)
+{
+    static const struct virtio_net_hdr vh_none; /* No offloads requested */
+    struct tap_thread_counters *cnt = w->counters[TAP_DIR_ASIC_TO_TAP];
+    struct tap_info *info = w->info;
+    struct tap_pbuf *desc;
+    uint64_t n_tx = 0;
+    uint64_t n_svi = 0;
+    int budget = OPS_FPA_TAP_DELIVER_BUDGET;
+    bool weighted;
+    bool gro;
+    int svi_fd;
+
+    atomic_read_relaxed(&info->sched_weighted, &weighted);
+    atomic_read_relaxed(&info->gro_enabled, &gro);
+    atomic_read_relaxed(&info->svi_fd, &svi_fd);
+
+    while ((desc = tap_worker_sched(w, weighted))) {
+        FPA_PACKET_BUFFER_STC *pkt = &desc->pkt;
+        struct iovec *iov = desc->iov;
+        struct tap_if_entry *if_entry = NULL;
+        int fd;
+
+        /* Tag is inserted after MAC addresses, EtherType is read below */
+        if (pkt->pktDataSize < ETH_HLEN) {
+            tap_stat_add(&w->stats.rx_runts, 1);
+            tap_count(cnt, TAP_CNT_DROP, pkt->inPortNum, pkt->reason,
+                      pkt->vid, pkt->pktDataSize);
+            tap_trace_record(info, w->trace, TAP_DIR_ASIC_TO_TAP,
+                             TAP_TRACE_DROP_ERROR, pkt->inPortNum, pkt->vid,
+                             pkt->reason, pkt->tableId,
+                             pkt->pktDataPtr, pkt->pktDataSize);
+            tap_worker_desc_put(w, desc);
+            goto next;
+        }
+
+        iov[0].iov_base = CONST_CAST(struct virtio_net_hdr *, &vh_none);
+        iov[0].iov_len = VNET_HDR_LEN;
+
+        if (!ops_fpa_vlan_internal(pkt->vid) && (ops_fpa_get_eth_type(pkt->pktDataPtr) != ETHERTYPE_VLAN)) {
+            /* for normal vlan need to add correct 802.1q header for vlansubintf master interface.
+             * Tag is inserted by scatter-gather write, packet data stays in place. */
+            /*TODO fill 802.1q header: CoS */
+            desc->tag[0] = htons(ETHERTYPE_VLAN);
+            desc->tag[1] = htons(pkt->vid);
+
+            iov[1].iov_base = pkt->pktDataPtr;
+            iov[1].iov_len = 2*ETH_ALEN;
+            iov[2].iov_base = desc->tag;
+            iov[2].iov_len = DOT1Q_LEN;
+            iov[3].iov_base = pkt->pktDataPtr + 2*ETH_ALEN;
+            iov[3].iov_len = pkt->pktDataSize - 2*ETH_ALEN;
+            desc->iovcnt = 4;
+            desc->len = pkt->pktDataSize + DOT1Q_LEN;
+        } else {
+            iov[1].iov_base = pkt->pktDataPtr;
+            iov[1].iov_len = pkt->pktDataSize;
+            desc->iovcnt = 2;
+            desc->len = pkt->pktDataSize;
+        }
+
+        /* SVI traffic is written to SVI TAP interface, kernel hands it to
+         * vlan subinterface by tag. Link-local control frames stay with
+         * port TAP interface, their protocols run per port. */
+        if (svi_fd >= 0 && tap_svi_vlan(info, pkt->vid)
+            && !tap_eth_is_link_local(pkt->pktDataPtr)) {
+            fd = svi_fd;
+            n_svi++;
+            goto write;
+        }
+
+        /* Find interface entry by port number */
+        if_entry = tap_worker_if_by_port(port_to_tap_if_map, pkt->inPortNum);
+        if (!if_entry) {
+            tap_stat_add(&w->stats.rx_no_if, 1);
+            tap_count(cnt, TAP_CNT_DROP, pkt->inPortNum, pkt->reason,
+                      pkt->vid, desc->len);
+            tap_trace_record(info, w->trace, TAP_DIR_ASIC_TO_TAP,
+                             TAP_TRACE_DROP_NO_IF, pkt->inPortNum, pkt->vid,
+                             pkt->reason, pkt->tableId,
+                             pkt->pktDataPtr, pkt->pktDataSize);
+            tap_worker_desc_put(w, desc);
+            goto next;
+        }
+
+        /* Send a packet to TAP interface */
+        VLOG_DBG("%s, TX packet of %d bytes to TAP interface '%s' (ingressed on port %d, vid %d)",
+            __func__, desc->len, if_entry->name, pkt->inPortNum, pkt->vid);
+
+        /* Untagged TCP segments are coalesced, the rest flushes pending
+         * coalesced frame and is written as is. Packet is kept until its
+         * frame is written. */
+        if (gro && desc->iovcnt == 2 && !if_entry->txq_len) {
+            w->gro_descs[w->gro_n++] = desc;
+            if (ops_fpa_gro_add(&w->gro, if_entry, pkt->pktDataPtr, pkt->pktDataSize)) {
+                goto next;
+            }
+            w->gro_n--;
+        }
+
+        fd = if_entry->fd;
+
+write:
+        /* Packets queued to interface go first */
+        desc->tx_if = if_entry;
+        if (w->uring && !(if_entry && if_entry->txq_len)) {
+            tap_uring_write(w, fd, desc);
+        } else {
+            n_tx += tap_worker_write(w, if_entry, fd, desc);
+        }
+
+next:
+        if (!--budget) {
+            tap_efd_signal(w->rx_efd);
+            break;
+        }
+    }
+
+    /* Nothing is held across wakeups, TAP interface may go away */
+    ops_fpa_gro_flush(&w->gro);
+
+    if (w->uring) {
+        tap_uring_submit(w);
+    }
+
+    tap_stat_add(&w->stats.tx_packets, n_tx);
+    tap_stat_add(&w->stats.svi_tx, n_svi);
+}
+
+/* Reads up to OPS_FPA_TAP_READ_BUDGET frames from TAP interface 'if_entry'
+ * of worker 'w'. Frames are read into pool buffer, TSO frames which do not
+ * fit continue in 'data' of OPS_FPA_GSO_MAX_LEN bytes and are completed
+ * there. Returns true if interface has no more frames, false if budget is
+ * exhausted. */
+static bool
+tap_worker_read_if(struct tap_worker *w, struct tap_if_entry *if_entry,
+                   struct virtio_net_hdr *vh, uint8_t *data)
+{
+    int budget;
+
+    for (budget = OPS_FPA_TAP_READ_BUDGET; budget > 0; budget--) {
+        struct tap_pbuf *desc = tap_pbuf_alloc(&w->cache);
+        uint8_t *head = data;
+        uint32_t head_len = OPS_FPA_GSO_MAX_LEN;
+        uint32_t len;
+        struct iovec iov[3];
+        int iovcnt = 2;
+        int bytes_recv;
+
+        if (desc) {
+            head = (uint8_t*)desc->buf + FPA_PKT_SAFEGUARD;
+            head_len = OPS_FPA_PBUF_SIZE - FPA_PKT_SAFEGUARD;
+            iov[2].iov_base = data + head_len;
+            iov[2].iov_len = OPS_FPA_GSO_MAX_LEN - head_len;
+            iovcnt = 3;
+        }
+        iov[0].iov_base = vh;
+        iov[0].iov_len = VNET_HDR_LEN;
+        iov[1].iov_base = head;
+        iov[1].iov_len = head_len;
+
+        do {
+            bytes_recv = readv(if_entry->fd, iov, iovcnt);
+        } while ((bytes_recv < 0) && (errno == EINTR));
+
+        if (bytes_recv <= (int) VNET_HDR_LEN) {
+            if (bytes_recv < 0 && errno != EWOULDBLOCK) {
+                VLOG_WARN_RL(&rl, "%s, Read from TAP interface '%s' failed. Error(%d) - %s",
+                             __func__, if_entry->name, errno, strerror(errno));
+            }
+            if (desc) {
+                tap_pbuf_unref(&w->cache, desc);
+            }
+            if (bytes_recv <= 0) {
+                return true;
+            }
+            continue;
+        }
+
+        len = bytes_recv - VNET_HDR_LEN;
+        if (len > head_len) {
+            memcpy(data, head, head_len);
+            head = data;
+        }
+        tap_worker_rx_frame(w, if_entry, vh, head, len);
+
+        if (desc) {
+            tap_pbuf_unref(&w->cache, desc);
+        }
+    }
+
+    return false;
+}
+
+/* TAP worker thread.
+ * Handles packets received from TAP interfaces of its ports to ASIC and
+ * packets of its ports dispatched by ASIC listener to TAP interfaces. */
+/* Closes TAP interface of worker's entry and frees it */
+static void
+tap_if_entry_close(struct tap_if_entry *if_entry)
+{
+    close(if_entry->fd);
+    free(if_entry->name);
+    free(if_entry);
+}
+
+void *
+tap_worker_main(void *arg)
+{
+    struct tap_worker *w = arg;
+    int i, n, epoll_fd;
+    struct ctrl_queue *ctrl = w->ctrl;
+    struct ctrl_cmd *cmd;
+    struct hmap fd_to_tap_if_map; /* FD to TAP interface entry map */
+    struct hmap port_to_tap_if_map; /* HW port to TAP interface entry map */
+    struct virtio_net_hdr vh;
+    uint8_t *data;
+    char *pbuf;
+    struct epoll_event ev;
+    struct epoll_event events[OPS_FPA_TAP_MAX_EVENTS];
+    struct tap_if_entry *if_entry, *next;
+    struct ovs_list ready; /* TAP interfaces with frames left to read */
+
+    VLOG_INFO("%s, Run TAP worker %d, switchId: %d, ctrl fd: %d",
+              __func__, w->id, w->info->switchId, ctrl->efd);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        VLOG_ERR("%s, epoll_create1 failed. Error(%d) - %s",
+                 __func__, errno, strerror(errno));
+        return NULL;
+    }
+    w->epoll_fd = epoll_fd;
+
+    /* Register control queue and receive ring eventfds. Control queue is
+     * the only registered fd without data, receive ring is tagged with the
+     * worker itself, the rest are TAP interface entries. */
+    memset(&ev, 0, sizeof ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ctrl->efd, &ev) < 0) {
+        VLOG_ERR("%s, Unable to register control queue %d. Error(%d) - %s",
+                 __func__, ctrl->efd, errno, strerror(errno));
+        close(epoll_fd);
+        return NULL;
+    }
+    ev.data.ptr = w;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, w->rx_efd, &ev) < 0) {
+        VLOG_ERR("%s, Unable to register receive ring %d. Error(%d) - %s",
+                 __func__, w->rx_efd, errno, strerror(errno));
+        close(epoll_fd);
+        return NULL;
+    }
+
+    /* io_uring backend if requested and supported. Its completion eventfd
+     * is tagged with the backend. */
+    if (w->info->use_uring) {
+        w->uring = tap_uring_create(w->id);
+    }
+    if (w->uring) {
+        ev.data.ptr = w->uring;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tap_uring_efd(w->uring), &ev) < 0) {
+            VLOG_ERR("%s, Unable to register io_uring completions. Error(%d) - %s",
+                     __func__, errno, strerror(errno));
+            tap_uring_destroy(w->uring);
+            w->uring = NULL;
+        }
+    }
+    atomic_store_relaxed(&w->stats.io_uring, w->uring != NULL);
+
+    /* Allocate memory for TSO frame which does not fit pool buffer */
+    pbuf = xzalloc(FPA_PKT_SAFEGUARD + OPS_FPA_GSO_MAX_LEN);
+    data = (uint8_t*)pbuf + FPA_PKT_SAFEGUARD;
+    ops_fpa_gro_init(&w->gro, tap_worker_gro_write, w);
+
+    /* Init maps */
+    hmap_init(&fd_to_tap_if_map);
+    hmap_init(&port_to_tap_if_map);
+    list_init(&ready);
+
+    /* Handling loop. */
+    for (;;) {
+        bool rx_ready = false;
+        bool io_ready = false;
+
+        /* Nothing RCU protected is held while waiting. Do not wait if
+         * TAP interfaces have frames left from the previous round. */
+        ovsrcu_quiesce_start();
+        n = epoll_wait(epoll_fd, events, ARRAY_SIZE(events),
+                       list_is_empty(&ready) ? -1 : 0);
+        ovsrcu_quiesce_end();
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VLOG_ERR("%s, epoll_wait failed. Error(%d) - %s",
+                     __func__, errno, strerror(errno));
+            goto exit;
+        }
+        tap_stat_add(&w->stats.io_wakeups, 1);
+
+        /* Firstly check control commands */
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == w) {
+                rx_ready = true;
+                continue;
+            }
+            if (w->uring && events[i].data.ptr == w->uring) {
+                io_ready = true;
+                continue;
+            }
+            if (events[i].data.ptr) {
+                continue;
+            }
+
+            ctrl_queue_clear_wakeup(ctrl);
+
+            while ((cmd = recv_ctrl_cmd(ctrl))) {
+                switch (cmd->type) {
+                    case OPS_FPA_CMD_THREAD_EXIT: {
+                        VLOG_INFO("TAP worker %d thread finished", w->id);
+                        free(cmd);
+                        goto exit;
+                    } break;
+                    case OPS_FPA_CMD_ADD_IF: {
+
+                        /* Creates new TAP info entry */
+                        if_entry = xzalloc(sizeof(* if_entry));
+                        if_entry->fd = cmd->add.fd;
+                        if_entry->portNum = cmd->add.portNum;
+                        if_entry->name = xstrdup(cmd->add.tap_if_name);
+                        memcpy(&if_entry->mac, &cmd->add.mac, ETH_ALEN);
+
+                        /* Start reading interface by io_uring or register
+                         * its fd in edge-triggered mode with direct
+                         * reference to its entry. */
+                        if (w->uring) {
+                            tap_uring_arm_read(w, if_entry);
+                        } else {
+                            memset(&ev, 0, sizeof ev);
+                            ev.events = EPOLLIN | EPOLLET;
+                            ev.data.ptr = if_entry;
+                            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, if_entry->fd, &ev) < 0) {
+                                VLOG_ERR("%s, Unable to register TAP interface '%s'. Error(%d) - %s",
+                                         __func__, if_entry->name, errno, strerror(errno));
+                            }
+                        }
+
+                        /* Inserts TAP info entry to maps */
+                        hmap_insert(&fd_to_tap_if_map, &if_entry->node, cmd->add.fd);
+                        hmap_insert(&port_to_tap_if_map, &if_entry->port_node,
+                                    hash_int(if_entry->portNum, 0));
+
+                        VLOG_INFO("%s, New TAP interface '%s' added to TAP worker %d",
+                                  __func__, if_entry->name, w->id);
+                    } break;
+                    case OPS_FPA_CMD_DEL_IF: {
+                        int k;
+
+                        /* Find interface entry by fd */
+                        if_entry = get_if_entry(&fd_to_tap_if_map, cmd->del.fd);
+                        if (!if_entry) {
+                            break;
+                        }
+
+                        /* Remove TAP info from maps */
+                        hmap_remove(&fd_to_tap_if_map, &if_entry->node);
+                        hmap_remove(&port_to_tap_if_map, &if_entry->port_node);
+
+                        /* Unregister interface fd, it is closed below.
+                         * TAP worker owns it since interface was added. */
+                        if (w->uring) {
+                            tap_uring_cancel(w, if_entry);
+                        } else {
+                            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, if_entry->fd, NULL);
+                        }
+                        tap_txq_purge(w, if_entry);
+                        if (if_entry->rx_ready) {
+                            list_remove(&if_entry->ready_node);
+                        }
+
+                        /* Forget events already reported for the entry. */
+                        for (k = 0; k < n; k++) {
+                            if (events[k].data.ptr == if_entry) {
+                                events[k].events = 0;
+                            }
+                        }
+
+                        VLOG_INFO("%s, Old TAP interface '%s' removed from TAP worker %d",
+                                  __func__, if_entry->name, w->id);
+
+                        /* Other workers write to SVI TAP interface until
+                         * they see it detached */
+                        if (if_entry->portNum == TAP_SVI_PORT) {
+                            ovsrcu_postpone(tap_if_entry_close, if_entry);
+                        } else {
+                            tap_if_entry_close(if_entry);
+                        }
+
+                    } break;
+                    default: {
+                        VLOG_ERR("%s, Invalid command type %d", __func__, cmd->type);
+                    }
+                }
+                free(cmd);
+            }
+        }
+
+        /* Deliver packets dispatched by ASIC listener */
+        if (rx_ready) {
+            tap_efd_clear(w->rx_efd);
+            tap_worker_deliver(w, &port_to_tap_if_map);
+        }
+
+        /* Handle completed io_uring reads and writes */
+        if (io_ready) {
+            tap_efd_clear(tap_uring_efd(w->uring));
+            tap_uring_complete(w);
+        }
+
+        /* Handle ready TAP interfaces only */
+        for (i = 0; i < n; i++) {
+            if_entry = events[i].data.ptr;
+            if (!if_entry || (void *) if_entry == w
+                || (void *) if_entry == w->uring) {
+                continue;
+            }
+
+            /* Interface became writable, send packets queued to it */
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)
+                && if_entry->txq_len) {
+                tap_stat_add(&w->stats.tx_packets, tap_txq_flush(w, if_entry));
+            }
+
+            if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                continue;
+            }
+
+            if (!if_entry->rx_ready) {
+                if_entry->rx_ready = true;
+                list_push_back(&ready, &if_entry->ready_node);
+            }
+        }
+
+        /* Read ready TAP interfaces in turn, so one flooding interface
+         * does not starve the others and control queue. */
+        LIST_FOR_EACH_SAFE (if_entry, next, ready_node, &ready) {
+            if (tap_worker_read_if(w, if_entry, &vh, data)) {
+                list_remove(&if_entry->ready_node);
+                if_entry->rx_ready = false;
+            }
+        }
+
+        /* Queued reads and writes */
+        if (w->uring) {
+            tap_uring_submit(w);
+        }
+    } /* for (;;) */
+
+exit:
+    /* Release memory allocated */
+    if (w->uring) {
+        tap_uring_destroy(w->uring);
+        w->uring = NULL;
     }
+    free(pbuf);
+    ops_fpa_gro_destroy(&w->gro);
+    /* TAP interfaces left are handed over to restarted workers, so their
+     * fds stay open */
+    HMAP_FOR_EACH_SAFE(if_entry, next, node, &fd_to_tap_if_map) {
+        hmap_remove(&fd_to_tap_if_map, &if_entry->node);
+        tap_txq_purge(w, if_entry);
+        free(if_entry->name);
+        free(if_entry);
+    }
+    tap_pbuf_cache_flush(&w->cache, 0);
+    hmap_destroy(&fd_to_tap_if_map);
+    hmap_destroy(&port_to_tap_if_map);
+    close(epoll_fd);
 
-    /* Get TAP interface entry for fd */
-    if_entry = get_if_entry(&info->fd_to_tap_if_map, tap_fd);
-    if (!if_entry) {
-        return ENOENT;
+    return NULL;
+}
+
+/* Receive stage of ASIC listener.
+ * Waits up to 'timeout' ms for the first packet, then drains up to
+ * OPS_FPA_RX_BURST packets without waiting into 'burst'.
+ * Returns number of packets received. */
+static size_t
+asic_rx_burst(struct tap_info *info, struct tap_pbuf *burst[],
+              uint32_t timeout)
+{
+    size_t n_rx = 0;
+
+    while (n_rx < OPS_FPA_RX_BURST) {
+        struct tap_pbuf *desc;
+        FPA_STATUS err;
+
+        /* Pool is sized so that it can't run out, see ops_fpa_tap_init() */
+        desc = tap_pbuf_alloc(&info->cache);
+        if (!desc) {
+            break;
+        }
+
+        memset(&desc->pkt, 0, sizeof desc->pkt);
+        desc->pkt.pktDataPtr = (uint8_t*)desc->buf + FPA_PKT_SAFEGUARD;
+
+        err = fpaLibPktReceive(info->switchId, n_rx ? OPS_FPA_RX_NOWAIT : timeout,
+                               &desc->pkt);
+        if (err != FPA_OK) {
+            tap_pbuf_unref(&info->cache, desc);
+            if (err == FPA_NO_MORE) { /* timeout ended */
+                VLOG_DBG("%s, wake up - no received data", __func__);
+            } else {
+                VLOG_ERR_RL(&rl, "%s, failed receive packet from FPA. Status: %s",
+                            __func__, ops_fpa_strerr(err));
+            }
+            break;
+        }
+
+        desc->rx_ns = tap_time_ns();
+        burst[n_rx++] = desc;
     }
 
-    /* Creates delete ctrl command for listener threads */
-    cmd.type = OPS_FPA_CMD_DEL_IF;
-    cmd.del.fd = tap_fd;
-    cmd.del.portNum = if_entry->portNum;
+    if (n_rx) {
+        tap_stat_add(&info->stats.rx_packets, n_rx);
+        tap_stat_add(&info->stats.rx_bursts, 1);
+    }
+
+    return n_rx;
+}
+
+/* Classifies packet received from ASIC by trap reason, ethertype,
+ * destination MAC and L4 protocol, so protocol PDUs are never queued
+ * behind data traps. */
+static enum tap_prio
+tap_classify(const FPA_PACKET_BUFFER_STC *pkt)
+{
+    const struct ether_header *eth_hdr = (const void *)pkt->pktDataPtr;
+    const uint8_t *l3 = (const uint8_t *)(eth_hdr + 1);
+    uint32_t l3_len;
+    uint16_t type;
 
-    /* Notifies all listener thread about remove TAP interface */
-    for (i = 0; i < OPS_FPA_THREAD_CNT; i++) {
-        send_ctrl_cmd(info->ctrl_fds[i][OPS_FPA_THREAD_PIPE_SEND], &cmd);
+    if (pkt->pktDataSize < sizeof *eth_hdr) {
+        return TAP_PRIO_LOW;
     }
+    l3_len = pkt->pktDataSize - sizeof *eth_hdr;
 
-    /* Remove TAP info from maps */
-    hmap_remove(&info->fd_to_tap_if_map, &if_entry->node);
+    if (tap_eth_is_link_local(eth_hdr->ether_dhost)) {
+        return TAP_PRIO_HIGH;
+    }
 
-    ops_fpa_dev_mutex_unlock();
+    type = ntohs(eth_hdr->ether_type);
+    if (type == ETHERTYPE_VLAN && l3_len >= DOT1Q_LEN) {
+        type = ntohs(*(const uint16_t *)(l3 + 2));
+        l3 += DOT1Q_LEN;
+        l3_len -= DOT1Q_LEN;
+    }
 
-    /* Try to remove interface from bridge before shutting down */
-    ops_fpa_bridge_port_rm(if_entry->name);
+    switch (type) {
+        case OPS_FPA_ETH_TYPE_SLOW:
+        case OPS_FPA_ETH_TYPE_LLDP:
+            return TAP_PRIO_HIGH;
+        case ETHERTYPE_IP: {
+            uint32_t ihl;
+            uint16_t dport, sport;
 
-    ops_fpa_system("/sbin/ifconfig %s down", if_entry->name);
+            if (l3_len < 20) {
+                break;
+            }
+            if (l3[9] == OPS_FPA_IPPROTO_OSPF || l3[9] == OPS_FPA_IPPROTO_VRRP) {
+                return TAP_PRIO_HIGH;
+            }
+            ihl = (l3[0] & 0x0f) * 4;
+            if ((l3[9] != IPPROTO_TCP && l3[9] != IPPROTO_UDP) || l3_len < ihl + 4) {
+                break;
+            }
+            sport = ntohs(*(const uint16_t *)(l3 + ihl));
+            dport = ntohs(*(const uint16_t *)(l3 + ihl + 2));
+            if (l3[9] == IPPROTO_TCP
+                && (sport == OPS_FPA_TCP_PORT_BGP || dport == OPS_FPA_TCP_PORT_BGP)) {
+                return TAP_PRIO_HIGH;
+            }
+            if (l3[9] == IPPROTO_UDP
+                && (dport == OPS_FPA_UDP_PORT_BFD || dport == OPS_FPA_UDP_PORT_BFD_ECHO)) {
+                return TAP_PRIO_HIGH;
+            }
+        } break;
+        default:
+            break;
+    }
 
-    free(if_entry->name);
+    /* Packets trapped by route lookup wait for next hop resolution */
+    if (pkt->tableId == FPA_FLOW_TABLE_TYPE_L3_UNICAST_E) {
+        return TAP_PRIO_LOW;
+    }
 
-    /* Close FD */
-    close(tap_fd);
-    free(if_entry);
+    /* Broadcast ARP requests and other flooded traffic */
+    if (eth_hdr->ether_dhost[0] & 0x01) {
+        return TAP_PRIO_LOW;
+    }
 
-    return 0;
+    return TAP_PRIO_NORMAL;
 }
 
-/* Finds TAP interface entry by key */
-struct tap_if_entry *
-get_if_entry(const struct hmap *map, int key)
+/* Dispatch stage of ASIC listener.
+ * Passes received packets to TAP workers owning their ingress ports,
+ * queued by priority class, and wakes up every worker which got packets
+ * once per burst. */
+static void
+asic_dispatch(struct tap_info *info, struct tap_pbuf *burst[], size_t n_rx)
 {
-    struct hmap_node *entry;
+    bool wakeup[OPS_FPA_TAP_WORKERS_MAX] = { false };
+    bool capture = ops_fpa_capture_enabled();
+    uint32_t max, used, outstanding;
+    size_t i;
+    int k;
+
+    for (i = 0; i < n_rx; i++) {
+        FPA_PACKET_BUFFER_STC *pkt = &burst[i]->pkt;
+        struct tap_worker *w = tap_worker_by_port(info, pkt->inPortNum);
+        enum tap_prio prio = tap_classify(pkt);
+
+        if (capture) {
+            struct ops_fpa_capture_meta meta = {
+                .inbound = true, .port = pkt->inPortNum, .vid = pkt->vid,
+                .reason = pkt->reason, .tableId = pkt->tableId,
+            };
+            ops_fpa_capture_packet(&meta, pkt->pktDataPtr, pkt->pktDataSize);
+        }
 
-    ovs_assert(map);
+        /* Worker keeps up to class depth of packets until they are
+         * delivered, so its rings always have room */
+        burst[i]->prio = prio;
+        atomic_read_relaxed(&w->class_outstanding[prio], &outstanding);
+        if (outstanding >= tap_prio_depth[prio]
+            || !tap_spsc_push(w->rx_ring[prio], burst[i])) {
+            tap_stat_add(&info->stats.rx_class_drops[prio], 1);
+            tap_count(info->counters, TAP_CNT_DROP, pkt->inPortNum,
+                      pkt->reason, pkt->vid, pkt->pktDataSize);
+            tap_trace_record(info, info->trace, TAP_DIR_ASIC_TO_TAP,
+                             TAP_TRACE_DROP_RING, pkt->inPortNum, pkt->vid,
+                             pkt->reason, pkt->tableId,
+                             pkt->pktDataPtr, pkt->pktDataSize);
+            tap_pbuf_unref(&info->cache, burst[i]);
+            continue;
+        }
 
-    entry = hmap_first_with_hash(map, key);
-    if (entry) {
-        return CONTAINER_OF(entry, struct tap_if_entry, node);
-    } else {
-       VLOG_ERR("%s: Not found TAP interface entry by key %d", __func__, key);
+        tap_stat_add(&info->stats.rx_class_packets[prio], 1);
+        atomic_add_relaxed(&w->class_outstanding[prio], 1, &outstanding);
+        wakeup[w->id] = true;
+    }
+
+    for (k = 0; k < info->n_workers; k++) {
+        struct tap_worker *w = &info->workers[k];
+        enum tap_prio prio;
+
+        if (!wakeup[k]) {
+            continue;
+        }
+
+        used = 0;
+        for (prio = 0; prio < TAP_PRIO_CNT; prio++) {
+            atomic_read_relaxed(&w->class_outstanding[prio], &outstanding);
+            used += outstanding;
+        }
+        atomic_store_relaxed(&w->stats.ring_used, used);
+        atomic_read_relaxed(&w->stats.ring_max, &max);
+        if (used > max) {
+            atomic_store_relaxed(&w->stats.ring_max, used);
+        }
+
+        tap_efd_signal(w->rx_efd);
+    }
+}
+
+/* Receives packets from ASIC and dispatches them to TAP workers */
+void *
+asic_listener(void *arg)
+{
+    struct tap_info *info = arg;
+    struct ctrl_queue *ctrl = info->ctrl;
+    struct tap_pbuf *burst[OPS_FPA_RX_BURST];
+    struct ctrl_cmd *cmd;
+    uint64_t last_rx_ns = 0;
+    uint32_t n_polls = 0;
+    uint32_t poll_us;
+    bool polling = false;
+    size_t n_rx;
+
+    VLOG_INFO("%s, Run ASIC listener, switchId: %d,  ctrl fd: %d", __func__, info->switchId, ctrl->efd);
+
+    for (;;) {
+        atomic_read_relaxed(&info->rx_poll_us, &poll_us);
+
+        if (polling) {
+            /* Busy-poll, passing quiescent state now and then whether or
+             * not packets come, so RCU grace periods never stall */
+            n_rx = asic_rx_burst(info, burst, OPS_FPA_RX_NOWAIT);
+            if (!n_rx) {
+                tap_stat_add(&info->stats.rx_polls, 1);
+            }
+            if (!(++n_polls % OPS_FPA_RX_POLL_QUIESCE)) {
+                ovsrcu_quiesce();
+            }
+        } else {
+            /* Wait for a burst of packets from ASIC */
+            ovsrcu_quiesce_start();
+            n_rx = asic_rx_burst(info, burst, OPS_FPA_RX_TIMEOUT);
+            ovsrcu_quiesce_end();
+            ctrl_queue_clear_wakeup(ctrl);
+        }
+
+        /* Poll while packets keep coming, block once traffic stops for
+         * the idle time */
+        if (n_rx) {
+            last_rx_ns = burst[n_rx - 1]->rx_ns;
+            if (!polling && poll_us) {
+                polling = true;
+                tap_stat_add(&info->stats.rx_poll_starts, 1);
+                atomic_store_relaxed(&info->stats.rx_polling, true);
+            }
+        } else if (polling
+                   && (!poll_us || tap_time_ns() - last_rx_ns >= poll_us * UINT64_C(1000))) {
+            polling = false;
+            atomic_store_relaxed(&info->stats.rx_polling, false);
+        }
+
+        /* Firstly check control commands. TAP interfaces are handled by
+         * TAP workers, so only exit is expected here. */
+        while ((cmd = recv_ctrl_cmd(ctrl))) {
+            if (cmd->type == OPS_FPA_CMD_THREAD_EXIT) {
+                VLOG_INFO("ASIC listener thread finished");
+                free(cmd);
+                tap_pbuf_cache_flush(&info->cache, 0);
+                return NULL;
+            }
+            VLOG_ERR("%s, Invalid command type %d", __func__, cmd->type);
+            free(cmd);
+        }
+
+        /* Pass received packets to TAP workers */
+        asic_dispatch(info, burst, n_rx);
     }
 
     return NULL;
 }
 
-/* Creates Linux tun/tap interface.
- *
- * Arguments taken by the function:
- * name:  The name of an interface (or '\0'). MUST have enough
- *        space to hold the interface name if '\0' is passed.
- * flags: IFF_TUN   - TUN device (no Ethernet headers)
- *        IFF_TAP   - TAP device
- *
- *        IFF_NO_PI - Do not provide packet information
- */
+/* Utility functions */
 
 int
-ops_fpa_tun_alloc(char *name, int flags)
+ops_fpa_net_if_setup(const char *name, const struct ether_addr *mac)
 {
+    int  rc = 0;
+    char buf[32] = {0};
 
-    struct ifreq ifr;
-    int fd, err;
-    static const char tun_dev[] = "/dev/net/tun";
+    /* Bring the Ethernet interface DOWN. */
+    rc = ops_fpa_system("/sbin/ifconfig %s down", name);
+    if (rc != 0) {
+        VLOG_ERR("Failed to bring down %s interface. (rc=%d)",
+                 name, rc);
+        return EFAULT;
+    }
 
-    ovs_assert(name);
+    /* Set MAC address for the Ethernet interface. */
+    rc = ops_fpa_system("/sbin/ip link set %s address %s",
+                       name, ether_ntoa_r(mac, buf));
+    if (rc != 0) {
+        VLOG_ERR("Failed to set MAC address for %s interface. (rc=%d)",
+                 name, rc);
+        return EFAULT;
+    }
 
-    /* Open the clone device */
-    fd = open(tun_dev, O_RDWR);
-    if (fd < 0) {
-        VLOG_WARN("opening \"%s\" failed: %s", tun_dev, ovs_strerror(errno));
-        return -errno;
+    VLOG_INFO("Set MAC address for %s to %s", name, buf);
+
+    /* Bring the Ethernet interface UP. */
+    rc = ops_fpa_system("/sbin/ifconfig %s up", name);
+    if (rc != 0) {
+        VLOG_ERR("Failed to bring up %s interface. (rc=%d)",
+                 name, rc);
+        return EFAULT;
     }
 
-    memset(&ifr, 0, sizeof(ifr));
-    ifr.ifr_flags = flags;
-    if (*name) {
-        /* if a device name was specified, put it in the structure; otherwise,
-         * the kernel will try to allocate the "next" device of the
-         * specified type */
-        ovs_strzcpy(ifr.ifr_name, name, sizeof ifr.ifr_name);
+    return 0;
+}
+
+/* Parses optional switch ID unixctl argument and finds its TAP info.
+ * Replies with error and returns NULL on failure. */
+static struct tap_info *
+tap_unixctl_get_info(struct unixctl_conn *conn, int argc, const char *argv[])
+{
+    struct tap_info *info;
+    int sid = FPA_DEV_SWITCH_ID_DEFAULT;
+
+    if (argc > 1 && ops_fpa_str2int(argv[1], &sid)) {
+        unixctl_command_reply_error(conn, "invalid switchId");
+        return NULL;
     }
 
-    /* try to create the device */
-    err = ioctl(fd, TUNSETIFF, &ifr);
-    if (err < 0) {
-        VLOG_WARN("%s: creating TAP device failed: %s", name,
-                  ovs_strerror(errno));
-        close(fd);
-        return -errno;
+    info = get_tap_info_by_switch_id(sid);
+    if (!info) {
+        unixctl_command_reply_error(conn, "no TAP interfaces for switch");
+    }
+
+    return info;
+}
+
+static void
+ops_fpa_tap_unixctl_stats(struct unixctl_conn *conn, int argc,
+                          const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    uint64_t rx_packets, rx_bursts, class_packets, class_drops;
+    uint64_t rx_no_if, rx_runts, tx_packets, tx_errors;
+    uint64_t gso_frames, gso_segments, gso_errors, gro_frames, gro_segments;
+    uint64_t io_wakeups, io_submits;
+    uint64_t svi_tx, svi_unicast, svi_flood, svi_flood_cut;
+    uint64_t txq_queued, txq_drops;
+    uint32_t txq_depth, txq_max;
+    uint64_t pool_refills, pool_flushes;
+    uint64_t rx_polls, rx_poll_starts;
+    uint32_t rx_poll_us;
+    bool rx_polling;
+    size_t pool_free;
+    bool io_uring;
+    uint32_t ring_used, ring_max;
+    struct tap_if_entry *e;
+    struct tap_info *info;
+    bool weighted;
+    bool gro;
+    int svi_fd;
+    int i;
+
+    ops_fpa_dev_mutex_lock();
+
+    info = tap_unixctl_get_info(conn, argc, argv);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
+
+    atomic_read_relaxed(&info->stats.rx_packets, &rx_packets);
+    atomic_read_relaxed(&info->stats.rx_bursts, &rx_bursts);
+    atomic_read_relaxed(&info->stats.rx_polls, &rx_polls);
+    atomic_read_relaxed(&info->stats.rx_poll_starts, &rx_poll_starts);
+    atomic_read_relaxed(&info->stats.rx_polling, &rx_polling);
+    atomic_read_relaxed(&info->rx_poll_us, &rx_poll_us);
+    atomic_read_relaxed(&info->sched_weighted, &weighted);
+    atomic_read_relaxed(&info->gro_enabled, &gro);
+    atomic_read_relaxed(&info->svi_fd, &svi_fd);
+    atomic_read_relaxed(&info->pool.refills, &pool_refills);
+    atomic_read_relaxed(&info->pool.flushes, &pool_flushes);
+    ovs_mutex_lock(&info->pool.mutex);
+    pool_free = info->pool.n_free;
+    ovs_mutex_unlock(&info->pool.mutex);
+
+    ds_put_format(&d_str, "CPU packet path statistics for switch %d:\n", info->switchId);
+    ds_put_format(&d_str, "  ASIC rx packets:       %"PRIu64"\n", rx_packets);
+    ds_put_format(&d_str, "  ASIC rx bursts:        %"PRIu64" (avg %.1f packets)\n",
+                  rx_bursts, rx_bursts ? (double) rx_packets / rx_bursts : 0.0);
+    if (rx_poll_us) {
+        ds_put_format(&d_str, "  ASIC rx mode:          adaptive, %"PRIu32" us idle (%s now)\n",
+                      rx_poll_us, rx_polling ? "polling" : "blocking");
+    } else {
+        ds_put_format(&d_str, "  ASIC rx mode:          blocking%s\n",
+                      rx_polling ? " (polling until idle)" : "");
+    }
+    ds_put_format(&d_str, "  ASIC rx busy-polls:    %"PRIu64" periods, %"PRIu64" empty polls\n",
+                  rx_poll_starts, rx_polls);
+    if (info->rx_cpu >= 0) {
+        ds_put_format(&d_str, "  ASIC listener CPU:     %d\n", info->rx_cpu);
+    } else {
+        ds_put_cstr(&d_str, "  ASIC listener CPU:     not bound\n");
+    }
+    ds_put_format(&d_str, "  Packet buffers:        %"PRIuSIZE" (%s), %"PRIuSIZE" free in pool, rest in use or cached\n",
+                  info->pool.size, info->pool.hugepages ? "hugepages" : "heap",
+                  pool_free);
+    ds_put_format(&d_str, "  Buffer cache batches:  %"PRIu64" refills, %"PRIu64" flushes\n",
+                  pool_refills, pool_flushes);
+    ds_put_format(&d_str, "  Scheduling:            %s\n",
+                  weighted ? "weighted" : "strict");
+    ds_put_format(&d_str, "  Receive coalescing:    %s\n", gro ? "on" : "off");
+    ds_put_format(&d_str, "  SVI delivery:          %s%s\n",
+                  tap_svi_direct() ? "direct" : "bridge",
+                  tap_svi_direct() && svi_fd < 0 ? " (no SVI TAP)" : "");
+    for (i = 0; i < TAP_PRIO_CNT; i++) {
+        atomic_read_relaxed(&info->stats.rx_class_packets[i], &class_packets);
+        atomic_read_relaxed(&info->stats.rx_class_drops[i], &class_drops);
+        ds_put_format(&d_str, "  Class %-6s           %"PRIu64" packets, %"PRIu64" drops (depth %"PRIu32")\n",
+                      tap_prio_name[i], class_packets, class_drops, tap_prio_depth[i]);
+    }
+
+    for (i = 0; i < info->n_workers; i++) {
+        struct tap_worker *w = &info->workers[i];
+        int n_ports = 0;
+
+        HMAP_FOR_EACH(e, node, &info->fd_to_tap_if_map) {
+            n_ports += tap_worker_by_port(info, e->portNum) == w;
+        }
+
+        atomic_read_relaxed(&w->stats.rx_no_if, &rx_no_if);
+        atomic_read_relaxed(&w->stats.rx_runts, &rx_runts);
+        atomic_read_relaxed(&w->stats.tx_packets, &tx_packets);
+        atomic_read_relaxed(&w->stats.tx_errors, &tx_errors);
+        atomic_read_relaxed(&w->stats.ring_used, &ring_used);
+        atomic_read_relaxed(&w->stats.ring_max, &ring_max);
+        atomic_read_relaxed(&w->stats.gso_frames, &gso_frames);
+        atomic_read_relaxed(&w->stats.gso_segments, &gso_segments);
+        atomic_read_relaxed(&w->stats.gso_errors, &gso_errors);
+        atomic_read_relaxed(&w->stats.gro_frames, &gro_frames);
+        atomic_read_relaxed(&w->stats.gro_segments, &gro_segments);
+        atomic_read_relaxed(&w->stats.io_wakeups, &io_wakeups);
+        atomic_read_relaxed(&w->stats.io_submits, &io_submits);
+        atomic_read_relaxed(&w->stats.io_uring, &io_uring);
+        atomic_read_relaxed(&w->stats.svi_tx, &svi_tx);
+        atomic_read_relaxed(&w->stats.svi_unicast, &svi_unicast);
+        atomic_read_relaxed(&w->stats.svi_flood, &svi_flood);
+        atomic_read_relaxed(&w->stats.svi_flood_cut, &svi_flood_cut);
+        atomic_read_relaxed(&w->stats.txq_queued, &txq_queued);
+        atomic_read_relaxed(&w->stats.txq_drops, &txq_drops);
+        atomic_read_relaxed(&w->stats.txq_depth, &txq_depth);
+        atomic_read_relaxed(&w->stats.txq_max, &txq_max);
+
+        ds_put_format(&d_str, "TAP worker %d (%d ports):\n", w->id, n_ports);
+        ds_put_format(&d_str, "  I/O backend:           %s (%"PRIu64" wakeups, %"PRIu64" submits)\n",
+                      io_uring ? "io_uring" : "epoll", io_wakeups, io_submits);
+        ds_put_format(&d_str, "  TAP tx packets:        %"PRIu64"\n", tx_packets);
+        ds_put_format(&d_str, "  Drops (no TAP):        %"PRIu64"\n", rx_no_if);
+        ds_put_format(&d_str, "  Drops (runt):          %"PRIu64"\n", rx_runts);
+        ds_put_format(&d_str, "  Drops (TAP write):     %"PRIu64" (%"PRIu64" TAP tx queue full)\n",
+                      tx_errors, txq_drops);
+        ds_put_format(&d_str, "  TAP tx queues:         %"PRIu32"/%d used, %"PRIu32" max per TAP (%d), %"PRIu64" queued\n",
+                      txq_depth, OPS_FPA_TAP_TXQ_WORKER_MAX, txq_max,
+                      OPS_FPA_TAP_TXQ_LEN, txq_queued);
+        HMAP_FOR_EACH(e, node, &info->fd_to_tap_if_map) {
+            uint32_t depth;
+
+            if (tap_worker_by_port(info, e->portNum) != w
+                || e->portNum >= OPS_FPA_CNT_MAX_PORTS) {
+                continue;
+            }
+            atomic_read_relaxed(&w->stats.txq_port_depth[e->portNum], &depth);
+            if (depth) {
+                ds_put_format(&d_str, "    %-19s %"PRIu32" queued\n", e->name, depth);
+            }
+        }
+        ds_put_format(&d_str, "  Rx queues:             %"PRIu32"/%d used, %"PRIu32" max\n",
+                      ring_used, OPS_FPA_RX_DEPTH_TOTAL, ring_max);
+        ds_put_format(&d_str, "  TSO frames:            %"PRIu64" (%"PRIu64" segments, %"PRIu64" errors)\n",
+                      gso_frames, gso_segments, gso_errors);
+        ds_put_format(&d_str, "  Coalesced frames:      %"PRIu64" (%"PRIu64" segments)\n",
+                      gro_frames, gro_segments);
+        ds_put_format(&d_str, "  SVI tx packets:        %"PRIu64"\n", svi_tx);
+        ds_put_format(&d_str, "  SVI rx frames:         %"PRIu64" unicast, %"PRIu64" flooded (%"PRIu64" not to all members)\n",
+                      svi_unicast, svi_flood, svi_flood_cut);
+    }
+
+    ops_fpa_dev_mutex_unlock();
+
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
+
+int
+ops_fpa_tap_cpu_stats_get(uint32_t switchId, int vid,
+                          struct ops_fpa_tap_cpu_stats *stats)
+{
+    struct tap_pkt_counters rx, tx;
+    struct tap_info *info;
+    int i;
+
+    memset(stats, 0, sizeof *stats);
+    memset(&rx, 0, sizeof rx);
+    memset(&tx, 0, sizeof tx);
+
+    /* TAP info is created and destroyed by main thread only, counters are
+     * atomic, so FPA device mutex is not needed */
+    info = get_tap_info_by_switch_id(switchId);
+    if (!info) {
+        return ENODEV;
+    }
+
+    for (i = 0; i < VLAN_BITMAP_SIZE; i++) {
+        if (vid < 0 || vid == i) {
+            int k;
+
+            tap_pkt_counters_read(&info->counters->vlan[i], &rx);
+            for (k = 0; k < info->n_workers; k++) {
+                struct tap_worker *w = &info->workers[k];
+
+                tap_pkt_counters_read(&w->counters[TAP_DIR_ASIC_TO_TAP]->vlan[i], &rx);
+                tap_pkt_counters_read(&w->counters[TAP_DIR_TAP_TO_ASIC]->vlan[i], &tx);
+            }
+        }
     }
 
-    /* Write back the name of the interface */
-    strcpy(name, ifr.ifr_name);
-    return fd;
+    /* ASIC to TAP is receive direction from host point of view */
+    atomic_read_relaxed(&rx.packets, &stats->rx_packets);
+    atomic_read_relaxed(&rx.bytes, &stats->rx_bytes);
+    atomic_read_relaxed(&rx.drops, &stats->rx_dropped);
+    atomic_read_relaxed(&tx.packets, &stats->tx_packets);
+    atomic_read_relaxed(&tx.bytes, &stats->tx_bytes);
+    atomic_read_relaxed(&tx.drops, &stats->tx_dropped);
+
+    return 0;
 }
 
-#define FPA_PKT_SAFEGUARD   32 /* offset due to bug in FPA */
-#define DOT1Q_LEN           4  /* size of 802.1q header */
+static void
+tap_counters_put(struct ds *d_str, const char *key,
+                 const struct tap_pkt_counters *cnt)
+{
+    uint64_t packets, bytes, drops, eagain, queued, drained;
+
+    atomic_read_relaxed(&cnt->packets, &packets);
+    atomic_read_relaxed(&cnt->bytes, &bytes);
+    atomic_read_relaxed(&cnt->drops, &drops);
+    atomic_read_relaxed(&cnt->eagain, &eagain);
+    atomic_read_relaxed(&cnt->queued, &queued);
+    atomic_read_relaxed(&cnt->drained, &drained);
+
+    if (packets || drops || drained) {
+        ds_put_format(d_str, "  %-22s %12"PRIu64" %14"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+                      key, packets, bytes, drops, eagain, queued, drained);
+    }
+}
 
-/* Handles packets received from TAP interfaces to corresponding ASIC */
-void *
-tap_listener(void *arg)
+/* Dumps counters of direction 'dir' summed over all threads */
+static void
+tap_counters_dump(struct ds *d_str, const char *name,
+                  const struct tap_info *info, enum tap_dir dir, bool reasons)
 {
-    uint32_t switchId;
-    int i, bytes_recv, ctrl_fd;
-    struct ctrl_cmd cmd;
-    struct tap_info *info = arg;
-    struct hmap fd_to_tap_if_map; /* FD to TAP interface entry map */
-    struct timeval init_time;
-    const uint8_t INIT_DRAIN_TIME = 5;
-    bool time_initialized = false;
-    FPA_PACKET_OUT_BUFFER_STC pkt = {0};
-    char *pbuf;
-    FPA_STATUS err;
-    fd_set rd, read_fd_set;
-    struct tap_if_entry *if_entry;
+    struct tap_thread_counters *c;
+    char key[32];
+    int port, reason, vid, i;
 
-    if (!info) {
-        VLOG_ERR("No TAP listener args specified");
-        return NULL;
+    c = xzalloc(sizeof *c);
+    if (dir == TAP_DIR_ASIC_TO_TAP) {
+        tap_thread_counters_read(info->counters, c);
+    }
+    for (i = 0; i < info->n_workers; i++) {
+        tap_thread_counters_read(info->workers[i].counters[dir], c);
     }
 
-    /* Save thread parameters */
-    switchId = info->switchId;
-    ctrl_fd = info->ctrl_fds[OPS_FPA_THREAD_TAP][OPS_FPA_THREAD_PIPE_RECV];
+    ds_put_format(d_str, "%s:\n", name);
+    ds_put_format(d_str, "  %-22s %12s %14s %10s %10s %10s %10s\n",
+                  "", "packets", "bytes", "drops", "eagain", "queued", "drained");
 
-    VLOG_INFO("%s, Run TAP listener, switchId: %d, ctrl fd: %d", __func__, switchId, ctrl_fd);
+    for (port = 0; port <= OPS_FPA_CNT_MAX_PORTS; port++) {
+        for (reason = 0; reason <= OPS_FPA_CNT_MAX_REASONS; reason++) {
+            if (port < OPS_FPA_CNT_MAX_PORTS) {
+                snprintf(key, sizeof key, "port %d", port);
+            } else {
+                snprintf(key, sizeof key, "port other");
+            }
+            if (reasons) {
+                size_t len = strlen(key);
+                if (reason < OPS_FPA_CNT_MAX_REASONS) {
+                    snprintf(key + len, sizeof key - len, " reason %d", reason);
+                } else {
+                    snprintf(key + len, sizeof key - len, " reason other");
+                }
+            }
+            tap_counters_put(d_str, key, &c->port[port][reason]);
+        }
+    }
 
-    /* Allocate memory for single packet */
-    pbuf = xzalloc(FPA_HAL_MAX_MTU_CNS * sizeof(uint8_t));
+    for (vid = 0; vid < VLAN_BITMAP_SIZE; vid++) {
+        snprintf(key, sizeof key, "vlan %d", vid);
+        tap_counters_put(d_str, key, &c->vlan[vid]);
+    }
 
-    /* Init map */
-    hmap_init(&fd_to_tap_if_map);
+    free(c);
+}
 
-    /* Register control pipe fd in read_fd_set */
-    FD_ZERO(&read_fd_set);
-    FD_SET(ctrl_fd, &read_fd_set);
+static void
+ops_fpa_tap_unixctl_counters(struct unixctl_conn *conn, int argc,
+                             const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    struct tap_info *info;
 
-    /* Handling loop. */
-    for (;;) {
+    ops_fpa_dev_mutex_lock();
 
-        /* Copies read fd set */
-        rd = read_fd_set;
+    info = tap_unixctl_get_info(conn, argc, argv);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
 
-        if (select(FD_SETSIZE, &rd, NULL, NULL, NULL) < 0) {
-            VLOG_ERR("%s, Select failed. Error(%d) - %s",
-                     __func__, errno, strerror(errno));
-            if (errno == EINTR)
-                goto exit;
-        }
+    tap_counters_dump(&d_str, "ASIC to TAP", info, TAP_DIR_ASIC_TO_TAP, true);
+    tap_counters_dump(&d_str, "TAP to ASIC", info, TAP_DIR_TAP_TO_ASIC, false);
 
-        /* Firstly check control commands */
-        if (FD_ISSET(ctrl_fd, &rd)) {
+    ops_fpa_dev_mutex_unlock();
 
-            while (recv_ctrl_cmd(ctrl_fd, &cmd) == sizeof(struct ctrl_cmd)) {
-                switch (cmd.type) {
-                    case OPS_FPA_CMD_THREAD_EXIT: {
-                        VLOG_INFO("TAP listener thread finished");
-                        goto exit;
-                    } break;
-                    case OPS_FPA_CMD_ADD_IF: {
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
 
-                        /* Creates new TAP info entry */
-                        if_entry = xzalloc(sizeof(* if_entry));
-                        if_entry->portNum = cmd.add.portNum;
-                        if_entry->name = xstrdup(cmd.add.tap_if_name);
-                        memcpy(&if_entry->mac, &cmd.add.mac, ETH_ALEN);
+static const char *
+tap_trace_verdict_str(uint8_t verdict)
+{
+    switch (verdict) {
+        case TAP_TRACE_FORWARDED: return "forwarded";
+        case TAP_TRACE_DROP_VLAN: return "drop:vlan";
+        case TAP_TRACE_DROP_SMAC: return "drop:smac";
+        case TAP_TRACE_DROP_NO_IF: return "drop:no-tap";
+        case TAP_TRACE_DROP_ERROR: return "drop:error";
+        case TAP_TRACE_DROP_RING: return "drop:ring-full";
+        default: break;
+    }
+    return "invalid";
+}
 
-                        /* Inserts TAP info entry to map */
-                        hmap_insert(&fd_to_tap_if_map, &if_entry->node, cmd.add.fd);
+static void
+tap_trace_dump_ring(struct ds *d_str, const char *name,
+                    const struct tap_trace_ring *ring)
+{
+    struct tap_trace_rec *recs;
+    uint64_t head, start, valid, i;
+
+    /* Snapshot records without stopping the writer. Records which may
+     * have been overwritten during copy are skipped, including the slot
+     * the writer may be filling in past the second head read. */
+    recs = xmalloc(sizeof ring->rec);
+    atomic_read_explicit(&ring->head, &head, memory_order_acquire);
+    start = head > OPS_FPA_TRACE_RING_SIZE ? head - OPS_FPA_TRACE_RING_SIZE : 0;
+    for (i = start; i < head; i++) {
+        recs[i - start] = ring->rec[i & (OPS_FPA_TRACE_RING_SIZE - 1)];
+    }
+    atomic_thread_fence(memory_order_acquire); /* Copy before 'head' read */
+    atomic_read_relaxed(&ring->head, &valid);
+    valid = valid >= OPS_FPA_TRACE_RING_SIZE ? valid - OPS_FPA_TRACE_RING_SIZE + 1 : 0;
+
+    ds_put_format(d_str, "%s: %"PRIu64" packets traced\n", name, head);
+    for (i = MAX(start, valid); i < head; i++) {
+        const struct tap_trace_rec *rec = &recs[i - start];
+        const struct ether_header *eth_hdr = (const void *)rec->data;
+        int j;
+
+        ds_put_format(d_str, "  %"PRIu64".%09"PRIu64" %s port %"PRIu32" vid %"PRIu16,
+                      rec->time_ns / UINT64_C(1000000000), rec->time_ns % UINT64_C(1000000000),
+                      rec->dir == TAP_DIR_ASIC_TO_TAP ? "asic->tap" : "tap->asic",
+                      rec->port, rec->vid);
+        if (rec->dir == TAP_DIR_ASIC_TO_TAP) {
+            ds_put_format(d_str, " reason %"PRIu32" table %"PRIu32,
+                          rec->reason, rec->tableId);
+        }
+        ds_put_format(d_str, " len %"PRIu16" %s\n", rec->len,
+                      tap_trace_verdict_str(rec->verdict));
+
+        if (rec->data_len >= sizeof *eth_hdr) {
+            ds_put_format(d_str, "    "ETH_ADDR_FMT" > "ETH_ADDR_FMT" type 0x%04x\n",
+                          ETH_ADDR_BYTES_ARGS(eth_hdr->ether_shost),
+                          ETH_ADDR_BYTES_ARGS(eth_hdr->ether_dhost),
+                          ntohs(eth_hdr->ether_type));
+        }
+        ds_put_cstr(d_str, "   ");
+        for (j = 0; j < rec->data_len; j++) {
+            ds_put_format(d_str, " %02"PRIx8, rec->data[j]);
+        }
+        ds_put_char(d_str, '\n');
+    }
 
-                        /* Register interface fd in TAP read_fd_set. */
-                        FD_SET(cmd.add.fd, &read_fd_set);
+    free(recs);
+}
 
-                        VLOG_INFO("%s, New TAP interface '%s' added to TAP listener", __func__, if_entry->name);
-                    } break;
-                    case OPS_FPA_CMD_DEL_IF: {
+static void
+ops_fpa_tap_unixctl_trace(struct unixctl_conn *conn, int argc,
+                          const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    struct tap_info *info;
 
-                        /* Find interface entry by fd */
-                        if_entry = get_if_entry(&fd_to_tap_if_map, cmd.del.fd);
-                        if (!if_entry) {
-                            continue;
-                        }
+    ops_fpa_dev_mutex_lock();
 
-                        /* Remove TAP info from map */
-                        hmap_remove(&fd_to_tap_if_map, &if_entry->node);
+    info = tap_unixctl_get_info(conn, argc - 1, argv + 1);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
 
-                        /* Clear interface socket in TAP read_fd_set. */
-                        FD_CLR(cmd.del.fd, &read_fd_set);
+    if (!strcmp(argv[1], "on")) {
+        atomic_store_relaxed(&info->trace_enabled, true);
+        ds_put_cstr(&d_str, "Packet trace enabled");
+    } else if (!strcmp(argv[1], "off")) {
+        atomic_store_relaxed(&info->trace_enabled, false);
+        ds_put_cstr(&d_str, "Packet trace disabled");
+    } else if (!strcmp(argv[1], "dump")) {
+        int i;
+
+        tap_trace_dump_ring(&d_str, "ASIC listener", info->trace);
+        for (i = 0; i < info->n_workers; i++) {
+            char name[32];
+
+            snprintf(name, sizeof name, "TAP worker %d", i);
+            tap_trace_dump_ring(&d_str, name, info->workers[i].trace);
+        }
+    } else {
+        ops_fpa_dev_mutex_unlock();
+        unixctl_command_reply_error(conn, "expected on, off or dump");
+        ds_destroy(&d_str);
+        return;
+    }
 
-                        VLOG_INFO("%s, Old TAP interface '%s' removed from TAP listener", __func__, if_entry->name);
+    ops_fpa_dev_mutex_unlock();
 
-                        free(if_entry->name);
-                        free(if_entry);
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
 
-                    } break;
-                    default: {
-                        VLOG_ERR("%s, Invalid command type %d", __func__, cmd.type);
-                    }
-                }
-            }
-        }
+static void
+ops_fpa_tap_unixctl_sched(struct unixctl_conn *conn, int argc,
+                          const char *argv[], void *aux OVS_UNUSED)
+{
+    struct tap_info *info;
+    bool weighted;
 
-        /* TODO: need create cycle only for read_fd_set FD */
-        for (i = 0; i < FD_SETSIZE; i++) {
-            if (FD_ISSET(i, &rd) && i != ctrl_fd) {
+    if (!strcmp(argv[1], "strict")) {
+        weighted = false;
+    } else if (!strcmp(argv[1], "weighted")) {
+        weighted = true;
+    } else {
+        unixctl_command_reply_error(conn, "expected strict or weighted");
+        return;
+    }
 
-                struct timeval cur_time, delta_time;
-                struct ether_header *eth_hdr;
-                uint16_t eth_type;
+    ops_fpa_dev_mutex_lock();
 
-                pkt.pktDataPtr = (uint8_t*)pbuf + FPA_PKT_SAFEGUARD;
+    info = tap_unixctl_get_info(conn, argc - 1, argv + 1);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
+    atomic_store_relaxed(&info->sched_weighted, weighted);
 
-                do {
-                    bytes_recv = read(i, pkt.pktDataPtr,
-                                      FPA_HAL_MAX_MTU_CNS * sizeof(uint8_t));
-                } while ((bytes_recv < 0) && (errno == EINTR));
+    ops_fpa_dev_mutex_unlock();
 
-                if ((bytes_recv < 0) && (errno != EWOULDBLOCK)) {
-                    VLOG_WARN("%s, Read from recv socket failed. Error(%d) - %s",
-                              __func__, errno, strerror(errno));
-                    continue;
-                }
-                pkt.pktDataSize = bytes_recv;
+    unixctl_command_reply(conn, weighted ? "Weighted CPU queue scheduling"
+                                         : "Strict priority CPU queue scheduling");
+}
 
-               /* Find interface entry by fd */
-                if_entry = get_if_entry(&fd_to_tap_if_map, i);
-                if (!if_entry) {
-                    continue;
-                }
+static void
+ops_fpa_tap_unixctl_gro(struct unixctl_conn *conn, int argc,
+                        const char *argv[], void *aux OVS_UNUSED)
+{
+    struct tap_info *info;
+    bool enable;
 
-                /* Check time */
-                if (!time_initialized) {
-                    gettimeofday(&init_time, NULL);
-                    time_initialized = true;
-                }
+    if (!strcmp(argv[1], "on")) {
+        enable = true;
+    } else if (!strcmp(argv[1], "off")) {
+        enable = false;
+    } else {
+        unixctl_command_reply_error(conn, "expected on or off");
+        return;
+    }
 
-                gettimeofday(&cur_time, NULL);
-                timersub(&cur_time, &init_time, &delta_time);
+    ops_fpa_dev_mutex_lock();
 
-                if (delta_time.tv_sec < INIT_DRAIN_TIME) {
-                    VLOG_WARN_RL(&rl, "%s, Drain %u bytes from TAP interface '%s'",
-                                 __func__, pkt.pktDataSize, if_entry->name);
-                    continue;
-                }
+    info = tap_unixctl_get_info(conn, argc - 1, argv + 1);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
+    atomic_store_relaxed(&info->gro_enabled, enable);
 
-                eth_hdr = (struct ether_header *)pkt.pktDataPtr;
-                eth_type = ops_fpa_get_eth_type(pkt.pktDataPtr);
-                VLOG_INFO("%s, RX packet of %d bytes (dst: "ETH_ADDR_FMT" src: "ETH_ADDR_FMT" type: 0x%04x)"
-                                  " on TAP '%s'\n  data: "OPS_FPA_PRINT_10_BYTES_FMT,
-                         __func__, pkt.pktDataSize,
-                         ETH_ADDR_BYTES_ARGS(eth_hdr->ether_dhost),
-                         ETH_ADDR_BYTES_ARGS(eth_hdr->ether_shost),
-                         eth_type,
-                         if_entry->name,
-                         OPS_FPA_PRINT_10_BYTES_ARGS((uint8_t*)eth_hdr+sizeof(struct ether_header)));
-
-                /* If tagged packet from port TAP (forwarded from some vlanXXX subinterface)
-                 * then check if port is member of that VLAN.
-                 * If not - drop it.
-                 * Also check egress tag state and decide to strip tag or not before sending to ASIC
-                */
-                if (eth_type == ETHERTYPE_VLAN) {
-                    uint16_t vid = ntohs(*(uint16_t*)(eth_hdr+1));
-                    bool pop;
-                    int err;
-
-                    err = get_port_eg_tag_state(switchId, if_entry->portNum, vid, &pop);
-                    if (!err) {
-                        VLOG_INFO("---> get_eg_tag_state_by_port: popTag:%d for vid %d and portNum %d", /* need to know if need to strip VLAN tag */
-                            pop, vid, if_entry->portNum);
-                    }
-                    else {
-                        /* No L2 group entry found for port/VID combination - dropping packet */
-                        VLOG_INFO("---> packet DROPPED: pid %d, vid %d",
-                            if_entry->portNum, vid);
-                        continue;
-                    }
+    ops_fpa_dev_mutex_unlock();
 
-                    if (pop) {
-                        VLOG_INFO("%s, tagged frame detected - stripping", __func__);
-                        memmove((uint8_t*)eth_hdr+DOT1Q_LEN, eth_hdr, 2*ETH_ALEN);
-                        pkt.pktDataPtr += DOT1Q_LEN;
-                        pkt.pktDataSize -= DOT1Q_LEN;
-                    }
-                }
-                else {
-                    /* Check for packet forwarded by bridge_normal from other TAP interface with SMAC different from system MAC.
-                     * If detected - drop it. */
-                    if (memcmp(&eth_hdr->ether_shost, &if_entry->mac, ETH_ALEN)) { /*TODO get actual TAP MAC by fd from netlink socket */
-                        continue;
-                    }
+    unixctl_command_reply(conn, enable ? "Receive coalescing enabled"
+                                       : "Receive coalescing disabled");
+}
 
-                }
+static void
+ops_fpa_tap_unixctl_rx_poll(struct unixctl_conn *conn, int argc,
+                            const char *argv[], void *aux OVS_UNUSED)
+{
+    struct tap_info *info;
+    int idle_us = 0;
 
-                pkt.outPortNum = if_entry->portNum;
-
-                eth_hdr = (struct ether_header *)pkt.pktDataPtr;
-                VLOG_INFO("%s, TX %d bytes (dst: "ETH_ADDR_FMT" src: "ETH_ADDR_FMT" type: 0x%04x)" /*TODO to be reverted to VLOG_INFO_RL after debug */
-                          " to ASIC port %d\n  data: "OPS_FPA_PRINT_10_BYTES_FMT,
-                 __func__, pkt.pktDataSize,
-                 ETH_ADDR_BYTES_ARGS(eth_hdr->ether_dhost),
-                 ETH_ADDR_BYTES_ARGS(eth_hdr->ether_shost),
-                 ntohs(eth_hdr->ether_type),
-                 pkt.outPortNum,
-                 OPS_FPA_PRINT_10_BYTES_ARGS((uint8_t*)eth_hdr+sizeof(struct ether_header)));
-
-                /* Send packet to ASIC */
-                err = fpaLibPortPktSend(switchId, FPA_INVALID_INTF_ID, &pkt);
-                if (err != FPA_OK) {
-                    VLOG_ERR("%s, fpaLibPortPktSend: failed send packet for TAP '%s', portNum %d. Status: %s",
-                             __func__, if_entry->name, if_entry->portNum, ops_fpa_strerr(err));
-                }
-            } /* if (FD_ISSET (i, &rd) */
-        } /* for (i = 0; i < FD_SETSIZE; i++) */
-    } /* while (1) */
+    if (strcmp(argv[1], "off")
+        && (ops_fpa_str2int(argv[1], &idle_us) || idle_us <= 0)) {
+        unixctl_command_reply_error(conn, "expected off or idle time in microseconds");
+        return;
+    }
 
-exit:
-    /* Release memory allocated */
-    free(pbuf);
-    hmap_destroy(&fd_to_tap_if_map);
+    ops_fpa_dev_mutex_lock();
 
-    return NULL;
+    info = tap_unixctl_get_info(conn, argc - 1, argv + 1);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
+    atomic_store_relaxed(&info->rx_poll_us, idle_us);
+
+    ops_fpa_dev_mutex_unlock();
+
+    unixctl_command_reply(conn, idle_us ? "ASIC receive busy-polls until idle"
+                                        : "ASIC receive blocks");
 }
 
-/* Handles packets received from ASIC to corresponding TAP interfaces */
-void *
-asic_listener(void *arg)
+static void
+ops_fpa_tap_unixctl_rx_cpu(struct unixctl_conn *conn, int argc,
+                           const char *argv[], void *aux OVS_UNUSED)
 {
-    int ret, ctrl_fd;
-    FPA_STATUS err;
-    FPA_PACKET_BUFFER_STC pkt = {0};
-    uint32_t timeout = 10000; /* timeout (in ms) to wait until event occure */
-    struct hmap port_num_to_tap_if_map; /* HW port number to TAP interface entry map */
-    struct tap_info *info = arg;
-    struct tap_if_entry *if_entry;
-    struct ctrl_cmd cmd;
-    uint32_t switchId;
-    char *pbuf;
+    struct tap_info *info;
+    cpu_set_t cpus;
+    int cpu = -1;
+    int err;
 
-    if (!info) {
-        VLOG_ERR("No ASIC listener args specified");
-        return NULL;
+    if (strcmp(argv[1], "none")
+        && (ops_fpa_str2int(argv[1], &cpu) || cpu < 0 || cpu >= CPU_SETSIZE)) {
+        unixctl_command_reply_error(conn, "expected CPU number or none");
+        return;
     }
 
-    /* Save thread parameters */
-    switchId = info->switchId;
-    ctrl_fd = info->ctrl_fds[OPS_FPA_THREAD_ASIC][OPS_FPA_THREAD_PIPE_RECV];
+    ops_fpa_dev_mutex_lock();
 
-    VLOG_INFO("%s, Run ASIC listener, switchId: %d,  ctrl fd: %d", __func__, switchId, ctrl_fd);
+    info = tap_unixctl_get_info(conn, argc - 1, argv + 1);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
 
-    /* Allocate memory for single packet */
-    pbuf = xzalloc(FPA_HAL_MAX_MTU_CNS * sizeof(uint8_t));
+    if (cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+    } else {
+        cpus = info->rx_cpus_dflt;
+    }
+    err = pthread_setaffinity_np(info->thread, sizeof cpus, &cpus);
+    if (!err) {
+        info->rx_cpu = cpu;
+    }
 
-    /* Init map */
-    hmap_init(&port_num_to_tap_if_map);
+    ops_fpa_dev_mutex_unlock();
 
-    for (;;) {
-        struct ether_header *eth_hdr;
-        uint16_t eth_type;
+    if (err) {
+        unixctl_command_reply_error(conn, ovs_strerror(err));
+    } else {
+        unixctl_command_reply(conn, cpu >= 0 ? "ASIC listener bound to CPU"
+                                             : "ASIC listener not bound");
+    }
+}
 
-        pkt.pktDataPtr = (uint8_t*)pbuf + FPA_PKT_SAFEGUARD;
-        /* Wait single packet from ASIC */
-        err = fpaLibPktReceive(switchId, timeout, &pkt);
+/* Dumps histogram of time from ASIC receive to TAP write since last
+ * clear, or clears it */
+static void
+ops_fpa_tap_unixctl_latency(struct unixctl_conn *conn, int argc,
+                            const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    uint64_t hist[OPS_FPA_LAT_BUCKETS] = { 0 };
+    uint64_t total = 0, sum = 0;
+    struct tap_info *info;
+    bool clear;
+    int i, k;
 
-        /* Firstly check control commands */
-        while (recv_ctrl_cmd(ctrl_fd, &cmd) == sizeof(struct ctrl_cmd)) {
-            switch (cmd.type) {
-                case OPS_FPA_CMD_THREAD_EXIT: {
-                    VLOG_INFO("ASIC listener thread finished");
-                    goto exit;
-                } break;
-                case OPS_FPA_CMD_ADD_IF: {
-
-                    /* Creates new TAP info entry */
-                    if_entry = xzalloc(sizeof(* if_entry));
-                    if_entry->fd = cmd.add.fd;
-                    if_entry->name = xstrdup(cmd.add.tap_if_name);
-                    memcpy(&if_entry->mac, &cmd.add.mac, ETH_ALEN);
-
-                    /* Inserts TAP info entry to map */
-                    hmap_insert(&port_num_to_tap_if_map, &if_entry->node, cmd.add.portNum);
-
-                    VLOG_INFO("%s, New TAP interface '%s' added to ASIC listener", __func__, if_entry->name);
-                } break;
-                case OPS_FPA_CMD_DEL_IF: {
-
-                    /* Find interface entry by port number */
-                    if_entry = get_if_entry(&port_num_to_tap_if_map, cmd.del.portNum);
-                    if (!if_entry) {
-                        continue;
-                    }
+    if (!strcmp(argv[1], "show")) {
+        clear = false;
+    } else if (!strcmp(argv[1], "clear")) {
+        clear = true;
+    } else {
+        unixctl_command_reply_error(conn, "expected show or clear");
+        return;
+    }
 
-                    /* Remove TAP info from map */
-                    hmap_remove(&port_num_to_tap_if_map, &if_entry->node);
+    ops_fpa_dev_mutex_lock();
 
-                    VLOG_INFO("%s, Old TAP interface '%s' removed from ASIC listener", __func__, if_entry->name);
+    info = tap_unixctl_get_info(conn, argc - 1, argv + 1);
+    if (!info) {
+        ops_fpa_dev_mutex_unlock();
+        return;
+    }
 
-                    free(if_entry->name);
-                    free(if_entry);
+    /* Workers own the histogram, clear only moves the base line */
+    for (i = 0; i < OPS_FPA_LAT_BUCKETS; i++) {
+        uint64_t value;
 
-                 } break;
-                 default: {
-                     VLOG_ERR("%s, Invalid command type %d", __func__, cmd.type);
-                 }
-            }
+        for (k = 0; k < info->n_workers; k++) {
+            atomic_read_relaxed(&info->workers[k].stats.latency[i], &value);
+            hist[i] += value;
         }
-
-        if (err == FPA_NO_MORE) { /* timeout ended */
-            VLOG_DBG("%s, wake up - no received data", __func__);
-            continue;
+        if (clear) {
+            info->latency_base[i] = hist[i];
         }
+        hist[i] -= info->latency_base[i];
+        total += hist[i];
+    }
 
-        if (err != FPA_OK) {
-            VLOG_ERR("%s, failed receive packet from FPA. Status: %s", __func__, ops_fpa_strerr(err));
-            continue;
-        }
+    ops_fpa_dev_mutex_unlock();
 
-        if (!ops_fpa_vlan_internal(pkt.vid) && (ops_fpa_get_eth_type(pkt.pktDataPtr) != ETHERTYPE_VLAN)) {
-            /* for normal vlan need to add correct 802.1q header for vlansubintf master interface*/
-            eth_hdr = (struct ether_header *)pkt.pktDataPtr;
-            memmove((uint8_t*)eth_hdr-DOT1Q_LEN, eth_hdr, 2*ETH_ALEN);
-            pkt.pktDataPtr -= DOT1Q_LEN;
-            pkt.pktDataSize += DOT1Q_LEN;
-            /*TODO fill 802.1q header: CoS */
-            eth_hdr = (struct ether_header *)pkt.pktDataPtr;
-            eth_hdr->ether_type = htons(ETHERTYPE_VLAN);
-            *(uint16_t *)((char *)eth_hdr + sizeof(struct ether_header)) = htons(pkt.vid);
-            VLOG_INFO("%s, added 802.1q header VID: %d", __func__, pkt.vid);
-        }
+    if (clear) {
+        unixctl_command_reply(conn, "Latency histogram cleared");
+        return;
+    }
 
-        /* Find interface entry by port number */
-        if_entry = get_if_entry(&port_num_to_tap_if_map, pkt.inPortNum);
-        if (!if_entry) {
+    ds_put_format(&d_str, "ASIC receive to TAP write latency, %"PRIu64" packets:\n", total);
+    for (i = 0; i < OPS_FPA_LAT_BUCKETS; i++) {
+        char range[32];
+
+        if (!hist[i]) {
             continue;
         }
+        if (!i) {
+            snprintf(range, sizeof range, "< 1 us");
+        } else if (i == OPS_FPA_LAT_BUCKETS - 1) {
+            snprintf(range, sizeof range, ">= %"PRIu64" us", UINT64_C(1) << (i - 1));
+        } else {
+            snprintf(range, sizeof range, "%"PRIu64"-%"PRIu64" us",
+                     UINT64_C(1) << (i - 1), UINT64_C(1) << i);
+        }
+        sum += hist[i];
+        ds_put_format(&d_str, "  %-16s %12"PRIu64" %6.2f%%\n",
+                      range, hist[i], 100.0 * sum / total);
+    }
 
-        /* Send a packet to TAP interface */
-        VLOG_DBG("%s, TX packet of %d bytes to TAP interface '%s' (ingressed on port %d, vid %d)",
-            __func__, pkt.pktDataSize, if_entry->name, pkt.inPortNum, pkt.vid);
-
-        eth_hdr = (struct ether_header *)pkt.pktDataPtr;
-        eth_type = ops_fpa_get_eth_type(pkt.pktDataPtr);
-        VLOG_INFO("%s, TX packet of bytes:%d (ingressed on port:%d, vid:%d, reason:%d tableId:%d (dst: " /*TODO to be changed to VLOG_INFO_Rl */
-                     ETH_ADDR_FMT" src: "ETH_ADDR_FMT" type: 0x%04x) to TAP '%s'\n  data:"OPS_FPA_PRINT_10_BYTES_FMT,
-                     __func__, pkt.pktDataSize,
-                     pkt.inPortNum, pkt.vid, pkt.reason, pkt.tableId,
-                     ETH_ADDR_BYTES_ARGS(eth_hdr->ether_dhost),
-                     ETH_ADDR_BYTES_ARGS(eth_hdr->ether_shost),
-                     eth_type,
-                     if_entry->name,
-                     OPS_FPA_PRINT_10_BYTES_ARGS((uint8_t*)eth_hdr+sizeof(struct ether_header)));
-
-        do {
-            ret = write(if_entry->fd, pkt.pktDataPtr, pkt.pktDataSize);
-        } while ((ret < 0) && (errno == EINTR));
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
 
-        if (ret < 0) {
-            VLOG_ERR_RL(&rl, "%s, Error sending packet to TAP interface '%s'. rc(%d) - %s",
-                        __func__, if_entry->name, errno, strerror(errno));
+/* Sets 'key' of CPU path configuration 'cfg' to 'value'. Returns false if
+ * key or value is invalid. */
+static bool
+tap_config_set(struct tap_config *cfg, const char *key, const char *value)
+{
+    int n;
+
+    if (!strcmp(key, "workers")) {
+        if (!strcmp(value, "auto")) {
+            cfg->n_workers = 0;
+        } else if (!ops_fpa_str2int(value, &n)
+                   && n > 0 && n <= OPS_FPA_TAP_WORKERS_MAX) {
+            cfg->n_workers = n;
+        } else {
+            return false;
+        }
+    } else if (!strcmp(key, "io")) {
+        if (strcmp(value, "epoll") && strcmp(value, "uring")) {
+            return false;
+        }
+        cfg->use_uring = !strcmp(value, "uring");
+    } else if (!strcmp(key, "pbuf-mem")) {
+        if (strcmp(value, "heap") && strcmp(value, "hugepages")) {
+            return false;
+        }
+        cfg->hugepages = !strcmp(value, "hugepages");
+    } else if (!strcmp(key, "svi-mode")) {
+        if (strcmp(value, "bridge") && strcmp(value, "direct")) {
+            return false;
         }
+        cfg->svi_direct = !strcmp(value, "direct");
+    } else {
+        return false;
     }
 
-exit:
-    /* Release memory from single packet */
-    free(pbuf);
-    hmap_destroy(&port_num_to_tap_if_map);
-
-    return NULL;
+    return true;
 }
 
-/* Utility functions */
-
-/* getting FPA to get egress tag state on ASIC port */
-int
-get_port_eg_tag_state(uint32_t switchId, uint32_t portNum, uint16_t vlanId, bool *pop_tag)
+/* Shows CPU path configuration or changes it. Threads of running switch
+ * are restarted if number of workers, TAP I/O backend or packet buffer
+ * memory is changed. */
+static void
+ops_fpa_tap_unixctl_config(struct unixctl_conn *conn, int argc,
+                           const char *argv[], void *aux OVS_UNUSED)
 {
-    uint32_t gid;
-    FPA_STATUS err;
-    FPA_GROUP_BUCKET_ENTRY_STC bucket;
-
-    FPA_GROUP_ENTRY_IDENTIFIER_STC ident = {
-        .groupType = FPA_GROUP_L2_INTERFACE_E,
-        .portNum = portNum,
-        .vlanId = vlanId
-    };
+    struct ds d_str = DS_EMPTY_INITIALIZER;
+    struct tap_config cfg = tap_config;
+    struct tap_info *info;
+    bool ok, restart;
+    int i;
 
-    err = fpaLibGroupIdentifierBuild(&ident, &gid);
-    if (err != FPA_OK) {
-        VLOG_ERR("failed to build group ID for portNum %d, vid %d, rc=%s",
-            portNum, vlanId, ops_fpa_strerr(err));
-        return EFAULT;
-    }
+    for (i = 1; i < argc; i++) {
+        char *key = xstrdup(argv[i]);
+        char *value = strchr(key, '=');
 
-    err = fpaLibGroupEntryBucketGet(switchId, gid, 0, &bucket);
-    if (err != FPA_OK) {
-        VLOG_INFO("Bucket not found for portNum %d, vid %d, rc=%s",
-            portNum, vlanId, ops_fpa_strerr(err));
-        return ENOENT;
+        ok = value != NULL;
+        if (ok) {
+            *value++ = '\0';
+            ok = tap_config_set(&cfg, key, value);
+        }
+        free(key);
+
+        if (!ok) {
+            ds_put_format(&d_str, "invalid setting '%s', expected workers=auto|1..%d, "
+                          "io=epoll|uring, pbuf-mem=heap|hugepages or "
+                          "svi-mode=bridge|direct", argv[i], OPS_FPA_TAP_WORKERS_MAX);
+            unixctl_command_reply_error(conn, ds_cstr(&d_str));
+            ds_destroy(&d_str);
+            return;
+        }
     }
 
-    *pop_tag = bucket.data.l2Interface.popVlanTagAction;
-
-    return 0;
-}
+    ops_fpa_dev_mutex_lock();
 
-int
-ops_fpa_net_if_setup(const char *name, const struct ether_addr *mac)
-{
-    int  rc = 0;
-    char buf[32] = {0};
+    restart = cfg.n_workers != tap_config.n_workers
+              || cfg.use_uring != tap_config.use_uring
+              || cfg.hugepages != tap_config.hugepages;
+    tap_config = cfg;
 
-    /* Bring the Ethernet interface DOWN. */
-    rc = ops_fpa_system("/sbin/ifconfig %s down", name);
-    if (rc != 0) {
-        VLOG_ERR("Failed to bring down %s interface. (rc=%d)",
-                 name, rc);
-        return EFAULT;
+    info = get_tap_info_by_switch_id(FPA_DEV_SWITCH_ID_DEFAULT);
+    if (info && restart) {
+        tap_threads_restart(info);
+        VLOG_INFO("CPU path threads restarted with new configuration");
     }
 
-    /* Set MAC address for the Ethernet interface. */
-    rc = ops_fpa_system("/sbin/ip link set %s address %s",
-                       name, ether_ntoa_r(mac, buf));
-    if (rc != 0) {
-        VLOG_ERR("Failed to set MAC address for %s interface. (rc=%d)",
-                 name, rc);
-        return EFAULT;
+    if (tap_config.n_workers) {
+        ds_put_format(&d_str, "  workers:  %d", tap_config.n_workers);
+    } else {
+        ds_put_cstr(&d_str, "  workers:  auto");
+    }
+    if (info) {
+        ds_put_format(&d_str, " (%d running)", info->n_workers);
+    }
+    ds_put_format(&d_str, "\n  io:       %s\n",
+                  tap_config.use_uring ? "uring" : "epoll");
+    ds_put_format(&d_str, "  pbuf-mem: %s\n",
+                  tap_config.hugepages ? "hugepages" : "heap");
+    ds_put_format(&d_str, "  svi-mode: %s",
+                  tap_config.svi_direct ? "direct" : "bridge");
+    if (tap_svi_direct() != tap_config.svi_direct) {
+        ds_put_format(&d_str, " (bridge interface is %s until created again)",
+                      tap_svi_direct() ? "direct" : "bridge");
     }
+    ds_put_cstr(&d_str, "\n");
 
-    VLOG_INFO("Set MAC address for %s to %s", name, buf);
+    ops_fpa_dev_mutex_unlock();
 
-    /* Bring the Ethernet interface UP. */
-    rc = ops_fpa_system("/sbin/ifconfig %s up", name);
-    if (rc != 0) {
-        VLOG_ERR("Failed to bring up %s interface. (rc=%d)",
-                 name, rc);
-        return EFAULT;
-    }
+    unixctl_command_reply(conn, ds_cstr(&d_str));
+    ds_destroy(&d_str);
+}
 
-    return 0;
+static void
+ops_fpa_tap_unixctl_init(void)
+{
+    static bool registered;
+    if (registered) {
+        return;
+    }
+    registered = true;
+
+    unixctl_command_register("fpa/tap/stats", "[switchId]", 0, 1,
+                             ops_fpa_tap_unixctl_stats, NULL);
+    unixctl_command_register("fpa/tap/counters", "[switchId]", 0, 1,
+                             ops_fpa_tap_unixctl_counters, NULL);
+    unixctl_command_register("fpa/tap/trace", "on|off|dump [switchId]", 1, 2,
+                             ops_fpa_tap_unixctl_trace, NULL);
+    unixctl_command_register("fpa/tap/sched", "strict|weighted [switchId]", 1, 2,
+                             ops_fpa_tap_unixctl_sched, NULL);
+    unixctl_command_register("fpa/tap/gro", "on|off [switchId]", 1, 2,
+                             ops_fpa_tap_unixctl_gro, NULL);
+    unixctl_command_register("fpa/tap/rx-poll", "off|IDLE_US [switchId]", 1, 2,
+                             ops_fpa_tap_unixctl_rx_poll, NULL);
+    unixctl_command_register("fpa/tap/rx-cpu", "CPU|none [switchId]", 1, 2,
+                             ops_fpa_tap_unixctl_rx_cpu, NULL);
+    unixctl_command_register("fpa/tap/latency", "show|clear [switchId]", 1, 2,
+                             ops_fpa_tap_unixctl_latency, NULL);
+    unixctl_command_register("fpa/tap/config", "[KEY=VALUE]...", 0, 4,
+                             ops_fpa_tap_unixctl_config, NULL);
+
+    ops_fpa_capture_unixctl_init();
 }
@@ -14,8 +14,12 @@
  *    permissions and limitations under the License.
  */
 
+#include <cmap.h>
+#include <hash.h>
+#include <ovs-rcu.h>
 #include "ops-fpa-vlan.h"
 #include "ops-fpa-route.h"
+#include "ops-fpa-bpf.h"
 
 VLOG_DEFINE_THIS_MODULE(ops_fpa_vlan);
 
@@ -55,6 +59,178 @@ ops_fpa_vlan_fetch(int sid, int pid, unsigned long *vmap)
     }
 }
 
+/* Egress tag state cache.
+ * Per port copy of egress state of FPA L2 interface groups, two bits per
+ * VLAN: VLAN_EG_MEMBER and VLAN_EG_POP. Updated in place word by word by
+ * ops_fpa_vlan_add()/ops_fpa_vlan_del(), read by CPU packet path without
+ * locking and without calls to FPA. Entries are freed after RCU grace
+ * period. */
+#define VLAN_EG_MEMBER  1
+#define VLAN_EG_POP     2
+#define VLAN_EG_BITS    2
+
+struct vlan_eg_entry {
+    struct cmap_node node;
+    int sid;
+    int pid;
+    atomic_ulong state[BITMAP_N_LONGS(VLAN_EG_BITS * VLAN_BITMAP_SIZE)];
+};
+
+static struct cmap vlan_eg_cache = CMAP_INITIALIZER;
+static struct ovs_mutex vlan_eg_mutex = OVS_MUTEX_INITIALIZER;
+
+static struct vlan_eg_entry *
+vlan_eg_entry_find(int sid, int pid)
+{
+    struct vlan_eg_entry *entry;
+
+    CMAP_FOR_EACH_WITH_HASH (entry, node, hash_2words(sid, pid), &vlan_eg_cache) {
+        if (entry->sid == sid && entry->pid == pid) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns VLAN_EG_* bits of 'vid' in 'entry' */
+static unsigned int
+vlan_eg_entry_get(struct vlan_eg_entry *entry, int vid)
+{
+    size_t bit = VLAN_EG_BITS * vid;
+    unsigned long word;
+
+    atomic_read_relaxed(&entry->state[bit / BITMAP_ULONG_BITS], &word);
+
+    return (word >> (bit % BITMAP_ULONG_BITS)) & (VLAN_EG_MEMBER | VLAN_EG_POP);
+}
+
+/* Replaces egress state of 'vid' on port 'pid' in cache.
+ * If 'member' is false port is removed from VLAN, otherwise its pop tag
+ * state is set to 'pop'. */
+static void
+vlan_eg_cache_update(int sid, int pid, int vid, bool member, bool pop)
+{
+    struct vlan_eg_entry *entry;
+    size_t bit = VLAN_EG_BITS * vid;
+    atomic_ulong *state;
+    unsigned long word;
+
+    ovs_mutex_lock(&vlan_eg_mutex);
+
+    entry = vlan_eg_entry_find(sid, pid);
+    if (!entry) {
+        if (!member) {
+            ovs_mutex_unlock(&vlan_eg_mutex);
+            return;
+        }
+        entry = xzalloc(sizeof *entry);
+        entry->sid = sid;
+        entry->pid = pid;
+        cmap_insert(&vlan_eg_cache, &entry->node, hash_2words(sid, pid));
+    }
+
+    /* Only this VLAN's bits change and writers are serialized by
+     * vlan_eg_mutex, readers see either old or new state of the word. */
+    state = &entry->state[bit / BITMAP_ULONG_BITS];
+    atomic_read_relaxed(state, &word);
+    word &= ~((unsigned long) (VLAN_EG_MEMBER | VLAN_EG_POP) << (bit % BITMAP_ULONG_BITS));
+    if (member) {
+        word |= (unsigned long) (VLAN_EG_MEMBER | (pop ? VLAN_EG_POP : 0))
+                << (bit % BITMAP_ULONG_BITS);
+    }
+    atomic_store_relaxed(state, word);
+
+    /* Same membership is checked by TAP filters in kernel */
+    ops_fpa_bpf_vlan_update(sid, pid, vid, member);
+
+    ovs_mutex_unlock(&vlan_eg_mutex);
+}
+
+int
+ops_fpa_vlan_egress_state(int sid, int pid, int vid, bool *pop)
+{
+    struct vlan_eg_entry *entry;
+    unsigned int state;
+
+    if (vid < 0 || vid >= VLAN_BITMAP_SIZE) {
+        return ENOENT;
+    }
+
+    entry = vlan_eg_entry_find(sid, pid);
+    if (!entry) {
+        return ENOENT;
+    }
+
+    state = vlan_eg_entry_get(entry, vid);
+    if (!(state & VLAN_EG_MEMBER)) {
+        return ENOENT;
+    }
+    *pop = state & VLAN_EG_POP;
+
+    return 0;
+}
+
+size_t
+ops_fpa_vlan_egress_members(int sid, int vid, uint32_t pids[], bool pops[],
+                            size_t max)
+{
+    struct vlan_eg_entry *entry;
+    size_t n = 0;
+
+    if (vid < 0 || vid >= VLAN_BITMAP_SIZE) {
+        return 0;
+    }
+
+    CMAP_FOR_EACH (entry, node, &vlan_eg_cache) {
+        unsigned int state;
+
+        if (entry->sid != sid) {
+            continue;
+        }
+
+        state = vlan_eg_entry_get(entry, vid);
+        if (state & VLAN_EG_MEMBER) {
+            if (n < max) {
+                pops[n] = state & VLAN_EG_POP;
+                pids[n] = entry->pid;
+            }
+            n++;
+        }
+    }
+
+    return n;
+}
+
+void
+ops_fpa_vlan_port_remove(int sid, int pid)
+{
+    unsigned long vmap[OPS_FPA_VMAP_LONGS];
+    struct vlan_eg_entry *entry;
+    int vidx;
+
+    /* Port leaves L2 interface groups of all its VLANs */
+    ops_fpa_vlan_fetch(sid, pid, vmap);
+    BITMAP_FOR_EACH_1 (vidx, OPS_FPA_VMAP_BITS, vmap) {
+        if (OPS_FPA_VIDX_IS_EGRESS(vidx)) {
+            int err = ops_fpa_vlan_del(sid, pid, vidx);
+            if (err) {
+                VLOG_ERR("%s: sid=%d pid=%d vid=%d: Unable to delete L2 group: %s",
+                         __func__, sid, pid, OPS_FPA_VIDX_VID(vidx),
+                         ops_fpa_strerr(err));
+            }
+        }
+    }
+
+    ovs_mutex_lock(&vlan_eg_mutex);
+    entry = vlan_eg_entry_find(sid, pid);
+    if (entry) {
+        cmap_remove(&vlan_eg_cache, &entry->node, hash_2words(sid, pid));
+        ovsrcu_postpone(free, entry);
+    }
+    ovs_mutex_unlock(&vlan_eg_mutex);
+}
+
 int
 ops_fpa_vlan_add(int sid, int pid, int vidx)
 {
@@ -62,7 +238,12 @@ ops_fpa_vlan_add(int sid, int pid, int vidx)
     /* for egress vidx -> create group table entry */
     if (OPS_FPA_VIDX_IS_EGRESS(vidx)) {
         uint32_t dummy;
-        return ops_fpa_route_add_l2_group(sid, pid, vid, OPS_FPA_VIDX_ARG(vidx), &dummy);
+        bool pop = OPS_FPA_VIDX_ARG(vidx);
+        int err = ops_fpa_route_add_l2_group(sid, pid, vid, pop, &dummy);
+        if (!err) {
+            vlan_eg_cache_update(sid, pid, vid, true, pop);
+        }
+        return err;
     }
     /* for ingress vidx -> create VLAN table entry */
     bool match_tagged = OPS_FPA_VIDX_ARG(vidx);
@@ -93,7 +274,11 @@ ops_fpa_vlan_del(int sid, int pid, int vidx)
         };
         uint32_t gid;
         fpaLibGroupIdentifierBuild(&ident, &gid);
-        return fpaLibGroupTableEntryDelete(sid, gid);
+        int err = fpaLibGroupTableEntryDelete(sid, gid);
+        if (!err) {
+            vlan_eg_cache_update(sid, pid, vid, false, false);
+        }
+        return err;
     }
     /* for ingress vidx -> delete VLAN table entry */
     bool match_tagged = OPS_FPA_VIDX_ARG(vidx);
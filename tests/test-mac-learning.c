@@ -0,0 +1,321 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *  File: test-mac-learning.c
+ *
+ *  Purpose: Unit tests of FDB key packing, AU event ring and mlearn
+ *           event spill limits.
+ */
+
+/* Static functions are tested, so the source is built into the test */
+#include "ops-fpa-mac-learning.c"
+#include <netdev-provider.h>
+
+#define TEST_PORT   1
+
+/* Plugin functions used by mac learning, the rest of plugin is not built
+ * into the test */
+static struct fpa_dev test_dev;
+static struct netdev test_netdev;
+static struct fpa_ofport test_port;
+
+struct fpa_dev *
+ops_fpa_dev_by_id(uint32_t switchId OVS_UNUSED)
+{
+    return &test_dev;
+}
+
+struct fpa_ofport *
+ops_fpa_get_ofport_by_pid(int pid)
+{
+    return pid == TEST_PORT ? &test_port : NULL;
+}
+
+const char *
+ops_fpa_strerr(int err OVS_UNUSED)
+{
+    return "test";
+}
+
+static struct fpa_mac_learning *
+test_ml_create(void)
+{
+    struct fpa_mac_learning *ml = xzalloc(sizeof *ml);
+    int idx;
+
+    cmap_init(&ml->table);
+    hmap_init(&ml->ports);
+    for (idx = 0; idx < OPS_FPA_ML_MAX_VLANS; idx++) {
+        list_init(&ml->vlan_entries[idx]);
+    }
+    ml->dev = &test_dev;
+    ovs_rwlock_init(&ml->rwlock);
+    ml->events = xzalloc_cacheline(sizeof *ml->events);
+    atomic_init(&ml->mlearn_deadline, LLONG_MAX);
+    ml->mlearn_seq = seq_create();
+    hmap_init(&ml->mlearn_spill);
+
+    for (idx = 0; idx < OPS_FPA_ML_NUM_BUFFERS; idx++) {
+        hmap_init(&ml->mlearn_event_tables[idx].table);
+        ml->mlearn_event_tables[idx].buffer.size = BUFFER_SIZE;
+    }
+
+    return ml;
+}
+
+static void
+test_ml_destroy(struct fpa_mac_learning *ml)
+{
+    struct ml_spill_event *s, *next;
+    int idx;
+
+    HMAP_FOR_EACH_SAFE (s, next, hmap_node, &ml->mlearn_spill) {
+        hmap_remove(&ml->mlearn_spill, &s->hmap_node);
+        free(s);
+    }
+    hmap_destroy(&ml->mlearn_spill);
+    for (idx = 0; idx < OPS_FPA_ML_NUM_BUFFERS; idx++) {
+        hmap_destroy(&ml->mlearn_event_tables[idx].table);
+    }
+    seq_destroy(ml->mlearn_seq);
+    free_cacheline(ml->events);
+    ovs_rwlock_destroy(&ml->rwlock);
+    hmap_destroy(&ml->ports);
+    cmap_destroy(&ml->table);
+    free(ml);
+}
+
+static void
+test_key(void)
+{
+    static const uint16_t vids[] = { 0, 1, 100, 4094, 4095 };
+    static const uint8_t macs[][ETH_ADDR_LEN] = {
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 },
+        { 0x01, 0x80, 0xc2, 0x00, 0x00, 0x0e },
+        { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+    };
+    size_t i, j;
+
+    for (i = 0; i < ARRAY_SIZE(vids); i++) {
+        for (j = 0; j < ARRAY_SIZE(macs); j++) {
+            FPA_MAC_ADDRESS_STC mac, out;
+            uint64_t key;
+
+            memcpy(mac.addr, macs[j], ETH_ADDR_LEN);
+            key = ops_fpa_ml_key(vids[i], &mac);
+
+            ovs_assert(ops_fpa_ml_key_vid(key) == vids[i]);
+            ops_fpa_ml_key_mac(key, &out);
+            ovs_assert(!memcmp(out.addr, mac.addr, ETH_ADDR_LEN));
+
+            /* VLAN and MAC don't overlap */
+            ovs_assert((key & 0xffffffffffffULL)
+                       == ops_fpa_ml_key(0, &mac));
+            ovs_assert(key >> 48 == vids[i]);
+        }
+    }
+}
+
+static void
+test_ring(void)
+{
+    struct fpa_mac_learning *ml = test_ml_create();
+    uint32_t start = UINT32_MAX - OPS_FPA_ML_RING_SIZE / 2;
+    uint32_t limit;
+    struct fpa_ml_event ev;
+    uint32_t i;
+
+    /* Ring positions wrap around in the middle of the ring */
+    atomic_init(&ml->events->head, start);
+    atomic_init(&ml->events->tail, start);
+
+    memset(&ev, 0, sizeof ev);
+    for (i = 0; i < OPS_FPA_ML_RING_SIZE; i++) {
+        ev.data.index = i;
+        ovs_assert(ml_ring_push(ml, &ev));
+    }
+    ovs_assert(!ml_ring_push(ml, &ev));
+
+    /* Events queued at or past 'limit' are left in the ring */
+    limit = start + OPS_FPA_ML_RING_SIZE * 3 / 4;
+    for (i = 0; i < OPS_FPA_ML_RING_SIZE * 3 / 4; i++) {
+        ovs_assert(ml_ring_pop(ml, limit, &ev));
+        ovs_assert(ev.data.index == i);
+    }
+    ovs_assert(!ml_ring_pop(ml, limit, &ev));
+
+    /* Freed slots are reused */
+    for (i = 0; i < OPS_FPA_ML_RING_SIZE * 3 / 4; i++) {
+        ev.data.index = OPS_FPA_ML_RING_SIZE + i;
+        ovs_assert(ml_ring_push(ml, &ev));
+    }
+    ovs_assert(!ml_ring_push(ml, &ev));
+
+    limit = start + 2 * OPS_FPA_ML_RING_SIZE;
+    for (i = OPS_FPA_ML_RING_SIZE * 3 / 4; i < OPS_FPA_ML_RING_SIZE * 7 / 4;
+         i++) {
+        ovs_assert(ml_ring_pop(ml, limit, &ev));
+        ovs_assert(ev.data.index == i);
+    }
+    ovs_assert(!ml_ring_pop(ml, limit, &ev));
+
+    test_ml_destroy(ml);
+}
+
+/* Queues mlearn event for the 'n'th test address */
+static void
+test_mlearn_add(struct fpa_mac_learning *ml, uint32_t n, uint32_t portNum,
+                const mac_event event)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    FPA_EVENT_ADDRESS_MSG_STC msg;
+
+    memset(&msg, 0, sizeof msg);
+    msg.vid = 1;
+    msg.address.addr[2] = n >> 24;
+    msg.address.addr[3] = n >> 16;
+    msg.address.addr[4] = n >> 8;
+    msg.address.addr[5] = n;
+    msg.portNum = portNum;
+
+    mac_learning_mlearn_add(ml, &msg, n, n, event);
+}
+
+static size_t
+test_mlearn_pending(const struct fpa_mac_learning *ml)
+{
+    return ml->mlearn_event_tables[ml->curr_mlearn_table_in_use]
+           .buffer.actual_size;
+}
+
+static void
+test_spill(void)
+{
+    struct fpa_mac_learning *ml = test_ml_create();
+    uint64_t dropped, lost;
+    uint32_t n = 0;
+    size_t i;
+
+    ovs_rwlock_wrlock(&ml->rwlock);
+
+    /* Event of deleted port is skipped */
+    test_mlearn_add(ml, n++, TEST_PORT + 1, MLEARN_ADD);
+    ovs_assert(!test_mlearn_pending(ml));
+
+    /* Events past full mlearn table are put off up to ML_SPILL_MAX */
+    for (i = 0; i < BUFFER_SIZE + ML_SPILL_MAX; i++) {
+        test_mlearn_add(ml, n++, TEST_PORT, MLEARN_ADD);
+    }
+    ovs_assert(test_mlearn_pending(ml) == BUFFER_SIZE);
+    ovs_assert(hmap_count(&ml->mlearn_spill) == ML_SPILL_MAX);
+    ovs_assert(!ml->mlearn_resync);
+
+    /* Add event past it is dropped and recovered by resync */
+    test_mlearn_add(ml, n++, TEST_PORT, MLEARN_ADD);
+    ovs_assert(hmap_count(&ml->mlearn_spill) == ML_SPILL_MAX);
+    ovs_assert(ml->mlearn_resync);
+    atomic_read_relaxed(&ml->stats.mlearn_dropped, &dropped);
+    ovs_assert(dropped == 1);
+
+    /* Delete events are put off up to ML_SPILL_HARD_MAX */
+    for (i = ML_SPILL_MAX; i < ML_SPILL_HARD_MAX; i++) {
+        test_mlearn_add(ml, n++, TEST_PORT, MLEARN_DEL);
+    }
+    ovs_assert(hmap_count(&ml->mlearn_spill) == ML_SPILL_HARD_MAX);
+    test_mlearn_add(ml, n++, TEST_PORT, MLEARN_DEL);
+    ovs_assert(hmap_count(&ml->mlearn_spill) == ML_SPILL_HARD_MAX);
+    atomic_read_relaxed(&ml->stats.mlearn_lost, &lost);
+    ovs_assert(lost == 1);
+
+    /* Event for put off address updates it in place */
+    test_mlearn_add(ml, BUFFER_SIZE + 1, TEST_PORT, MLEARN_DEL);
+    ovs_assert(hmap_count(&ml->mlearn_spill) == ML_SPILL_HARD_MAX);
+
+    ovs_rwlock_unlock(&ml->rwlock);
+    test_ml_destroy(ml);
+}
+
+/* Hands over current mlearn table the way vswitchd notification does */
+static void
+test_mlearn_hand_over(struct fpa_mac_learning *ml)
+    OVS_REQ_WRLOCK(ml->rwlock)
+{
+    ml->curr_mlearn_table_in_use = ml->curr_mlearn_table_in_use ^ 1;
+    ops_fpa_mac_learning_clear_mlearn_hmap(
+        &ml->mlearn_event_tables[ml->curr_mlearn_table_in_use]);
+    mac_learning_mlearn_unspill(ml);
+}
+
+static void
+test_resync(void)
+{
+    struct fpa_mac_learning *ml = test_ml_create();
+    size_t n = BUFFER_SIZE + ML_SPILL_MAX + 10;
+    struct fpa_mac_entry *entries = xcalloc(n, sizeof *entries);
+    uint64_t resyncs;
+    size_t i;
+
+    ovs_rwlock_wrlock(&ml->rwlock);
+
+    for (i = 0; i < n; i++) {
+        FPA_MAC_ADDRESS_STC mac;
+
+        memset(&mac, 0, sizeof mac);
+        mac.addr[4] = i >> 8;
+        mac.addr[5] = i;
+        entries[i].key = ops_fpa_ml_key(1, &mac);
+        entries[i].hash = i;
+        entries[i].portNum = TEST_PORT;
+        cmap_insert(&ml->table, &entries[i].cmap_node, entries[i].hash);
+    }
+
+    /* Resync stops once ML_SPILL_MAX events are put off */
+    ml->mlearn_resync = true;
+    mac_learning_mlearn_resync(ml);
+    ovs_assert(test_mlearn_pending(ml) == BUFFER_SIZE);
+    ovs_assert(hmap_count(&ml->mlearn_spill) == ML_SPILL_MAX);
+    ovs_assert(ml->mlearn_resync);
+
+    /* and goes on after the hand over, from where it stopped */
+    test_mlearn_hand_over(ml);
+    mac_learning_mlearn_resync(ml);
+    ovs_assert(!ml->mlearn_resync);
+    ovs_assert(test_mlearn_pending(ml) == BUFFER_SIZE);
+    ovs_assert(hmap_count(&ml->mlearn_spill) == n - 2 * BUFFER_SIZE);
+    atomic_read_relaxed(&ml->stats.mlearn_resyncs, &resyncs);
+    ovs_assert(resyncs == 1);
+
+    ovs_rwlock_unlock(&ml->rwlock);
+    for (i = 0; i < n; i++) {
+        cmap_remove(&ml->table, &entries[i].cmap_node, entries[i].hash);
+    }
+    test_ml_destroy(ml);
+    free(entries);
+}
+
+int
+main(void)
+{
+    test_netdev.name = CONST_CAST(char *, "1");
+    test_port.up.netdev = &test_netdev;
+
+    test_key();
+    test_ring();
+    test_spill();
+    test_resync();
+
+    return 0;
+}
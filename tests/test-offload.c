@@ -0,0 +1,278 @@
+/*
+ *  Copyright (C) 2016, Marvell International Ltd. ALL RIGHTS RESERVED.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *    not use this file except in compliance with the License. You may obtain
+ *    a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ *    CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ *    LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS
+ *    FOR A PARTICULAR PURPOSE, MERCHANTABILITY OR NON-INFRINGEMENT.
+ *
+ *    See the Apache Version 2.0 License for specific language governing
+ *    permissions and limitations under the License.
+ *
+ *  File: test-offload.c
+ *
+ *  Purpose: Unit tests of TCP segmentation (GSO) and receive coalescing
+ *           (GRO) of CPU TAP interfaces.
+ */
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <csum.h>
+
+#include "ops-fpa.h"
+#include "ops-fpa-offload.h"
+
+#define TEST_HDR_LEN    (14 + 20 + 20)
+#define TEST_MSS        1000
+#define TEST_SEQ        0xfffffe00  /* Sequence numbers wrap around */
+#define TEST_IP_ID      0x1234
+#define TEST_MAX_SEGS   8
+
+#define TCP_PSH         0x08
+#define TCP_ACK         0x10
+
+static uint8_t
+test_payload(uint32_t off)
+{
+    return off % 251;
+}
+
+static uint32_t
+test_pseudo(const uint8_t *ip, uint32_t tcp_len)
+{
+    uint32_t partial;
+
+    partial = csum_continue(0, ip + 12, 8);
+    partial = csum_add16(partial, htons(IPPROTO_TCP));
+    return csum_add16(partial, htons(tcp_len));
+}
+
+/* Builds TCP/IPv4 frame with valid checksums, payload starts at stream
+ * offset 'off'. Returns frame length. */
+static uint32_t
+test_build_frame(uint8_t *data, uint32_t off, uint32_t payload, uint8_t flags)
+{
+    static const uint8_t macs[2 * ETH_ALEN] = {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    };
+    uint8_t *ip = data + 14;
+    uint8_t *tcp = ip + 20;
+    uint32_t seq = TEST_SEQ + off;
+    ovs_be16 sum;
+    uint32_t i;
+
+    memset(data, 0, TEST_HDR_LEN);
+    memcpy(data, macs, sizeof macs);
+    data[12] = ETHERTYPE_IP >> 8;
+    data[13] = ETHERTYPE_IP & 0xff;
+
+    ip[0] = 0x45;
+    ip[2] = (20 + 20 + payload) >> 8;
+    ip[3] = 20 + 20 + payload;
+    ip[4] = TEST_IP_ID >> 8;
+    ip[5] = TEST_IP_ID & 0xff;
+    ip[8] = 64;
+    ip[9] = IPPROTO_TCP;
+    memcpy(ip + 12, "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+    sum = csum(ip, 20);
+    memcpy(ip + 10, &sum, sizeof sum);
+
+    tcp[0] = 0xc0;                  /* Source port 49152 */
+    tcp[3] = 179;                   /* Destination port BGP */
+    tcp[4] = seq >> 24;
+    tcp[5] = seq >> 16;
+    tcp[6] = seq >> 8;
+    tcp[7] = seq;
+    tcp[11] = 1;                    /* Ack */
+    tcp[12] = 5 << 4;
+    tcp[13] = flags;
+    tcp[14] = 0xff;                 /* Window */
+
+    for (i = 0; i < payload; i++) {
+        data[TEST_HDR_LEN + i] = test_payload(off + i);
+    }
+
+    sum = csum_finish(csum_continue(test_pseudo(ip, 20 + payload), tcp,
+                                    20 + payload));
+    memcpy(tcp + 16, &sum, sizeof sum);
+
+    return TEST_HDR_LEN + payload;
+}
+
+static uint32_t
+test_get_be32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Checks IPv4 and TCP checksums of 'data' and that its payload continues
+ * stream at its sequence number */
+static void
+test_check_frame(const uint8_t *data, uint32_t len)
+{
+    const uint8_t *ip = data + 14;
+    const uint8_t *tcp = ip + 20;
+    uint32_t off = test_get_be32(tcp + 4) - TEST_SEQ;
+    uint32_t i;
+
+    ovs_assert(len > TEST_HDR_LEN);
+    ovs_assert(((ip[2] << 8) | ip[3]) == len - 14);
+    ovs_assert(!csum(ip, 20));
+    ovs_assert(!csum_finish(csum_continue(test_pseudo(ip, len - 34), tcp,
+                                          len - 34)));
+    for (i = 0; i < len - TEST_HDR_LEN; i++) {
+        ovs_assert(data[TEST_HDR_LEN + i] == test_payload(off + i));
+    }
+}
+
+struct test_segs {
+    uint8_t data[TEST_MAX_SEGS][TEST_HDR_LEN + TEST_MSS];
+    uint32_t len[TEST_MAX_SEGS];
+    size_t n;
+};
+
+static void
+test_gso_cb(void *aux, uint8_t *data, uint32_t len)
+{
+    struct test_segs *segs = aux;
+
+    ovs_assert(segs->n < TEST_MAX_SEGS);
+    ovs_assert(len <= sizeof segs->data[0]);
+    memcpy(segs->data[segs->n], data, len);
+    segs->len[segs->n++] = len;
+}
+
+static void
+test_gso(struct test_segs *segs)
+{
+    uint8_t *frame = xmalloc(OPS_FPA_GSO_MAX_LEN);
+    uint32_t payload = 3 * TEST_MSS + 100;
+    struct virtio_net_hdr vh;
+    uint32_t len;
+    size_t i;
+
+    len = test_build_frame(frame, 0, payload, TCP_ACK | TCP_PSH);
+
+    memset(&vh, 0, sizeof vh);
+    vh.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    vh.gso_size = TEST_MSS;
+    vh.hdr_len = TEST_HDR_LEN;
+
+    memset(segs, 0, sizeof *segs);
+    ovs_assert(!ops_fpa_gso_segment(frame, len, &vh, test_gso_cb, segs));
+    ovs_assert(segs->n == 4);
+
+    for (i = 0; i < segs->n; i++) {
+        const uint8_t *ip = segs->data[i] + 14;
+        const uint8_t *tcp = ip + 20;
+
+        ovs_assert(segs->len[i] == TEST_HDR_LEN + (i < 3 ? TEST_MSS : 100));
+        ovs_assert(test_get_be32(tcp + 4)
+                   == (uint32_t) (TEST_SEQ + i * TEST_MSS));
+        ovs_assert(((ip[4] << 8) | ip[5]) == TEST_IP_ID + i);
+        /* PSH only on the last segment */
+        ovs_assert(tcp[13] == (i < 3 ? TCP_ACK : TCP_ACK | TCP_PSH));
+        test_check_frame(segs->data[i], segs->len[i]);
+    }
+
+    /* Only TCP is segmented */
+    vh.gso_type = VIRTIO_NET_HDR_GSO_UDP;
+    ovs_assert(ops_fpa_gso_segment(frame, len, &vh, test_gso_cb, segs)
+               == EOPNOTSUPP);
+
+    free(frame);
+}
+
+struct test_frames {
+    uint8_t data[OPS_FPA_GSO_MAX_LEN];
+    uint32_t len;
+    uint32_t n_segs;
+    struct virtio_net_hdr vh;
+    size_t n;
+};
+
+static void
+test_gro_cb(void *aux, void *owner OVS_UNUSED,
+            const struct virtio_net_hdr *vh, const uint8_t *data,
+            uint32_t len, uint32_t n_segs)
+{
+    struct test_frames *frames = aux;
+
+    /* Only the last frame is kept */
+    memcpy(frames->data, data, len);
+    frames->len = len;
+    frames->n_segs = n_segs;
+    frames->vh = *vh;
+    frames->n++;
+}
+
+static void
+test_gro(const struct test_segs *segs)
+{
+    struct test_frames *frames = xzalloc(sizeof *frames);
+    struct ops_fpa_gro gro;
+    uint8_t seg[TEST_HDR_LEN + TEST_MSS];
+    int owner;
+    size_t i;
+
+    ops_fpa_gro_init(&gro, test_gro_cb, frames);
+
+    /* Short last segment ends the frame */
+    for (i = 0; i < segs->n; i++) {
+        ovs_assert(ops_fpa_gro_add(&gro, &owner, segs->data[i],
+                                   segs->len[i]));
+    }
+    ovs_assert(frames->n == 1);
+    ovs_assert(frames->n_segs == segs->n);
+    ovs_assert(frames->len == TEST_HDR_LEN + 3 * TEST_MSS + 100);
+    ovs_assert(frames->vh.gso_type == VIRTIO_NET_HDR_GSO_TCPV4);
+    ovs_assert(frames->vh.gso_size == TEST_MSS);
+    ovs_assert(frames->vh.hdr_len == TEST_HDR_LEN);
+    ovs_assert(frames->data[14 + 20 + 13] == (TCP_ACK | TCP_PSH));
+
+    /* Kernel completes checksum of coalesced frame */
+    ovs_assert(!ops_fpa_csum_complete(frames->data, frames->len,
+                                      &frames->vh));
+    test_check_frame(frames->data, frames->len);
+
+    /* Segment out of order flushes pending frame */
+    memset(frames, 0, sizeof *frames);
+    ovs_assert(ops_fpa_gro_add(&gro, &owner, segs->data[0], segs->len[0]));
+    ovs_assert(ops_fpa_gro_add(&gro, &owner, segs->data[2], segs->len[2]));
+    ovs_assert(frames->n == 1);
+    ovs_assert(frames->n_segs == 1);
+    ovs_assert(!frames->vh.gso_type);
+    ovs_assert(frames->len == segs->len[0]);
+    ops_fpa_gro_flush(&gro);
+    ovs_assert(frames->n == 2);
+    ovs_assert(test_get_be32(frames->data + 14 + 20 + 4)
+               == TEST_SEQ + 2 * TEST_MSS);
+
+    /* Segment with bad checksum is not coalesced */
+    memset(frames, 0, sizeof *frames);
+    ovs_assert(ops_fpa_gro_add(&gro, &owner, segs->data[0], segs->len[0]));
+    memcpy(seg, segs->data[1], segs->len[1]);
+    seg[TEST_HDR_LEN] ^= 0xff;
+    ovs_assert(!ops_fpa_gro_add(&gro, &owner, seg, segs->len[1]));
+    ovs_assert(frames->n == 1);
+    ovs_assert(frames->n_segs == 1);
+
+    ops_fpa_gro_destroy(&gro);
+    free(frames);
+}
+
+int
+main(void)
+{
+    struct test_segs *segs = xmalloc(sizeof *segs);
+
+    test_gso(segs);
+    test_gro(segs);
+
+    free(segs);
+    return 0;
+}